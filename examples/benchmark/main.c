@@ -0,0 +1,39 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <perf/benchmark.h>
+
+#define ELEMENTS 4096
+
+static uint32_t numbers[ELEMENTS];
+
+PERF_BENCHMARK(sum_forwards) {
+  uint64_t sum = 0;
+  for (int i = 0; i < ELEMENTS; i++)
+    sum += numbers[i];
+  perf_benchmark_keep(sum);
+}
+
+PERF_BENCHMARK(sum_strided) {
+  uint64_t sum = 0;
+  for (int stride = 0; stride < 16; stride++) {
+    for (int i = stride; i < ELEMENTS; i += 16)
+      sum += numbers[i];
+  }
+  perf_benchmark_keep(sum);
+}
+
+PERF_BENCHMARK(copy) {
+  static uint32_t target[ELEMENTS];
+  memcpy(target, numbers, sizeof(numbers));
+  perf_benchmark_keep(target[0]);
+}
+
+int main(int argc, char **argv) {
+  for (int i = 0; i < ELEMENTS; i++)
+    numbers[i] = rand();
+
+  // Run all registered benchmarks, see --help for the available options
+  return perf_benchmark_main(argc, argv);
+}
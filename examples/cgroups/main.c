@@ -0,0 +1,115 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <perf/event_set.h>
+#include <perf/group.h>
+#include <perf/utilities.h>
+
+struct timespec one_second = {1, 0};
+
+// Get the cgroup v2 path of the calling process, such as /user.slice.
+// Returns <0 if an error occured.
+static int get_own_cgroup(char *path, size_t size) {
+  FILE *cgroups = fopen("/proc/self/cgroup", "r");
+  if (cgroups == NULL)
+    return PERF_ERROR_IO;
+
+  // The cgroup v2 hierarchy is listed as "0::/path"
+  char line[4096];
+  while (fgets(line, sizeof(line), cgroups) != NULL) {
+    if (strncmp(line, "0::", 3) != 0)
+      continue;
+
+    line[strcspn(line, "\n")] = '\0';
+    fclose(cgroups);
+    // Relative to the cgroup2 mount
+    snprintf(path, size, "%s", line[3] == '/' ? line + 4 : line + 3);
+    return 0;
+  }
+
+  fclose(cgroups);
+  return PERF_ERROR_NOT_SUPPORTED;
+}
+
+int main(int argc, char **argv) {
+  // Measure the cgroups given as arguments, such as system.slice/docker-<id>.scope, or the own cgroup
+  char own[4096];
+  const char *own_paths[] = {own};
+  const char **paths = (const char **)&argv[1];
+  int count = argc - 1;
+  if (count == 0) {
+    if (get_own_cgroup(own, sizeof(own)) < 0) {
+      fprintf(stderr, "error: cgroup v2 not available\n");
+      return EXIT_FAILURE;
+    }
+    paths = own_paths;
+    count = 1;
+  }
+
+  // Describe the events to measure per container. The prototype itself is never opened.
+  // Cgroups are counted per CPU, where the task clock does not count, so use the CPU clock
+  perf_group_t *prototype = perf_create_group(4, -1, -1);
+  int measure_cpu_clock = perf_group_add_measurement(prototype, "cpu clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK);
+  int measure_instructions = perf_group_add_measurement(prototype, "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  int measure_cycles = perf_group_add_measurement(prototype, "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  int measure_cache_misses = perf_group_add_measurement(prototype, "cache misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+  // One event set per container, each fanned out across all CPUs
+  perf_event_set_t **sets = (perf_event_set_t **)calloc(count, sizeof(perf_event_set_t *));
+  if (sets == NULL) {
+    perror("unable to allocate");
+    return EXIT_FAILURE;
+  }
+
+  for (int i = 0; i < count; i++) {
+    sets[i] = perf_create_cgroup_event_set(prototype, paths[i]);
+    if (sets[i] == NULL) {
+      fprintf(stderr, "error: unable to measure cgroup %s: ", paths[i]);
+      perror(NULL);
+      return EXIT_FAILURE;
+    }
+
+    int status = perf_open_event_set(sets[i], 0);
+    if (status < 0) {
+      perf_print_error(status);
+      return EXIT_FAILURE;
+    }
+  }
+  free((void *)prototype);
+
+  for (int i = 0; i < count; i++)
+    perf_start_event_set(sets[i]);
+  // Let the containers run for a while
+  nanosleep(&one_second, NULL);
+  for (int i = 0; i < count; i++)
+    perf_stop_event_set(sets[i]);
+
+  printf("%-40s%17s%17s%17s%9s%17s\n", "cgroup", "cpu clock", "instructions", "cycles", "IPC", "cache misses");
+  for (int i = 0; i < count; i++) {
+    int status = perf_read_event_set(sets[i]);
+    if (status < 0) {
+      perf_print_error(status);
+      return EXIT_FAILURE;
+    }
+
+    const uint64_t *totals = sets[i]->totals;
+    printf("%-40s%17" PRIu64 "%17" PRIu64 "%17" PRIu64, paths[i][0] == '\0' ? "/" : paths[i], totals[measure_cpu_clock], totals[measure_instructions], totals[measure_cycles]);
+    // Without hardware counters there are no cycles to relate to
+    if (totals[measure_cycles] > 0)
+      printf("%9.2f", (double)totals[measure_instructions] / (double)totals[measure_cycles]);
+    else
+      printf("%9s", "n/a");
+    printf("%17" PRIu64 "\n", totals[measure_cache_misses]);
+  }
+
+  for (int i = 0; i < count; i++) {
+    perf_close_event_set(sets[i]);
+    perf_free_event_set(sets[i]);
+  }
+  free((void *)sets);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <perf/collector.h>
+#include <perf/group.h>
+#include <perf/utilities.h>
+
+// A service handling requests, with some idle time between them
+static void serve(int seconds) {
+  struct timespec idle = {0, 1000000};
+  time_t end = time(NULL) + seconds;
+  volatile double result = 0;
+  while (time(NULL) < end) {
+    for (int i = 0; i < 100000; i++)
+      result += sqrt((double)i);
+    nanosleep(&idle, NULL);
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "/tmp/perf.sock";
+  int seconds = argc > 2 ? atoi(argv[2]) : 5;
+
+  perf_group_t *group = perf_create_group(4, 0, -1);
+  if (group == NULL) {
+    perror("unable to create group");
+    return EXIT_FAILURE;
+  }
+
+  perf_group_add_measurement(group, "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  perf_group_add_measurement(group, "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  perf_group_add_measurement(group, "task clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+  perf_group_add_measurement(group, "context switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+
+  int status = perf_open_group(group, 0);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+
+  // Read the group every 500ms, keeping the last minute of samples
+  perf_collector_t *collector = perf_create_collector(1, 120, 500);
+  if (collector == NULL) {
+    perror("unable to create collector");
+    return EXIT_FAILURE;
+  }
+
+  perf_collector_add_group(collector, "service", group);
+
+  status = perf_collector_listen(collector, path);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+
+  status = perf_start_collector(collector);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+
+  fprintf(stderr, "serving metrics on %s for %ds, try: curl --unix-socket %s http://localhost/metrics\n", path, seconds, path);
+  serve(seconds);
+
+  perf_stop_collector(collector);
+  perf_collector_exposition(collector, collector->buffer, PERF_COLLECTOR_BUFFER_SIZE);
+  printf("%s", collector->buffer);
+
+  perf_free_collector(collector);
+  perf_close_group(group);
+  free((void *)group);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,43 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <system_error>
+
+#include <perf/perf.hpp>
+
+using namespace perf::events;
+
+static double compute(int iterations) {
+  volatile double result = 0;
+  for (int i = 0; i < iterations; i++)
+    result += std::sqrt((double)i);
+  return result;
+}
+
+int main(int argc, char **argv) {
+  try {
+    // The events are part of the type. The slot of each is known at compile time
+    perf::group<task_clock, context_switches, page_faults> group;
+
+    group.start();
+    compute(10000000);
+    group.stop();
+
+    auto values = group.read();
+    std::printf("task clock: %lu\n", (unsigned long)values.get<task_clock>());
+    std::printf("context switches: %lu\n", (unsigned long)values.get<context_switches>());
+    std::printf("page faults: %lu\n", (unsigned long)values.get<page_faults>());
+
+    // A single counter left running, read as a difference. Uses rdpmc for hardware events
+    perf::counter<task_clock> clock;
+    uint64_t start = clock.read();
+    compute(1000000);
+    std::printf("task clock: %lu (%s)\n", (unsigned long)(clock.read() - start), clock.is_userspace() ? "rdpmc" : "syscall");
+  } catch (const std::system_error &error) {
+    // Every measurement opened so far has already been closed
+    std::fprintf(stderr, "error: %s\n", error.what());
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
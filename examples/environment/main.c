@@ -0,0 +1,39 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <perf/environment.h>
+#include <perf/utilities.h>
+
+int main(int argc, char **argv) {
+  // The cache is optional, but makes subsequent runs on the same system skip probing
+  const char *cache_path = argc > 1 ? argv[1] : NULL;
+
+  const perf_environment_t *environment = perf_get_environment();
+  printf("kernel:            %s\n", environment->kernel_release);
+  printf("cpu:               %s\n", environment->cpu_model);
+  printf("paranoia:          %d\n", environment->paranoia);
+  printf("CAP_SYS_ADMIN:     %d\n", environment->has_cap_sys_admin);
+  printf("CAP_PERFMON:       %d\n", environment->has_cap_perfmon);
+  printf("pmus:             ");
+  for (size_t i = 0; i < environment->pmus; i++)
+    printf(" %s (%d)", environment->pmu[i].name, environment->pmu[i].type);
+  printf("\n");
+
+  perf_event_support_t support;
+  int status = perf_probe_event_support(&support, cache_path);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+  printf("support:           %s\n", status == 1 ? "cached" : "probed");
+
+  printf("instructions:      %d\n", perf_event_support_lookup(&support, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS));
+  printf("cpu cycles:        %d\n", perf_event_support_lookup(&support, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES));
+  printf("task clock:        %d\n", perf_event_support_lookup(&support, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK));
+  printf("context switches:  %d\n", perf_event_support_lookup(&support, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES));
+  uint64_t l1d_read_misses = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  printf("L1D read misses:   %d\n", perf_event_support_lookup(&support, PERF_TYPE_HW_CACHE, l1d_read_misses));
+
+  return EXIT_SUCCESS;
+}
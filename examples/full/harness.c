@@ -4,8 +4,20 @@
 #include <sys/mman.h>
 
 #include "harness.h"
+#include "perf/calibration.h"
+#include "perf/group.h"
+#include "perf/statistics.h"
 #include "perf/utilities.h"
 
+perf_statistics_t *measurements;
+perf_calibration_t *overhead;
+perf_group_t *all_measurements;
+int measure_instruction_count;
+int measure_cycle_count;
+int measure_context_switches;
+int measure_cpu_clock;
+int measure_branch_misses;
+
 static int prepared_successfully = 0;
 
 // Call prepare before executing main
@@ -35,7 +47,7 @@ void assert_support() {
   }
 }
 
-void prepare_measurement(const char *description, perf_measurement_t *measurement, perf_measurement_t *parent_measurement) {
+void assert_privilege(const perf_measurement_t *measurement) {
   int status = perf_has_sufficient_privilege(measurement);
   if (status < 0) {
     perf_print_error(status);
@@ -44,23 +56,6 @@ void prepare_measurement(const char *description, perf_measurement_t *measuremen
     fprintf(stderr, "error: unprivileged user\n");
     exit(EXIT_FAILURE);
   }
-
-  int support_status = perf_event_is_supported(measurement);
-  if (support_status < 0) {
-    perf_print_error(support_status);
-    exit(EXIT_FAILURE);
-  } else if (support_status == 0) {
-    fprintf(stderr, "warning: %s not supported\n", description);
-    return;
-  }
-
-  int group = parent_measurement == NULL ? -1 : parent_measurement->file_descriptor;
-
-  status = perf_open_measurement(measurement, group, 0);
-  if (status < 0) {
-    perf_print_error(status);
-    exit(EXIT_FAILURE);
-  }
 }
 
 void prepare() {
@@ -69,53 +64,74 @@ void prepare() {
   // Fail if the perf API is unsupported
   assert_support();
 
-  // Create a dummy measurement (measures nothing) to act as a group leader
-  all_measurements = perf_create_measurement(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_DUMMY, 0, -1);
-  prepare_measurement("software dummy counter", all_measurements, NULL);
+  // Create a group to measure all events simultaneously
+  all_measurements = perf_create_group(5, 0, -1);
+  if (all_measurements == NULL) {
+    perror("unable to create group");
+    exit(EXIT_FAILURE);
+  }
 
   // Measure the number of retired instructions
-  measure_instruction_count = perf_create_measurement(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 0, -1);
-  measure_instruction_count->attribute.exclude_kernel = 1;
-  prepare_measurement("hardware instruction counter", measure_instruction_count, all_measurements);
+  measure_instruction_count = perf_group_add_measurement(all_measurements, "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  all_measurements->members[measure_instruction_count].attribute.exclude_kernel = 1;
+  all_measurements->members[measure_instruction_count].attribute.exclude_hv = 1;
 
   // Measure the number of CPU cycles (at least on Intel CPUs, see https://perf.wiki.kernel.org/index.php/Tutorial#Default_event:_cycle_counting)
-  measure_cycle_count = perf_create_measurement(PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES, 0, -1);
-  measure_cycle_count->attribute.exclude_kernel = 1;
-  prepare_measurement("hardware cycles counter", measure_cycle_count, all_measurements);
+  measure_cycle_count = perf_group_add_measurement(all_measurements, "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES);
+  all_measurements->members[measure_cycle_count].attribute.exclude_kernel = 1;
 
   // Measure the number of context switches
-  measure_context_switches = perf_create_measurement(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, 0, -1);
-  prepare_measurement("software context switches counter", measure_context_switches, all_measurements);
+  measure_context_switches = perf_group_add_measurement(all_measurements, "context switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
 
   // Measure the CPU clock related to the task (see https://stackoverflow.com/questions/23965363/linux-perf-events-cpu-clock-and-task-clock-what-is-the-difference)
-  measure_cpu_clock = perf_create_measurement(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, 0, -1);
-  prepare_measurement("software task clock", measure_cpu_clock, all_measurements);
+  measure_cpu_clock = perf_group_add_measurement(all_measurements, "clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+
+  // Measure mispredicted branches
+  measure_branch_misses = perf_group_add_measurement(all_measurements, "branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+  all_measurements->members[measure_branch_misses].attribute.exclude_kernel = 1;
+  all_measurements->members[measure_branch_misses].attribute.exclude_hv = 1;
+
+  for (size_t i = 0; i < all_measurements->size; i++)
+    assert_privilege(&all_measurements->members[i]);
 
-  // Measure CPU branches
-  measure_cpu_branches = perf_create_measurement(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, 0, -1);
-  prepare_measurement("cpu branches counter", measure_cpu_branches, all_measurements);
+  int status = perf_open_group(all_measurements, 0);
+  if (status < 0) {
+    perf_print_error(status);
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < all_measurements->size; i++) {
+    if (all_measurements->members[i].file_descriptor < 0)
+      fprintf(stderr, "warning: %s not supported\n", all_measurements->names[i]);
+  }
+
+  // Measure the cost of the start / stop pair itself
+  overhead = perf_calibrate_group(all_measurements, 1000);
+  if (overhead == NULL) {
+    perror("unable to calibrate measurement overhead");
+    exit(EXIT_FAILURE);
+  }
+
+  measurements = perf_create_statistics(all_measurements->size);
+  if (measurements == NULL) {
+    perror("unable to allocate statistics");
+    exit(EXIT_FAILURE);
+  }
 
   // Mark the preparation stage as successfuly
   prepared_successfully = 1;
 }
 
 void print_results() {
-  printf("     instructions          cycles  context switches            clock     cpu branches\n");
-  for (int i = 0; i < TEST_ITERATIONS; i++) {
-    uint64_t values[6] = {0};
-    perf_measurement_t *taken_measurements[] = {all_measurements, measure_instruction_count, measure_cycle_count, measure_context_switches, measure_cpu_clock, measure_cpu_branches};
-
-    for (uint64_t j = 0; j < measurements[i].recorded_values; j++) {
-      for (int k = 0; k < 6; k++) {
-        if (measurements[i].values[j].id == taken_measurements[k]->id) {
-          values[k] = measurements[i].values[j].value;
-          break;
-        }
-      }
-    }
-
-    // Ignore the results from the dummy counter
-    printf("%17" PRIu64 "%17" PRIu64 "%17" PRIu64 "%17" PRIu64 "%17" PRIu64 "\n", values[1], values[2], values[3], values[4], values[5]);
+  printf("measurement overhead (subtracted)\n");
+  perf_print_statistics(overhead->statistics, all_measurements->names, stdout);
+
+  printf("\nmeasurements\n");
+  perf_print_statistics(measurements, all_measurements->names, stdout);
+
+  for (size_t i = 0; i < all_measurements->size; i++) {
+    if (all_measurements->members[i].file_descriptor >= 0 && perf_calibration_is_below_noise_floor(overhead, i, perf_statistic_percentile(&measurements->events[i], 50)))
+      printf("note: %s is below the noise floor of the measurement\n", all_measurements->names[i]);
   }
 }
 
@@ -125,27 +141,10 @@ void cleanup() {
 
   fprintf(stderr, "cleaning up harness\n");
   if (all_measurements != NULL) {
-    perf_close_measurement(all_measurements);
+    perf_close_group(all_measurements);
     free((void *)all_measurements);
   }
 
-  if (measure_instruction_count != NULL) {
-    perf_close_measurement(measure_instruction_count);
-    free((void *)measure_instruction_count);
-  }
-
-  if (measure_cycle_count != NULL) {
-    perf_close_measurement(measure_cycle_count);
-    free((void *)measure_cycle_count);
-  }
-
-  if (measure_context_switches != NULL) {
-    perf_close_measurement(measure_context_switches);
-    free((void *)measure_context_switches);
-  }
-
-  if (measure_cpu_clock != NULL) {
-    perf_close_measurement(measure_cpu_clock);
-    free((void *)measure_cpu_clock);
-  }
+  free((void *)measurements);
+  free((void *)overhead);
 }
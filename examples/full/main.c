@@ -22,11 +22,13 @@ int main(int argc, char **argv) {
   int result = 0;
   // Perform the test several times
   for (int i = 0; i < TEST_ITERATIONS; i++) {
-    perf_start_measurement(all_measurements);
+    perf_start_group(all_measurements);
     // Carry out the computation
     result = perform_computation();
-    perf_stop_measurement(all_measurements);
-    perf_read_measurement(all_measurements, measurements + i, sizeof(measurement_t));
+    perf_stop_group(all_measurements);
+    perf_read_group(all_measurements);
+    perf_calibration_subtract(overhead, all_measurements->values, all_measurements->values);
+    perf_statistics_add_group(measurements, all_measurements);
   }
 
   // Print the result, just as the original program would
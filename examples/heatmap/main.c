@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <perf/profiler.h>
+#include <perf/utilities.h>
+
+#define REGION_SIZE (32 * 1024 * 1024)
+#define BUFFER_SIZE (8 * 1024 * 1024)
+
+// Functions touching memory in distinct patterns, so that the heatmap has something to show
+__attribute__((noinline)) static void touch_sequentially(volatile char *region, size_t size) {
+  for (size_t i = 0; i < size; i += 64)
+    region[i] = 1;
+}
+
+__attribute__((noinline)) static void touch_strided(volatile char *region, size_t size, size_t stride) {
+  for (size_t i = 0; i < size; i += stride)
+    region[i] = 1;
+}
+
+__attribute__((noinline)) static char *fill_buffer(size_t size) {
+  char *buffer = (char *)malloc(size);
+  if (buffer != NULL)
+    memset(buffer, 1, size);
+  return buffer;
+}
+
+int main(int argc, char **argv) {
+  // Sample all page faults, or with --minor or --major only faults served without or with I/O
+  uint64_t config = PERF_COUNT_SW_PAGE_FAULTS;
+  if (argc > 1 && strcmp(argv[1], "--minor") == 0)
+    config = PERF_COUNT_SW_PAGE_FAULTS_MIN;
+  else if (argc > 1 && strcmp(argv[1], "--major") == 0)
+    config = PERF_COUNT_SW_PAGE_FAULTS_MAJ;
+
+  // Page faults are software events, so no PMU is needed
+  perf_profiler_t *profiler = perf_create_profiler(PERF_TYPE_SOFTWARE, config, 0);
+  if (profiler == NULL) {
+    perror("unable to create profiler");
+    return EXIT_FAILURE;
+  }
+
+  // Sample every fault rather than at a frequency, so that each first touch is seen
+  profiler->attribute.freq = 0;
+  profiler->attribute.sample_period = 1;
+
+  int status = perf_profiler_record_addresses(profiler);
+  if (status >= 0)
+    status = perf_open_profiler(profiler, 256);
+  if (status < 0) {
+    perf_print_error(status);
+    perf_free_profiler(profiler);
+    return EXIT_FAILURE;
+  }
+
+  // Huge pages would fault in 2MiB at a time, hiding the pattern of each 4KiB page
+  char *region = (char *)mmap(NULL, REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    perror("unable to map region");
+    perf_free_profiler(profiler);
+    return EXIT_FAILURE;
+  }
+  madvise(region, REGION_SIZE, MADV_NOHUGEPAGE);
+
+  perf_start_profiler(profiler);
+
+  // Poll between the phases, so that the ring buffers never fill up
+  touch_sequentially(region, REGION_SIZE / 4);
+  perf_poll_profiler(profiler);
+  touch_strided(region + REGION_SIZE / 2, REGION_SIZE / 2, 4 * sysconf(_SC_PAGESIZE));
+  perf_poll_profiler(profiler);
+  char *buffer = fill_buffer(BUFFER_SIZE);
+
+  perf_stop_profiler(profiler);
+  status = perf_poll_profiler(profiler);
+  if (status < 0) {
+    perf_print_error(status);
+    perf_free_profiler(profiler);
+    return EXIT_FAILURE;
+  }
+
+  // The mappings are read while printing, so print before anything is unmapped
+  perf_print_heatmap(profiler->heatmap, 0, 64, stdout);
+  printf("\n");
+  perf_print_profile(profiler, 10, stdout);
+  printf("\n");
+  perf_print_first_touches(profiler->heatmap, profiler->symbols, 10, stdout);
+
+  free((void *)buffer);
+  munmap(region, REGION_SIZE);
+  perf_free_profiler(profiler);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <perf/group.h>
+#include <perf/log.h>
+#include <perf/utilities.h>
+
+#define ITERATIONS 100
+
+struct timespec one_millisecond = {0, 1000000};
+
+int perform_computation() {
+  int result = 0;
+
+  // Some costly computation
+  for (int i = 0; i < 10000; i++)
+    result = i + i * 2;
+
+  // A bit of IO
+  nanosleep(&one_millisecond, NULL);
+
+  return result;
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "measurements.perflog";
+
+  perf_group_t *group = perf_create_group(3, 0, -1);
+  if (group == NULL) {
+    perror("unable to create group");
+    return EXIT_FAILURE;
+  }
+
+  perf_group_add_measurement(group, "task clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+  perf_group_add_measurement(group, "context switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+  perf_group_add_measurement(group, "page faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+
+  int status = perf_open_group(group, 0);
+  if (status < 0) {
+    perf_print_error(status);
+    free((void *)group);
+    return EXIT_FAILURE;
+  }
+
+  // Keep every iteration in a binary log rather than aggregating in process
+  perf_log_writer_t *log = perf_create_log(path, group, 0);
+  if (log == NULL) {
+    perror("unable to create log");
+    perf_close_group(group);
+    free((void *)group);
+    return EXIT_FAILURE;
+  }
+
+  int result = 0;
+  for (int i = 0; i < ITERATIONS; i++) {
+    perf_start_group(group);
+    result = perform_computation();
+    perf_stop_group(group);
+    perf_read_group(group);
+    perf_log_append_group(log, group);
+  }
+
+  printf("Result: %d\n", result);
+
+  status = perf_close_log(log);
+  if (status < 0)
+    perf_print_error(status);
+
+  perf_close_group(group);
+  free((void *)group);
+
+  fprintf(stderr, "wrote %d records to %s, try: ./build/bin/perflog %s\n", ITERATIONS, path, path);
+
+  return status < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <perf/metrics.h>
+#include <perf/utilities.h>
+
+#define ITERATIONS 100
+
+// A computation with data dependent branches, so that the branch miss rate has something to show
+__attribute__((noinline)) static double perform_computation(unsigned int seed) {
+  double result = 0;
+  for (int i = 0; i < 100000; i++) {
+    seed = seed * 1103515245 + 12345;
+    if (seed & 0x10000)
+      result += sqrt((double)i);
+    else
+      result -= (double)i;
+  }
+  return result;
+}
+
+int main(int argc, char **argv) {
+  // Derive metrics such as IPC from events scheduled together. The metrics don't fit the
+  // hardware counters at once, so they get groups of their own, multiplexed by the kernel
+  perf_metrics_t *metrics;
+  int status = perf_create_metrics(perf_default_metrics, PERF_DEFAULT_METRICS, 0, 0, -1, &metrics);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+
+  status = perf_open_metrics(metrics, 0);
+  if (status < 0) {
+    perf_print_error(status);
+    perf_free_metrics(metrics);
+    return EXIT_FAILURE;
+  } else if (status > 0) {
+    fprintf(stderr, "warning: %d events not supported\n", status);
+  }
+
+  volatile double result = 0;
+  for (int i = 0; i < ITERATIONS; i++) {
+    perf_start_metrics(metrics);
+    result += perform_computation(i);
+    perf_stop_metrics(metrics);
+    perf_read_metrics(metrics);
+  }
+
+  printf("Result: %f\n", result);
+  perf_print_metrics(metrics, stdout);
+
+  perf_close_metrics(metrics);
+  perf_free_metrics(metrics);
+
+  return EXIT_SUCCESS;
+}
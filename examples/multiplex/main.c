@@ -0,0 +1,64 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <perf/events.h>
+#include <perf/multiplex.h>
+#include <perf/utilities.h>
+
+// More hardware events than most PMUs have counters for
+#define DEFAULT_EVENTS "instructions:u,cycles:u,branches:u,branch-misses:u,cache-references:u,cache-misses:u,bus-cycles:u,ref-cycles:u,task-clock:u,page-faults:u"
+
+int main(int argc, char **argv) {
+  // Any list of events may be given, such as "cycles:u,L1-dcache-load-misses,cpu/event=0xd1,umask=0x20/"
+  perf_event_list_t *events = NULL;
+  int status = perf_parse_event_list(argc > 1 ? argv[1] : DEFAULT_EVENTS, &events);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+  const char **names = (const char **)events->names;
+
+  int budget = perf_get_counter_budget();
+  fprintf(stderr, "hardware counters: %d\n", budget);
+
+  // Split the events into groups fitting the detected counters of the calling thread
+  perf_multiplex_t *multiplex = perf_create_multiplex(events->attributes, names, events->size, budget, 0, -1);
+  if (multiplex == NULL) {
+    perror("unable to create groups");
+    return EXIT_FAILURE;
+  }
+
+  status = perf_open_multiplex(multiplex, 0);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  } else if (status > 0) {
+    fprintf(stderr, "warning: %d events not supported\n", status);
+  }
+
+  fprintf(stderr, "groups: %zu\n", multiplex->groups_count);
+
+  perf_start_multiplex(multiplex);
+  // Perform a computation long enough for the kernel to rotate the groups
+  volatile uint64_t result = 0;
+  for (uint64_t i = 0; i < 100000000; i++)
+    result += i * 3;
+  perf_stop_multiplex(multiplex);
+
+  status = perf_read_multiplex(multiplex);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+
+  printf("%32s%17s%17s%9s\n", "event", "raw", "scaled", "running");
+  for (size_t i = 0; i < multiplex->size; i++)
+    printf("%32s%17" PRIu64 "%17" PRIu64 "%8.1f%%\n", names[i], multiplex->values[i], multiplex->scaled[i], multiplex->ratios[i] * 100);
+
+  perf_close_multiplex(multiplex);
+  perf_free_multiplex(multiplex);
+  free((void *)events);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <perf/off_cpu.h>
+#include <perf/statistics.h>
+#include <perf/symbols.h>
+#include <perf/utilities.h>
+
+#define ITERATIONS 20
+
+struct timespec ten_milliseconds = {0, 10 * 1000000};
+
+// Block in a function of its own, so that the intervals have a callchain to show
+__attribute__((noinline)) static void wait_for_io() {
+  nanosleep(&ten_milliseconds, NULL);
+}
+
+__attribute__((noinline)) static int perform_computation() {
+  int result = 0;
+
+  // Some costly computation
+  for (int i = 0; i < 1000000; i++)
+    result = i + i * 2;
+
+  // A bit of IO
+  wait_for_io();
+
+  return result;
+}
+
+int main(int argc, char **argv) {
+  // Keep every interval of the thread, with up to 16 frames of where it blocked
+  perf_off_cpu_t *off_cpu = perf_create_off_cpu(ITERATIONS * 4, 16);
+  if (off_cpu == NULL) {
+    perror("unable to create off-CPU tracker");
+    return EXIT_FAILURE;
+  }
+
+  int status = perf_open_off_cpu(off_cpu, 64);
+  if (status < 0) {
+    perf_print_error(status);
+    perf_free_off_cpu(off_cpu);
+    return EXIT_FAILURE;
+  }
+
+  perf_statistics_t *times = perf_create_statistics(PERF_OFF_CPU_VALUES);
+  if (times == NULL) {
+    perror("unable to allocate statistics");
+    perf_free_off_cpu(off_cpu);
+    return EXIT_FAILURE;
+  }
+
+  int result = 0;
+  for (int i = 0; i < ITERATIONS; i++) {
+    perf_off_cpu_snapshot_t snapshot;
+    perf_off_cpu_snapshot(off_cpu, &snapshot);
+    result = perform_computation();
+    uint64_t values[PERF_OFF_CPU_VALUES];
+    perf_off_cpu_since(off_cpu, &snapshot, values);
+    perf_statistics_add(times, values);
+  }
+
+  printf("Result: %d\n", result);
+
+  printf("\noff-CPU time\n");
+  perf_print_statistics(times, perf_off_cpu_names, stdout);
+
+  printf("\n");
+  perf_symbol_table_t *symbols = perf_load_symbol_table(0);
+  perf_print_off_cpu_intervals(off_cpu, symbols, 5, stdout);
+  if (symbols != NULL)
+    perf_free_symbol_table(symbols);
+
+  free((void *)times);
+  perf_free_off_cpu(off_cpu);
+
+  return EXIT_SUCCESS;
+}
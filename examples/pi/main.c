@@ -1,7 +1,12 @@
 #include <stdio.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "harness.h"
+#include <perf/compare.h>
+#include <perf/region.h>
+
 double PI_double = 3.14159265f / 4;
 float PI_float = 3.1415929265f / 4;
 
@@ -23,37 +28,102 @@ float calculate_pi_float() {
   return pi * 4;
 }
 
-int main()
+// The variants of the comparison mode
+static void variant_double(void *argument) {
+  *(double *)argument = calculate_pi_double();
+}
+
+static void variant_float(void *argument) {
+  *(double *)argument = calculate_pi_float();
+}
+
+// Compare the float implementation to the double implementation, running them
+// interleaved. Optionally save the results as a baseline, or fail if a previously
+// saved baseline regressed by more than the threshold
+int compare(int argc, char **argv) {
+  const char *save = NULL;
+  const char *check = NULL;
+  double threshold = 0.02;
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "--save") == 0 && i + 1 < argc)
+      save = argv[++i];
+    else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc)
+      check = argv[++i];
+    else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+      threshold = atof(argv[++i]);
+  }
+
+  const char *names[] = {"double", "float"};
+  const perf_variant_t variants[] = {variant_double, variant_float};
+  perf_comparison_t *comparison = perf_create_comparison(all_measurements, names, 2, COMPARE_ITERATIONS);
+  if (comparison == NULL) {
+    perror("unable to create comparison");
+    return EXIT_FAILURE;
+  }
+
+  double pi = 0;
+  int status = perf_compare_variants(comparison, all_measurements, variants, &pi, COMPARE_ITERATIONS);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+
+  perf_print_comparison(comparison, stdout);
+
+  int regressions = 0;
+  if (save != NULL) {
+    status = perf_save_baseline(comparison, save);
+    if (status < 0) {
+      perf_print_error(status);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (check != NULL) {
+    perf_baseline_t *baseline = perf_load_baseline(check);
+    if (baseline == NULL) {
+      perror("unable to load baseline");
+      return EXIT_FAILURE;
+    }
+
+    regressions = perf_check_baseline(comparison, baseline, threshold, stdout);
+    free((void *)baseline);
+    if (regressions < 0) {
+      perf_print_error(regressions);
+      return EXIT_FAILURE;
+    }
+  }
+
+  free((void *)comparison);
+  return regressions > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
 {
+  if (argc > 1 && strcmp(argv[1], "--compare") == 0)
+    return compare(argc - 2, argv + 2);
+
   double pi_double = 0;
   float pi_float = 0;
-  measurement_t measurements_pi_double[TEST_ITERATIONS];
-  measurement_t measurements_pi_float[TEST_ITERATIONS];
 
   // Perform the test several times
   for (int i = 0; i < TEST_ITERATIONS; i++)
   {
-    perf_start_measurement(all_measurements);
+    PERF_REGION_BEGIN("pi using double");
     // Carry out the computation
     pi_double = calculate_pi_double();
-    perf_stop_measurement(all_measurements);
-    perf_read_measurement(all_measurements, measurements_pi_double + i, sizeof(measurement_t));
+    PERF_REGION_END("pi using double");
 
-    perf_start_measurement(all_measurements);
-    // Carry out the computation
-    pi_float = calculate_pi_float();
-    perf_stop_measurement(all_measurements);
-    perf_read_measurement(all_measurements, measurements_pi_float + i, sizeof(measurement_t));
+    {
+      PERF_REGION_SCOPED("pi using float");
+      // Carry out the computation
+      pi_float = calculate_pi_float();
+    }
   }
 
-  printf("Result calculating pi using double\n");
-  print_results(measurements_pi_double);
-  printf("pi: %f\n\n", pi_double);
-
-  printf("Result calculating pi using float\n");
-  print_results(measurements_pi_float);
-  printf("pi : %f\n", pi_float);
-
+  print_results();
+  printf("pi using double: %f\n", pi_double);
+  printf("pi using float: %f\n", pi_float);
 }
 
 /**
@@ -0,0 +1,110 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <perf/profiler.h>
+#include <perf/utilities.h>
+
+#define WORKERS 2
+#define DURATION 2000
+
+static volatile int running = 1;
+
+// Functions with distinct costs, so that the profile has something to show
+__attribute__((noinline)) static double compute_square_roots(uint64_t n) {
+  double sum = 0;
+  for (uint64_t i = 0; i < n; i++)
+    sum += sqrt((double)i);
+  return sum;
+}
+
+__attribute__((noinline)) static uint64_t compute_sum(uint64_t n) {
+  volatile uint64_t sum = 0;
+  for (uint64_t i = 0; i < n; i++)
+    sum += i;
+  return sum;
+}
+
+static void *work(void *argument) {
+  volatile double result = 0;
+  while (running) {
+    result += compute_square_roots(300000);
+    result += (double)compute_sum(100000);
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  // Print a live view, a dump of the top functions or, with --folded, the folded stacks for flamegraph.pl
+  int live = argc > 1 && strcmp(argv[1], "--live") == 0;
+  int folded = argc > 1 && strcmp(argv[1], "--folded") == 0;
+
+  // The workers already run when the profiler is opened, as those of a service profiling itself on demand would
+  pthread_t workers[WORKERS];
+  for (int i = 0; i < WORKERS; i++)
+    pthread_create(&workers[i], NULL, work, NULL);
+
+  // Prefer cycles, falling back to the task clock where there are no hardware counters
+  perf_profiler_t *profiler = perf_create_profiler(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 1000);
+  if (profiler == NULL) {
+    perror("unable to create profiler");
+    return EXIT_FAILURE;
+  }
+
+  int status = folded ? perf_profiler_record_callchains(profiler, 64) : 0;
+  if (status >= 0)
+    status = perf_open_profiler(profiler, 64);
+  if (status == PERF_ERROR_NOT_SUPPORTED) {
+    perf_free_profiler(profiler);
+    profiler = perf_create_profiler(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, 1000);
+    if (profiler == NULL) {
+      perror("unable to create profiler");
+      return EXIT_FAILURE;
+    }
+    status = folded ? perf_profiler_record_callchains(profiler, 64) : 0;
+    if (status >= 0)
+      status = perf_open_profiler(profiler, 64);
+  }
+
+  if (status < 0) {
+    perf_print_error(status);
+    perf_free_profiler(profiler);
+    return EXIT_FAILURE;
+  }
+
+  perf_start_profiler(profiler);
+
+  if (live) {
+    // Redraw the top functions every 500ms
+    status = perf_live_profile(profiler, 10, 500, DURATION, stdout);
+  } else {
+    // Collect samples in the background and dump the profile at the end
+    struct timespec interval = {0, 100 * 1000000};
+    for (int i = 0; i < DURATION / 100 && status >= 0; i++) {
+      nanosleep(&interval, NULL);
+      status = perf_poll_profiler(profiler);
+    }
+  }
+
+  running = 0;
+  for (int i = 0; i < WORKERS; i++)
+    pthread_join(workers[i], NULL);
+  perf_stop_profiler(profiler);
+
+  if (status < 0) {
+    perf_print_error(status);
+    perf_free_profiler(profiler);
+    return EXIT_FAILURE;
+  }
+
+  perf_poll_profiler(profiler);
+  if (folded)
+    perf_write_folded_stacks(profiler, stdout);
+  else if (!live)
+    perf_print_profile(profiler, 10, stdout);
+
+  perf_free_profiler(profiler);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <perf/sampling.h>
+#include <perf/utilities.h>
+
+#define ITERATIONS 50000000
+
+int main(int argc, char **argv) {
+  // Sample the instruction pointer of this thread every 100µs of task clock
+  perf_measurement_t *measure_task_clock = perf_create_sampling_measurement(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, 0, -1, 100000, PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME);
+  if (measure_task_clock == NULL) {
+    perror("unable to create measurement");
+    return EXIT_FAILURE;
+  }
+
+  // Ensure that the caller has sufficient privilege for performing the measurement
+  int has_sufficient_privilege = perf_has_sufficient_privilege(measure_task_clock);
+  if (has_sufficient_privilege != 1) {
+    fprintf(stderr, "Insufficient privilege\n");
+    return EXIT_FAILURE;
+  }
+
+  int status = perf_open_measurement(measure_task_clock, -1, 0);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+
+  // Map 16 pages of samples (64KiB on most systems)
+  perf_ring_buffer_t *ring_buffer = perf_map_ring_buffer(measure_task_clock, 16);
+  if (ring_buffer == NULL) {
+    perror("unable to map ring buffer");
+    return EXIT_FAILURE;
+  }
+
+  uint64_t samples = 0;
+  uint64_t lost = 0;
+  uint64_t throttles = 0;
+  uint64_t first_ip = 0;
+  uint64_t last_ip = 0;
+
+  perf_start_measurement(measure_task_clock);
+
+  // Perform a computation, draining the ring buffer every now and then
+  volatile uint64_t result = 0;
+  for (uint64_t i = 0; i < ITERATIONS; i++) {
+    result += i * 2;
+
+    if (i % (ITERATIONS / 100) != 0)
+      continue;
+
+    perf_ring_buffer_begin_read(ring_buffer);
+    const struct perf_event_header *record;
+    while ((record = perf_ring_buffer_next(ring_buffer)) != NULL) {
+      if (record->type == PERF_RECORD_SAMPLE) {
+        perf_sample_t sample;
+        if (perf_parse_sample(ring_buffer, record, &sample) < 0)
+          continue;
+        if (samples++ == 0)
+          first_ip = sample.ip;
+        last_ip = sample.ip;
+      } else if (record->type == PERF_RECORD_LOST) {
+        lost += ((const perf_record_lost_t *)record)->lost;
+      } else if (record->type == PERF_RECORD_THROTTLE) {
+        throttles++;
+      }
+    }
+    perf_ring_buffer_end_read(ring_buffer);
+  }
+
+  perf_stop_measurement(measure_task_clock);
+
+  printf("Result: %" PRIu64 "\n", result);
+  printf("samples: %" PRIu64 ", lost: %" PRIu64 ", throttled: %" PRIu64 "\n", samples, lost, throttles);
+  printf("first ip: 0x%" PRIx64 ", last ip: 0x%" PRIx64 "\n", first_ip, last_ip);
+
+  // Always unmap a mapped ring buffer before closing the measurement
+  perf_unmap_ring_buffer(ring_buffer);
+  perf_close_measurement(measure_task_clock);
+  free((void *)measure_task_clock);
+
+  return EXIT_SUCCESS;
+}
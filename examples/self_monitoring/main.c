@@ -0,0 +1,54 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <perf/self_monitoring.h>
+#include <perf/utilities.h>
+
+#define TEST_ITERATIONS 10
+
+int main(int argc, char **argv) {
+  // Measure the number of retired user space instructions of this thread
+  perf_measurement_t *measure_instruction_count = perf_create_measurement(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 0, -1);
+  measure_instruction_count->attribute.exclude_kernel = 1;
+
+  // Fall back to the software task clock on machines without hardware counters (such as many VMs)
+  if (perf_event_is_supported(measure_instruction_count) != 1) {
+    fprintf(stderr, "warning: hardware instruction counter not supported, using task clock\n");
+    free((void *)measure_instruction_count);
+    measure_instruction_count = perf_create_measurement(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, 0, -1);
+  }
+
+  int status = perf_open_measurement(measure_instruction_count, -1, 0);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+
+  // Map the counter for reading in user space. This enables the measurement
+  perf_self_monitor_t *monitor = perf_map_self_monitor(measure_instruction_count);
+  if (monitor == NULL) {
+    perror("unable to map measurement");
+    return EXIT_FAILURE;
+  }
+
+  printf("reading using %s\n", perf_self_monitor_is_userspace(monitor) ? "rdpmc" : "read(2)");
+
+  volatile uint64_t result = 0;
+  for (int i = 0; i < TEST_ITERATIONS; i++) {
+    perf_self_monitor_start(monitor);
+    // Perform a computation
+    for (uint64_t j = 0; j < 1000; j++)
+      result += j;
+    uint64_t value = perf_self_monitor_stop(monitor);
+
+    printf("%17" PRIu64 "\n", value);
+  }
+
+  // Always unmap a mapped monitor before closing the measurement
+  perf_unmap_self_monitor(monitor);
+  perf_close_measurement(measure_instruction_count);
+  free((void *)measure_instruction_count);
+
+  return EXIT_SUCCESS;
+}
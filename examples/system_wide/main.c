@@ -0,0 +1,56 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <perf/event_set.h>
+#include <perf/group.h>
+#include <perf/utilities.h>
+
+struct timespec hundred_milliseconds = {0, 100 * 1000000};
+
+int main(int argc, char **argv) {
+  // Describe the events to measure on each CPU. The prototype itself is never opened
+  perf_group_t *prototype = perf_create_group(3, -1, -1);
+  int measure_cpu_clock = perf_group_add_measurement(prototype, "cpu clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK);
+  int measure_context_switches = perf_group_add_measurement(prototype, "context switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+  int measure_cpu_migrations = perf_group_add_measurement(prototype, "cpu migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS);
+
+  // Measure all processes on all online CPUs
+  perf_event_set_t *set = perf_create_event_set(prototype, -1);
+  free((void *)prototype);
+  if (set == NULL) {
+    perror("unable to create event set");
+    return EXIT_FAILURE;
+  }
+
+  int status = perf_open_event_set(set, 0);
+  if (status < 0) {
+    perf_print_error(status);
+    perf_free_event_set(set);
+    return EXIT_FAILURE;
+  }
+
+  perf_start_event_set(set);
+  // Let the system run for a while
+  nanosleep(&hundred_milliseconds, NULL);
+  perf_stop_event_set(set);
+
+  status = perf_read_event_set(set);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+
+  printf("  cpu        cpu clock  context switches   cpu migrations\n");
+  for (size_t i = 0; i < set->cpus; i++) {
+    const uint64_t *values = set->values + i * set->size;
+    printf("%5d%17" PRIu64 "%17" PRIu64 "%17" PRIu64 "\n", set->cpu_ids[i], values[measure_cpu_clock], values[measure_context_switches], values[measure_cpu_migrations]);
+  }
+  printf("total%17" PRIu64 "%17" PRIu64 "%17" PRIu64 "\n", set->totals[measure_cpu_clock], set->totals[measure_context_switches], set->totals[measure_cpu_migrations]);
+
+  perf_close_event_set(set);
+  perf_free_event_set(set);
+
+  return EXIT_SUCCESS;
+}
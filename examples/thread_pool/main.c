@@ -0,0 +1,85 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <perf/group.h>
+#include <perf/thread_tracker.h>
+#include <perf/utilities.h>
+
+#define WORKERS 4
+
+// Work of distinct sizes per worker, so that each thread counts differently
+static void *work(void *argument) {
+  size_t size = (size_t)argument;
+
+  char name[16];
+  snprintf(name, sizeof(name), "worker-%zu", size);
+  pthread_setname_np(pthread_self(), name);
+
+  // Spin for a while, long enough for the tracker to find the thread, then touch fresh memory
+  struct timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  do {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+  } while ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 < (long)(50 * size));
+
+  char *buffer = (char *)malloc(size * 1024 * 1024);
+  if (buffer != NULL)
+    memset(buffer, 1, size * 1024 * 1024);
+  free((void *)buffer);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  // Software events, so that the example runs without hardware counters
+  perf_group_t *prototype = perf_create_group(3, 0, -1);
+  if (prototype == NULL) {
+    perror("unable to create group");
+    return EXIT_FAILURE;
+  }
+  perf_group_add_measurement(prototype, "task clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+  perf_group_add_measurement(prototype, "page faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+  perf_group_add_measurement(prototype, "context switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+
+  perf_thread_tracker_t *tracker = perf_create_thread_tracker(prototype);
+  free((void *)prototype);
+  if (tracker == NULL) {
+    perror("unable to create thread tracker");
+    return EXIT_FAILURE;
+  }
+
+  // Look for new threads every 10ms
+  int status = perf_start_thread_tracker(tracker, 10);
+  if (status < 0) {
+    perf_print_error(status);
+    perf_free_thread_tracker(tracker);
+    return EXIT_FAILURE;
+  }
+
+  // The workers are created after the tracker, as a thread pool would be
+  pthread_t workers[WORKERS];
+  for (size_t i = 0; i < WORKERS; i++)
+    pthread_create(&workers[i], NULL, work, (void *)(i + 1));
+
+  // Show the pool while the largest workers are still running
+  pthread_join(workers[0], NULL);
+  pthread_join(workers[1], NULL);
+  perf_update_thread_tracker(tracker);
+  perf_read_thread_tracker(tracker);
+  printf("while running\n");
+  perf_print_thread_tracker(tracker, stdout);
+
+  for (size_t i = 2; i < WORKERS; i++)
+    pthread_join(workers[i], NULL);
+
+  perf_stop_thread_tracker(tracker);
+  perf_read_thread_tracker(tracker);
+  printf("\nafter all workers exited\n");
+  perf_print_thread_tracker(tracker, stdout);
+
+  perf_free_thread_tracker(tracker);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <perf/group.h>
+#include <perf/recorder.h>
+#include <perf/statistics.h>
+#include <perf/utilities.h>
+
+#define WORKERS 4
+#define REQUESTS 10000
+
+static perf_recorder_t *recorder;
+
+// A request handled by a worker of the pool
+static uint64_t handle_request(uint64_t request) {
+  volatile uint64_t result = 0;
+  for (uint64_t i = 0; i < 1000 + request % 1000; i++)
+    result += i * request;
+  return result;
+}
+
+static void *work(void *argument) {
+  // Each worker lazily gets a group measuring only itself
+  perf_recorder_thread_t *thread = perf_recorder_thread(recorder);
+  if (thread == NULL) {
+    perror("unable to create thread state");
+    return NULL;
+  }
+
+  for (uint64_t request = 0; request < REQUESTS; request++) {
+    perf_recorder_begin(thread);
+    handle_request(request);
+    // Never blocks, even while the aggregator is draining
+    perf_recorder_end(thread);
+  }
+
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  perf_group_t *prototype = perf_create_group(3, 0, -1);
+  if (prototype == NULL) {
+    perror("unable to create group");
+    return EXIT_FAILURE;
+  }
+
+  perf_group_add_measurement(prototype, "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  perf_group_add_measurement(prototype, "task clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+  perf_group_add_measurement(prototype, "context switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+
+  // Buffer up to 1024 regions per thread between drains
+  recorder = perf_create_recorder(prototype, 1024);
+  if (recorder == NULL) {
+    perror("unable to create recorder");
+    return EXIT_FAILURE;
+  }
+
+  // Drain the rings of all threads every 10ms
+  int status = perf_start_recorder(recorder, 10);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+
+  pthread_t workers[WORKERS];
+  for (int i = 0; i < WORKERS; i++)
+    pthread_create(&workers[i], NULL, work, NULL);
+  for (int i = 0; i < WORKERS; i++)
+    pthread_join(workers[i], NULL);
+
+  status = perf_stop_recorder(recorder);
+  if (status < 0) {
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+
+  perf_print_statistics(recorder->statistics, prototype->names, stdout);
+  printf("dropped: %" PRIu64 "\n", perf_recorder_dropped(recorder));
+
+  perf_free_recorder(recorder);
+  free((void *)prototype);
+
+  return EXIT_SUCCESS;
+}
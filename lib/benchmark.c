@@ -0,0 +1,368 @@
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchmark.h"
+#include "calibration.h"
+#include "group.h"
+#include "statistics.h"
+#include "utilities.h"
+
+static perf_benchmark_t *first_benchmark = NULL;
+static perf_benchmark_t *last_benchmark = NULL;
+
+void perf_register_benchmark(perf_benchmark_t *benchmark) {
+  benchmark->next = NULL;
+  if (last_benchmark == NULL)
+    first_benchmark = benchmark;
+  else
+    last_benchmark->next = benchmark;
+  last_benchmark = benchmark;
+}
+
+const perf_benchmark_t *perf_get_benchmarks() {
+  return first_benchmark;
+}
+
+void perf_benchmark_default_options(perf_benchmark_options_t *options) {
+  options->cpu = -1;
+  options->warmup_iterations = 10;
+  options->min_iterations = 10;
+  options->max_iterations = 1000000;
+  options->batch = 1;
+  options->target_error = 0.01;
+  options->subtract_overhead = 1;
+  options->calibration_iterations = 1000;
+  options->filter = NULL;
+  options->format = PERF_BENCHMARK_FORMAT_TEXT;
+  options->output = stdout;
+}
+
+perf_group_t *perf_create_benchmark_group() {
+  perf_group_t *group = perf_create_group(5, 0, -1);
+  if (group == NULL)
+    return NULL;
+
+  int slot = perf_group_add_measurement(group, "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  group->members[slot].attribute.exclude_kernel = 1;
+
+  slot = perf_group_add_measurement(group, "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  group->members[slot].attribute.exclude_kernel = 1;
+
+  slot = perf_group_add_measurement(group, "branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+  group->members[slot].attribute.exclude_kernel = 1;
+
+  perf_group_add_measurement(group, "task clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+  perf_group_add_measurement(group, "context switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+
+  return group;
+}
+
+// Returns whether or not the mean of a statistic is known to within the target error.
+static int perf_benchmark_is_stable(const perf_statistic_t *statistic, double target_error) {
+  if (statistic->count < 2)
+    return 0;
+
+  // A constant value, such as a deterministic instruction count, is trivially stable
+  if (statistic->mean == 0)
+    return statistic->m2 == 0;
+
+  double standard_error = perf_statistic_stddev(statistic) / sqrt((double)statistic->count);
+  return standard_error / statistic->mean < target_error;
+}
+
+int perf_run_benchmark(const perf_benchmark_t *benchmark, perf_group_t *group, const perf_benchmark_options_t *options, const perf_calibration_t *calibration, perf_statistics_t *statistics, perf_benchmark_result_t *result) {
+  // Judge stability on the first member actually being measured
+  size_t primary = 0;
+  while (primary < group->size && group->members[primary].file_descriptor < 0)
+    primary++;
+  if (primary == group->size)
+    return PERF_ERROR_NOT_SUPPORTED;
+
+  // Warm up caches, branch predictors and lazily bound symbols
+  for (uint64_t i = 0; i < options->warmup_iterations; i++)
+    benchmark->function(benchmark->argument);
+
+  perf_statistics_reset(statistics);
+
+  uint64_t batch = options->batch > 0 ? options->batch : 1;
+  int stable = 0;
+  uint64_t iterations = 0;
+  while (iterations < options->max_iterations) {
+    perf_start_group(group);
+    for (uint64_t i = 0; i < batch; i++)
+      benchmark->function(benchmark->argument);
+    perf_stop_group(group);
+
+    int status = perf_read_group(group);
+    if (status < 0)
+      return status;
+
+    // The overhead is paid once per measurement, not once per call
+    if (calibration != NULL)
+      perf_calibration_subtract(calibration, group->values, group->values);
+    if (batch > 1) {
+      for (size_t slot = 0; slot < group->size; slot++)
+        group->values[slot] /= batch;
+    }
+
+    perf_statistics_add_group(statistics, group);
+    iterations++;
+
+    if (iterations >= options->min_iterations && perf_benchmark_is_stable(&statistics->events[primary], options->target_error)) {
+      stable = 1;
+      break;
+    }
+  }
+
+  result->benchmark = benchmark;
+  result->iterations = iterations;
+  result->batch = batch;
+  result->stable = stable;
+  result->statistics = statistics;
+  result->calibration = calibration;
+
+  return 0;
+}
+
+// Write a string as a JSON string literal.
+static void perf_write_json_string(FILE *output, const char *string) {
+  fputc('"', output);
+  for (; *string != '\0'; string++) {
+    if (*string == '"' || *string == '\\')
+      fprintf(output, "\\%c", *string);
+    else if ((unsigned char)*string < 0x20)
+      fprintf(output, "\\u%04x", *string);
+    else
+      fputc(*string, output);
+  }
+  fputc('"', output);
+}
+
+// Returns whether or not the median of an event is within the noise of the measurement itself.
+static int perf_result_is_below_noise_floor(const perf_benchmark_result_t *result, size_t slot) {
+  if (result->calibration == NULL)
+    return 0;
+
+  // The noise floor is that of a whole iteration, so compare the undivided value
+  return perf_calibration_is_below_noise_floor(result->calibration, slot, perf_statistic_percentile(&result->statistics->events[slot], 50) * result->batch);
+}
+
+// Returns the overhead subtracted from an event, per call like the statistics.
+static double perf_result_overhead(const perf_benchmark_result_t *result, size_t slot) {
+  if (result->calibration == NULL)
+    return 0;
+
+  return (double)result->calibration->baseline[slot] / (double)result->batch;
+}
+
+static void perf_write_result(const perf_group_t *group, const perf_benchmark_result_t *result, const perf_benchmark_options_t *options, int first) {
+  FILE *output = options->output;
+
+  switch (options->format) {
+  case PERF_BENCHMARK_FORMAT_TEXT:
+    fprintf(output, "%s: %" PRIu64 " iterations of %" PRIu64 " calls%s\n", result->benchmark->name, result->iterations, result->batch, result->stable ? "" : " (not stable)");
+    perf_print_statistics(result->statistics, group->names, output);
+    for (size_t slot = 0; slot < group->size; slot++) {
+      if (group->members[slot].file_descriptor >= 0 && perf_result_is_below_noise_floor(result, slot))
+        fprintf(output, "note: %s is below the noise floor of the measurement (%.3f per call)\n", group->names[slot], (double)result->calibration->noise_floor[slot] / (double)result->batch);
+    }
+    fprintf(output, "\n");
+    break;
+  case PERF_BENCHMARK_FORMAT_JSON:
+    fprintf(output, "%s\n    {\"name\": ", first ? "" : ",");
+    perf_write_json_string(output, result->benchmark->name);
+    fprintf(output, ", \"iterations\": %" PRIu64 ", \"stable\": %s, \"events\": {", result->iterations, result->stable ? "true" : "false");
+    for (size_t slot = 0; slot < group->size; slot++) {
+      const perf_statistic_t *statistic = &result->statistics->events[slot];
+      fprintf(output, "%s\n      ", slot == 0 ? "" : ",");
+      perf_write_json_string(output, group->names[slot]);
+      fprintf(output, ": {\"supported\": %s, \"overhead\": %.3f, \"below_noise_floor\": %s, \"min\": %" PRIu64 ", \"mean\": %.3f, \"stddev\": %.3f, \"p50\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"max\": %" PRIu64 "}",
+              group->members[slot].file_descriptor >= 0 ? "true" : "false",
+              perf_result_overhead(result, slot),
+              perf_result_is_below_noise_floor(result, slot) ? "true" : "false",
+              statistic->min,
+              statistic->mean,
+              perf_statistic_stddev(statistic),
+              perf_statistic_percentile(statistic, 50),
+              perf_statistic_percentile(statistic, 99),
+              statistic->max);
+    }
+    fprintf(output, "\n    }}");
+    break;
+  case PERF_BENCHMARK_FORMAT_CSV:
+    for (size_t slot = 0; slot < group->size; slot++) {
+      if (group->members[slot].file_descriptor < 0)
+        continue;
+      const perf_statistic_t *statistic = &result->statistics->events[slot];
+      fprintf(output, "%s,%s,%" PRIu64 ",%d,%.3f,%d,%" PRIu64 ",%.3f,%.3f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+              result->benchmark->name,
+              group->names[slot],
+              result->iterations,
+              result->stable,
+              perf_result_overhead(result, slot),
+              perf_result_is_below_noise_floor(result, slot),
+              statistic->min,
+              statistic->mean,
+              perf_statistic_stddev(statistic),
+              perf_statistic_percentile(statistic, 50),
+              perf_statistic_percentile(statistic, 99),
+              statistic->max);
+    }
+    break;
+  }
+}
+
+int perf_run_benchmarks(perf_group_t *group, const perf_benchmark_options_t *options) {
+  cpu_set_t original_affinity;
+  if (options->cpu >= 0) {
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &original_affinity) < 0)
+      return PERF_ERROR_LIBRARY_FAILURE;
+
+    cpu_set_t affinity;
+    CPU_ZERO(&affinity);
+    CPU_SET(options->cpu, &affinity);
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &affinity) < 0)
+      return PERF_ERROR_BAD_PARAMETERS;
+  }
+
+  perf_statistics_t *statistics = perf_create_statistics(group->size);
+  if (statistics == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  // Calibrate on the pinned CPU, under the same conditions as the benchmarks
+  perf_calibration_t *calibration = NULL;
+  if (options->subtract_overhead) {
+    calibration = perf_calibrate_group(group, options->calibration_iterations);
+    if (calibration == NULL) {
+      free((void *)statistics);
+      return PERF_ERROR_IO;
+    }
+  }
+
+  if (options->format == PERF_BENCHMARK_FORMAT_JSON)
+    fprintf(options->output, "{\n  \"cpu\": %d,\n  \"batch\": %" PRIu64 ",\n  \"benchmarks\": [", options->cpu, options->batch);
+  else if (options->format == PERF_BENCHMARK_FORMAT_CSV)
+    fprintf(options->output, "benchmark,event,iterations,stable,overhead,below_noise_floor,min,mean,stddev,p50,p99,max\n");
+
+  int status = 0;
+  int first = 1;
+  for (const perf_benchmark_t *benchmark = first_benchmark; benchmark != NULL; benchmark = benchmark->next) {
+    if (options->filter != NULL && strstr(benchmark->name, options->filter) == NULL)
+      continue;
+
+    perf_benchmark_result_t result;
+    status = perf_run_benchmark(benchmark, group, options, calibration, statistics, &result);
+    if (status < 0)
+      break;
+
+    perf_write_result(group, &result, options, first);
+    first = 0;
+  }
+
+  if (options->format == PERF_BENCHMARK_FORMAT_JSON)
+    fprintf(options->output, "\n  ]\n}\n");
+
+  free((void *)statistics);
+  free((void *)calibration);
+
+  if (options->cpu >= 0)
+    sched_setaffinity(0, sizeof(cpu_set_t), &original_affinity);
+
+  return status;
+}
+
+int perf_benchmark_main(int argc, char **argv) {
+  perf_benchmark_options_t options;
+  perf_benchmark_default_options(&options);
+
+  for (int i = 1; i < argc; i++) {
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(argv[i], "--help") == 0) {
+      fprintf(stderr, "usage: %s [--cpu N] [--warmup N] [--min-iterations N] [--max-iterations N] [--batch N] [--target-error E] [--subtract-overhead 0|1] [--filter NAME] [--format text|json|csv]\n", argv[0]);
+      return EXIT_SUCCESS;
+    } else if (value == NULL) {
+      fprintf(stderr, "error: missing value for %s\n", argv[i]);
+      return EXIT_FAILURE;
+    } else if (strcmp(argv[i], "--cpu") == 0) {
+      options.cpu = atoi(value);
+    } else if (strcmp(argv[i], "--warmup") == 0) {
+      options.warmup_iterations = strtoull(value, NULL, 10);
+    } else if (strcmp(argv[i], "--min-iterations") == 0) {
+      options.min_iterations = strtoull(value, NULL, 10);
+    } else if (strcmp(argv[i], "--max-iterations") == 0) {
+      options.max_iterations = strtoull(value, NULL, 10);
+    } else if (strcmp(argv[i], "--batch") == 0) {
+      options.batch = strtoull(value, NULL, 10);
+      if (options.batch == 0) {
+        fprintf(stderr, "error: invalid batch %s\n", value);
+        return EXIT_FAILURE;
+      }
+    } else if (strcmp(argv[i], "--target-error") == 0) {
+      options.target_error = strtod(value, NULL);
+    } else if (strcmp(argv[i], "--subtract-overhead") == 0) {
+      options.subtract_overhead = atoi(value);
+    } else if (strcmp(argv[i], "--filter") == 0) {
+      options.filter = value;
+    } else if (strcmp(argv[i], "--format") == 0) {
+      if (strcmp(value, "json") == 0) {
+        options.format = PERF_BENCHMARK_FORMAT_JSON;
+      } else if (strcmp(value, "csv") == 0) {
+        options.format = PERF_BENCHMARK_FORMAT_CSV;
+      } else if (strcmp(value, "text") == 0) {
+        options.format = PERF_BENCHMARK_FORMAT_TEXT;
+      } else {
+        fprintf(stderr, "error: unknown format %s\n", value);
+        return EXIT_FAILURE;
+      }
+    } else {
+      fprintf(stderr, "error: unknown option %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+    i++;
+  }
+
+  perf_group_t *group = perf_create_benchmark_group();
+  if (group == NULL) {
+    perror("unable to create group");
+    return EXIT_FAILURE;
+  }
+
+  for (size_t slot = 0; slot < group->size; slot++) {
+    int status = perf_has_sufficient_privilege(&group->members[slot]);
+    if (status < 0) {
+      perf_print_error(status);
+      free((void *)group);
+      return EXIT_FAILURE;
+    } else if (status == 0) {
+      fprintf(stderr, "error: unprivileged user\n");
+      free((void *)group);
+      return EXIT_FAILURE;
+    }
+  }
+
+  int status = perf_open_group(group, 0);
+  if (status < 0) {
+    perf_print_error(status);
+    free((void *)group);
+    return EXIT_FAILURE;
+  }
+
+  for (size_t slot = 0; slot < group->size; slot++) {
+    if (group->members[slot].file_descriptor < 0)
+      fprintf(stderr, "warning: %s not supported\n", group->names[slot]);
+  }
+
+  status = perf_run_benchmarks(group, &options);
+  if (status < 0)
+    perf_print_error(status);
+
+  perf_close_group(group);
+  free((void *)group);
+
+  return status < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
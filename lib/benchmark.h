@@ -0,0 +1,125 @@
+#ifndef PERF_BENCHMARK_H
+#define PERF_BENCHMARK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "calibration.h"
+#include "group.h"
+#include "statistics.h"
+
+// A function to benchmark. Called once per iteration.
+typedef void (*perf_benchmark_function_t)(void *argument);
+
+// A registered benchmark. Registered benchmarks form a list, so registration never allocates.
+typedef struct perf_benchmark {
+  // The name of the benchmark
+  const char *name;
+  // The function to measure
+  perf_benchmark_function_t function;
+  // The argument passed to the function
+  void *argument;
+  // The next registered benchmark
+  struct perf_benchmark *next;
+} perf_benchmark_t;
+
+typedef enum {
+  PERF_BENCHMARK_FORMAT_TEXT,
+  PERF_BENCHMARK_FORMAT_JSON,
+  PERF_BENCHMARK_FORMAT_CSV,
+} perf_benchmark_format_t;
+
+typedef struct {
+  // The CPU to pin the benchmarking thread to. -1 to not pin
+  int cpu;
+  // The number of unmeasured iterations run before measuring
+  uint64_t warmup_iterations;
+  // The bounds of measured iterations
+  uint64_t min_iterations;
+  uint64_t max_iterations;
+  // The number of calls measured by each iteration. Values are divided by it, so that
+  // functions close to the overhead of the measurement itself are measured over
+  // several calls rather than within the noise of a single one
+  uint64_t batch;
+  // Stop iterating once the relative standard error of the mean of the first
+  // supported event falls below this value
+  double target_error;
+  // Whether or not to subtract the calibrated overhead of the measurement itself
+  int subtract_overhead;
+  // The number of empty measurements used to calibrate the overhead
+  uint64_t calibration_iterations;
+  // Only run benchmarks whose name contains this string. NULL to run all
+  const char *filter;
+  // The format of the results
+  perf_benchmark_format_t format;
+  // Where to write the results
+  FILE *output;
+} perf_benchmark_options_t;
+
+// The result of a benchmark.
+typedef struct {
+  // The benchmark
+  const perf_benchmark_t *benchmark;
+  // The number of measured iterations
+  uint64_t iterations;
+  // The number of calls measured by each iteration. The statistics are per call
+  uint64_t batch;
+  // Whether or not target_error was reached before max_iterations
+  int stable;
+  // The statistics of each member of the group, indexed by slot
+  const perf_statistics_t *statistics;
+  // The overhead subtracted from each iteration, before dividing by the batch. NULL if none was subtracted
+  const perf_calibration_t *calibration;
+} perf_benchmark_result_t;
+
+// Prevent the compiler from optimizing away the computation of a value.
+#define perf_benchmark_keep(value) __asm__ volatile("" \
+                                                    :  \
+                                                    : "g"(value) \
+                                                    : "memory")
+
+// Register a benchmark. The benchmark must outlive the run.
+void perf_register_benchmark(perf_benchmark_t *benchmark);
+
+// Define and register a benchmark function before main is executed.
+// Usage: PERF_BENCHMARK(sum_array) { ... }
+#define PERF_BENCHMARK(function)                                                                  \
+  static void function(void *argument);                                                           \
+  static perf_benchmark_t perf_benchmark_##function = {#function, function, NULL, NULL};         \
+  static void perf_register_benchmark_##function() __attribute__((constructor));                 \
+  static void perf_register_benchmark_##function() {                                              \
+    perf_register_benchmark(&perf_benchmark_##function);                                          \
+  }                                                                                               \
+  static void function(void *argument)
+
+// Get the first registered benchmark. Benchmarks are listed in the order they were registered.
+const perf_benchmark_t *perf_get_benchmarks();
+
+// Fill options with defaults: no pinning, 10 warmup iterations, 10 to 1000000
+// iterations of a single call each, 1% target error, overhead subtracted using 1000 calibration
+// iterations, text output to stdout.
+void perf_benchmark_default_options(perf_benchmark_options_t *options);
+
+// Create the default group used by perf_benchmark_main: user space instructions
+// and cycles, branch misses, task clock and context switches. Should be freed.
+// Returns NULL if an error occured.
+perf_group_t *perf_create_benchmark_group();
+
+// Run a single benchmark using an opened group of the calling thread.
+// statistics must hold group->size events and is reset before running.
+// If calibration is not NULL, its baseline is subtracted from each iteration.
+// Returns <0 if an error occured.
+int perf_run_benchmark(const perf_benchmark_t *benchmark, perf_group_t *group, const perf_benchmark_options_t *options, const perf_calibration_t *calibration, perf_statistics_t *statistics, perf_benchmark_result_t *result);
+
+// Run all registered benchmarks matching the filter and write their results.
+// Pins the calling thread for the duration of the run if a CPU is specified.
+// Returns <0 if an error occured.
+int perf_run_benchmarks(perf_group_t *group, const perf_benchmark_options_t *options);
+
+// A main function running all registered benchmarks using the default group.
+// Supports --cpu N, --warmup N, --min-iterations N, --max-iterations N, --batch N,
+// --target-error E, --subtract-overhead 0|1, --filter NAME and --format text|json|csv.
+int perf_benchmark_main(int argc, char **argv);
+
+#endif
@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "calibration.h"
+#include "group.h"
+#include "statistics.h"
+
+perf_calibration_t *perf_calibrate_group(perf_group_t *group, uint64_t iterations) {
+  // The calibration and its statistics are a single allocation
+  size_t allocation = sizeof(perf_calibration_t) +
+                      sizeof(perf_statistics_t) +
+                      sizeof(perf_statistic_t) * group->size +
+                      sizeof(uint64_t) * group->size * 2;
+
+  perf_calibration_t *calibration = (perf_calibration_t *)malloc(allocation);
+  if (calibration == NULL)
+    return NULL;
+
+  memset((void *)calibration, 0, allocation);
+
+  calibration->size = group->size;
+  calibration->statistics = (perf_statistics_t *)(calibration + 1);
+  calibration->statistics->size = group->size;
+  calibration->statistics->events = (perf_statistic_t *)(calibration->statistics + 1);
+  calibration->baseline = (uint64_t *)(calibration->statistics->events + group->size);
+  calibration->noise_floor = calibration->baseline + group->size;
+
+  // Measure exactly what a measured region pays, with nothing in between
+  for (uint64_t i = 0; i < iterations; i++) {
+    perf_start_group(group);
+    perf_stop_group(group);
+
+    if (perf_read_group(group) < 0) {
+      free((void *)calibration);
+      return NULL;
+    }
+
+    perf_statistics_add_group(calibration->statistics, group);
+  }
+
+  // The median is robust against the occasional interrupt landing in the pair
+  for (size_t slot = 0; slot < group->size; slot++) {
+    calibration->baseline[slot] = perf_statistic_percentile(&calibration->statistics->events[slot], 50);
+    calibration->noise_floor[slot] = perf_statistic_percentile(&calibration->statistics->events[slot], 99);
+  }
+
+  return calibration;
+}
+
+void perf_calibration_subtract(const perf_calibration_t *calibration, const uint64_t *values, uint64_t *corrected) {
+  for (size_t slot = 0; slot < calibration->size; slot++)
+    corrected[slot] = values[slot] > calibration->baseline[slot] ? values[slot] - calibration->baseline[slot] : 0;
+}
+
+int perf_calibration_is_below_noise_floor(const perf_calibration_t *calibration, size_t slot, uint64_t corrected) {
+  // An event unaffected by the measurement has no noise floor
+  if (calibration->noise_floor[slot] == 0)
+    return 0;
+
+  return corrected + calibration->baseline[slot] <= calibration->noise_floor[slot] ? 1 : 0;
+}
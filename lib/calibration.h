@@ -0,0 +1,39 @@
+#ifndef PERF_CALIBRATION_H
+#define PERF_CALIBRATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "group.h"
+#include "statistics.h"
+
+// The cost of the measurement itself. Starting and stopping a group retires
+// instructions and burns cycles (the return path of the enable ioctl and the entry
+// of the disable ioctl) which are attributed to the measured region.
+typedef struct {
+  // The number of members of the calibrated group
+  size_t size;
+  // The distribution of an empty start / stop pair, indexed by slot
+  perf_statistics_t *statistics;
+  // The median value of an empty start / stop pair, indexed by slot
+  uint64_t *baseline;
+  // The 99th percentile of an empty start / stop pair, indexed by slot. A region
+  // reading at or below this value is indistinguishable from an empty one
+  uint64_t *noise_floor;
+} perf_calibration_t;
+
+// Measure the overhead of an empty start / stop pair of an opened group.
+// The group is left stopped. Should be freed.
+// Returns NULL if an error occured.
+perf_calibration_t *perf_calibrate_group(perf_group_t *group, uint64_t iterations);
+
+// Subtract the calibrated baseline from values, indexed by slot. Values are clamped to zero.
+// values and corrected may be the same array.
+void perf_calibration_subtract(const perf_calibration_t *calibration, const uint64_t *values, uint64_t *corrected);
+
+// Whether or not a value, with the baseline already subtracted, lies within the
+// noise of the measurement itself. Events with a noise floor of zero are never below it.
+// Returns 1 if the value is below the noise floor, 0 otherwise.
+int perf_calibration_is_below_noise_floor(const perf_calibration_t *calibration, size_t slot, uint64_t corrected);
+
+#endif
@@ -0,0 +1,432 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "collector.h"
+#include "group.h"
+#include "utilities.h"
+
+// The number of values of a sample preceding the values of the members
+#define PERF_COLLECTOR_SAMPLE_HEADER 3
+
+static uint64_t perf_collector_now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+}
+
+static uint64_t *perf_collector_sample(const perf_collector_t *collector, const perf_collector_group_t *group, uint64_t index) {
+  size_t stride = PERF_COLLECTOR_SAMPLE_HEADER + group->group->size;
+  return &group->samples[(index % collector->history) * stride];
+}
+
+perf_collector_t *perf_create_collector(size_t capacity, size_t history, int interval) {
+  // At least two samples are needed to compute rates
+  if (history < 2 || interval <= 0)
+    return NULL;
+
+  // The collector, its groups and the exposition buffer are stored in a single allocation
+  size_t allocation = sizeof(perf_collector_t) + sizeof(perf_collector_group_t) * capacity + PERF_COLLECTOR_BUFFER_SIZE;
+  perf_collector_t *collector = (perf_collector_t *)malloc(allocation);
+  if (collector == NULL)
+    return NULL;
+
+  memset((void *)collector, 0, sizeof(perf_collector_t) + sizeof(perf_collector_group_t) * capacity);
+  collector->capacity = capacity;
+  collector->history = history;
+  collector->interval = interval;
+  collector->groups = (perf_collector_group_t *)(collector + 1);
+  collector->buffer = (char *)(collector->groups + capacity);
+
+  if (pipe2(collector->wake, O_CLOEXEC) < 0) {
+    free((void *)collector);
+    return NULL;
+  }
+
+  pthread_mutex_init(&collector->lock, NULL);
+  return collector;
+}
+
+int perf_collector_add_group(perf_collector_t *collector, const char *name, perf_group_t *group) {
+  if (collector->running || collector->size == collector->capacity)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  // The history is allocated up front, so that collecting never allocates
+  uint64_t *samples = (uint64_t *)calloc(collector->history * (PERF_COLLECTOR_SAMPLE_HEADER + group->size), sizeof(uint64_t));
+  if (samples == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  perf_collector_group_t *entry = &collector->groups[collector->size];
+  entry->name = name;
+  entry->group = group;
+  entry->samples_taken = 0;
+  entry->samples = samples;
+
+  return (int)collector->size++;
+}
+
+int perf_collector_listen(perf_collector_t *collector, const char *path) {
+  if (collector->running || collector->listeners_size == PERF_COLLECTOR_MAX_LISTENERS)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  struct sockaddr_un address;
+  memset((void *)&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path))
+    return PERF_ERROR_BAD_PARAMETERS;
+  strcpy(address.sun_path, path);
+
+  char *path_copy = strdup(path);
+  if (path_copy == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener < 0) {
+    free((void *)path_copy);
+    return PERF_ERROR_IO;
+  }
+
+  // A socket left behind by a previous run would fail the bind
+  unlink(path);
+  if (bind(listener, (const struct sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 8) < 0) {
+    close(listener);
+    free((void *)path_copy);
+    return PERF_ERROR_IO;
+  }
+
+  collector->listeners[collector->listeners_size] = listener;
+  collector->listener_paths[collector->listeners_size] = path_copy;
+  collector->listeners_size++;
+  return 0;
+}
+
+int perf_collector_listen_port(perf_collector_t *collector, uint16_t port) {
+  if (collector->running || collector->listeners_size == PERF_COLLECTOR_MAX_LISTENERS)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener < 0)
+    return PERF_ERROR_IO;
+
+  int reuse = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  // Only served locally
+  struct sockaddr_in address;
+  memset((void *)&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listener, (const struct sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 8) < 0) {
+    close(listener);
+    return PERF_ERROR_IO;
+  }
+
+  collector->listeners[collector->listeners_size] = listener;
+  collector->listener_paths[collector->listeners_size] = NULL;
+  collector->listeners_size++;
+  return 0;
+}
+
+// Read all groups once. Never allocates.
+static void perf_collector_tick(perf_collector_t *collector) {
+  uint64_t timestamp = perf_collector_now();
+
+  pthread_mutex_lock(&collector->lock);
+  for (size_t i = 0; i < collector->size; i++) {
+    perf_collector_group_t *entry = &collector->groups[i];
+    if (perf_read_group(entry->group) < 0)
+      continue;
+
+    uint64_t *sample = perf_collector_sample(collector, entry, entry->samples_taken);
+    sample[0] = timestamp;
+    sample[1] = entry->group->time_enabled;
+    sample[2] = entry->group->time_running;
+    memcpy((void *)&sample[PERF_COLLECTOR_SAMPLE_HEADER], (const void *)entry->group->values, sizeof(uint64_t) * entry->group->size);
+    entry->samples_taken++;
+  }
+  pthread_mutex_unlock(&collector->lock);
+}
+
+// Write an entire buffer to a socket, giving up on errors.
+static void perf_collector_send(int client, const char *buffer, size_t bytes) {
+  while (bytes > 0) {
+    ssize_t sent = send(client, buffer, bytes, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    buffer += sent;
+    bytes -= (size_t)sent;
+  }
+}
+
+// Serve the exposition to a single client of a listener.
+static void perf_collector_serve(perf_collector_t *collector, int listener, int http) {
+  int client = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+  if (client < 0)
+    return;
+
+  // A stalled client must not stall collecting
+  struct timeval timeout = {0, 100000};
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  // Clients of Unix sockets may simply read, or send an HTTP request first
+  struct pollfd request = {client, POLLIN, 0};
+  if (poll(&request, 1, http ? 100 : 10) > 0) {
+    char method[1024];
+    ssize_t bytes = recv(client, method, sizeof(method), 0);
+    if (bytes >= 4 && memcmp(method, "GET ", 4) == 0)
+      http = 1;
+  }
+
+  size_t length = perf_collector_exposition(collector, collector->buffer, PERF_COLLECTOR_BUFFER_SIZE);
+  if (http) {
+    char header[256];
+    int header_length = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", length);
+    perf_collector_send(client, header, (size_t)header_length);
+  }
+  perf_collector_send(client, collector->buffer, length);
+
+  close(client);
+}
+
+static void *perf_collector_run(void *argument) {
+  perf_collector_t *collector = (perf_collector_t *)argument;
+
+  struct pollfd descriptors[1 + PERF_COLLECTOR_MAX_LISTENERS];
+  descriptors[0].fd = collector->wake[0];
+  descriptors[0].events = POLLIN;
+  for (size_t i = 0; i < collector->listeners_size; i++) {
+    descriptors[1 + i].fd = collector->listeners[i];
+    descriptors[1 + i].events = POLLIN;
+  }
+
+  uint64_t interval = (uint64_t)collector->interval * 1000000;
+  uint64_t next = perf_collector_now();
+  for (;;) {
+    uint64_t now = perf_collector_now();
+    if (now >= next) {
+      perf_collector_tick(collector);
+      next += interval;
+      // Skip ticks missed while busy rather than reading in a burst
+      if (next <= now)
+        next = now + interval;
+    }
+
+    // Sleep until the next tick, serving scrapes meanwhile
+    int timeout = (int)((next - now + 999999) / 1000000);
+    int ready = poll(descriptors, 1 + collector->listeners_size, timeout);
+    if (ready < 0 && errno != EINTR)
+      break;
+    if (ready <= 0)
+      continue;
+
+    if (descriptors[0].revents)
+      break;
+
+    for (size_t i = 0; i < collector->listeners_size; i++) {
+      if (descriptors[1 + i].revents & POLLIN)
+        perf_collector_serve(collector, collector->listeners[i], collector->listener_paths[i] == NULL);
+    }
+  }
+
+  return NULL;
+}
+
+int perf_start_collector(perf_collector_t *collector) {
+  if (collector->running)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  // Started once, the groups are read as cumulative counters
+  for (size_t i = 0; i < collector->size; i++)
+    perf_start_group(collector->groups[i].group);
+
+  collector->running = 1;
+  if (pthread_create(&collector->thread, NULL, perf_collector_run, collector) != 0) {
+    collector->running = 0;
+    return PERF_ERROR_LIBRARY_FAILURE;
+  }
+
+  return 0;
+}
+
+int perf_stop_collector(perf_collector_t *collector) {
+  if (!collector->running)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  char stop = 1;
+  if (write(collector->wake[1], &stop, 1) != 1)
+    return PERF_ERROR_IO;
+
+  if (pthread_join(collector->thread, NULL) != 0)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  // Drain the wake-up, so that the collector may be started again
+  char drained;
+  if (read(collector->wake[0], &drained, 1) != 1)
+    return PERF_ERROR_IO;
+
+  collector->running = 0;
+  return 0;
+}
+
+size_t perf_collector_series(perf_collector_t *collector, size_t index, uint64_t *samples, size_t count) {
+  if (index >= collector->size)
+    return 0;
+
+  pthread_mutex_lock(&collector->lock);
+  const perf_collector_group_t *entry = &collector->groups[index];
+  size_t stride = PERF_COLLECTOR_SAMPLE_HEADER + entry->group->size;
+
+  uint64_t available = entry->samples_taken < collector->history ? entry->samples_taken : collector->history;
+  if (count > available)
+    count = (size_t)available;
+
+  uint64_t first = entry->samples_taken - count;
+  for (size_t i = 0; i < count; i++)
+    memcpy((void *)&samples[i * stride], (const void *)perf_collector_sample(collector, entry, first + i), sizeof(uint64_t) * stride);
+  pthread_mutex_unlock(&collector->lock);
+
+  return count;
+}
+
+// Append formatted text to a buffer, truncating at its end
+static void perf_collector_append(char *buffer, size_t size, size_t *length, const char *format, ...) {
+  if (*length + 1 >= size)
+    return;
+
+  va_list arguments;
+  va_start(arguments, format);
+  int written = vsnprintf(buffer + *length, size - *length, format, arguments);
+  va_end(arguments);
+
+  if (written < 0)
+    return;
+  *length += (size_t)written;
+  if (*length >= size)
+    *length = size - 1;
+}
+
+// Append a label value, escaping backslashes, quotes and newlines
+static void perf_collector_append_label(char *buffer, size_t size, size_t *length, const char *value) {
+  for (const char *c = value; *c != '\0'; c++) {
+    if (*c == '\\' || *c == '"')
+      perf_collector_append(buffer, size, length, "\\%c", *c);
+    else if (*c == '\n')
+      perf_collector_append(buffer, size, length, "\\n");
+    else
+      perf_collector_append(buffer, size, length, "%c", *c);
+  }
+}
+
+// Append the labels of an event, such as {group="service",event="instructions"}
+static void perf_collector_append_labels(char *buffer, size_t size, size_t *length, const char *group, const char *event) {
+  perf_collector_append(buffer, size, length, "{group=\"");
+  perf_collector_append_label(buffer, size, length, group);
+  if (event != NULL) {
+    perf_collector_append(buffer, size, length, "\",event=\"");
+    perf_collector_append_label(buffer, size, length, event);
+  }
+  perf_collector_append(buffer, size, length, "\"}");
+}
+
+size_t perf_collector_exposition(perf_collector_t *collector, char *buffer, size_t size) {
+  size_t length = 0;
+  if (size == 0)
+    return 0;
+  buffer[0] = '\0';
+
+  pthread_mutex_lock(&collector->lock);
+
+  perf_collector_append(buffer, size, &length, "# HELP perf_event_total The cumulative count of an event, scaled when multiplexed.\n# TYPE perf_event_total counter\n");
+  for (size_t i = 0; i < collector->size; i++) {
+    const perf_collector_group_t *entry = &collector->groups[i];
+    if (entry->samples_taken == 0)
+      continue;
+
+    const uint64_t *latest = perf_collector_sample(collector, entry, entry->samples_taken - 1);
+    for (size_t slot = 0; slot < entry->group->size; slot++) {
+      if (entry->group->members[slot].file_descriptor < 0)
+        continue;
+      perf_collector_append(buffer, size, &length, "perf_event_total");
+      perf_collector_append_labels(buffer, size, &length, entry->name, entry->group->names[slot]);
+      perf_collector_append(buffer, size, &length, " %" PRIu64 "\n", perf_scale_value(latest[PERF_COLLECTOR_SAMPLE_HEADER + slot], latest[1], latest[2]));
+    }
+  }
+
+  perf_collector_append(buffer, size, &length, "# HELP perf_event_rate The count of an event per second over the last interval.\n# TYPE perf_event_rate gauge\n");
+  for (size_t i = 0; i < collector->size; i++) {
+    const perf_collector_group_t *entry = &collector->groups[i];
+    if (entry->samples_taken < 2)
+      continue;
+
+    const uint64_t *latest = perf_collector_sample(collector, entry, entry->samples_taken - 1);
+    const uint64_t *previous = perf_collector_sample(collector, entry, entry->samples_taken - 2);
+    double elapsed = (double)(latest[0] - previous[0]) / 1e9;
+    if (elapsed <= 0)
+      continue;
+
+    for (size_t slot = 0; slot < entry->group->size; slot++) {
+      if (entry->group->members[slot].file_descriptor < 0)
+        continue;
+      uint64_t delta = perf_scale_value(latest[PERF_COLLECTOR_SAMPLE_HEADER + slot] - previous[PERF_COLLECTOR_SAMPLE_HEADER + slot], latest[1] - previous[1], latest[2] - previous[2]);
+      perf_collector_append(buffer, size, &length, "perf_event_rate");
+      perf_collector_append_labels(buffer, size, &length, entry->name, entry->group->names[slot]);
+      perf_collector_append(buffer, size, &length, " %.3f\n", (double)delta / elapsed);
+    }
+  }
+
+  perf_collector_append(buffer, size, &length, "# HELP perf_group_running_ratio The share of the last interval the group was counting.\n# TYPE perf_group_running_ratio gauge\n");
+  for (size_t i = 0; i < collector->size; i++) {
+    const perf_collector_group_t *entry = &collector->groups[i];
+    if (entry->samples_taken < 2)
+      continue;
+
+    const uint64_t *latest = perf_collector_sample(collector, entry, entry->samples_taken - 1);
+    const uint64_t *previous = perf_collector_sample(collector, entry, entry->samples_taken - 2);
+    uint64_t enabled = latest[1] - previous[1];
+    uint64_t running = latest[2] - previous[2];
+    perf_collector_append(buffer, size, &length, "perf_group_running_ratio");
+    perf_collector_append_labels(buffer, size, &length, entry->name, NULL);
+    perf_collector_append(buffer, size, &length, " %.6f\n", enabled == 0 ? 0 : (double)running / (double)enabled);
+  }
+
+  pthread_mutex_unlock(&collector->lock);
+  return length;
+}
+
+void perf_free_collector(perf_collector_t *collector) {
+  if (collector->running)
+    perf_stop_collector(collector);
+
+  for (size_t i = 0; i < collector->listeners_size; i++) {
+    close(collector->listeners[i]);
+    if (collector->listener_paths[i] != NULL) {
+      unlink(collector->listener_paths[i]);
+      free((void *)collector->listener_paths[i]);
+    }
+  }
+
+  for (size_t i = 0; i < collector->size; i++)
+    free((void *)collector->groups[i].samples);
+
+  close(collector->wake[0]);
+  close(collector->wake[1]);
+  pthread_mutex_destroy(&collector->lock);
+  free((void *)collector);
+}
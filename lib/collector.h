@@ -0,0 +1,92 @@
+#ifndef PERF_COLLECTOR_H
+#define PERF_COLLECTOR_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "group.h"
+
+// The maximum number of sockets a collector listens on
+#define PERF_COLLECTOR_MAX_LISTENERS 4
+// The size of the buffer used to serve the exposition. Longer expositions are truncated
+#define PERF_COLLECTOR_BUFFER_SIZE (64 * 1024)
+
+// A group read by a collector, and its recent samples.
+typedef struct {
+  // The name of the group, exported as the group label. Not owned by the collector
+  const char *name;
+  // The group. Not owned by the collector
+  perf_group_t *group;
+  // The number of samples taken. The latest sample is at (samples_taken - 1) % history
+  uint64_t samples_taken;
+  // The ring of samples, history samples of { timestamp, time_enabled, time_running, values... }
+  uint64_t *samples;
+} perf_collector_group_t;
+
+// Reads groups periodically on a background thread, keeping a bounded history of
+// samples and serving the latest values and rates in the Prometheus text format.
+typedef struct {
+  // The groups
+  size_t size;
+  size_t capacity;
+  perf_collector_group_t *groups;
+  // The number of samples kept per group
+  size_t history;
+  // The interval between reads in milliseconds
+  int interval;
+  // The sockets accepting scrapes, and the path of each Unix socket. NULL for TCP sockets
+  size_t listeners_size;
+  int listeners[PERF_COLLECTOR_MAX_LISTENERS];
+  char *listener_paths[PERF_COLLECTOR_MAX_LISTENERS];
+  // Written to wake the collector when stopping
+  int wake[2];
+  // The buffer the exposition is written to when serving a scrape
+  char *buffer;
+  // Guards the samples when read by other threads
+  pthread_mutex_t lock;
+  pthread_t thread;
+  int running;
+} perf_collector_t;
+
+// Create a collector reading capacity groups every interval milliseconds, keeping
+// history samples per group. Should be freed using perf_free_collector.
+// Returns NULL if an error occured.
+perf_collector_t *perf_create_collector(size_t capacity, size_t history, int interval);
+
+// Add an opened group to the collector. The group is started once by perf_start_collector
+// and read as cumulative counters. Must be called before the collector is started.
+// Returns <0 if an error occured, the index of the group otherwise.
+int perf_collector_add_group(perf_collector_t *collector, const char *name, perf_group_t *group);
+
+// Serve the exposition on a Unix socket at path, replacing any existing socket.
+// Clients may send an HTTP GET request, such as curl --unix-socket, or simply read.
+// Returns <0 if an error occured.
+int perf_collector_listen(perf_collector_t *collector, const char *path);
+
+// Serve the exposition over HTTP on a port of the loopback interface.
+// Returns <0 if an error occured.
+int perf_collector_listen_port(perf_collector_t *collector, uint16_t port);
+
+// Start all groups and the collecting thread.
+// Returns <0 if an error occured.
+int perf_start_collector(perf_collector_t *collector);
+
+// Stop the collecting thread. The groups are left running.
+// Returns <0 if an error occured.
+int perf_stop_collector(perf_collector_t *collector);
+
+// Copy the latest samples of a group, oldest first, into samples. Each sample is
+// 3 + group->size values: { timestamp, time_enabled, time_running, values... }.
+// The timestamp is CLOCK_MONOTONIC in nanoseconds.
+// Returns the number of copied samples, at most count.
+size_t perf_collector_series(perf_collector_t *collector, size_t index, uint64_t *samples, size_t count);
+
+// Write the latest values and rates of all groups in the Prometheus text format.
+// Returns the length of the exposition, truncated to fit size - 1 bytes.
+size_t perf_collector_exposition(perf_collector_t *collector, char *buffer, size_t size);
+
+// Stop the collector if running, close its sockets and free it. The groups are not closed.
+void perf_free_collector(perf_collector_t *collector);
+
+#endif
@@ -0,0 +1,371 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compare.h"
+#include "group.h"
+#include "utilities.h"
+
+// A value of either variant of a Mann-Whitney U test
+typedef struct {
+  double value;
+  // 0 for the baseline, 1 for the variant
+  int sample;
+} perf_ranked_value_t;
+
+static int perf_compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static int perf_compare_ranked_values(const void *a, const void *b) {
+  return perf_compare_doubles(&((const perf_ranked_value_t *)a)->value, &((const perf_ranked_value_t *)b)->value);
+}
+
+static const uint64_t *perf_comparison_sample(const perf_comparison_t *comparison, size_t variant, size_t iteration) {
+  return &comparison->samples[(variant * comparison->capacity + iteration) * comparison->size];
+}
+
+// Copy the values of an event of a variant, sorted
+static void perf_comparison_column(const perf_comparison_t *comparison, size_t variant, size_t slot, double *values) {
+  for (size_t i = 0; i < comparison->counts[variant]; i++)
+    values[i] = (double)perf_comparison_sample(comparison, variant, i)[slot];
+  qsort(values, comparison->counts[variant], sizeof(double), perf_compare_doubles);
+}
+
+static double perf_median(const double *sorted, size_t count) {
+  if (count == 0)
+    return 0;
+  if (count % 2 == 1)
+    return sorted[count / 2];
+  return (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+static void perf_mean_variance(const double *values, size_t count, double *mean, double *variance) {
+  double sum = 0;
+  for (size_t i = 0; i < count; i++)
+    sum += values[i];
+  *mean = count == 0 ? 0 : sum / (double)count;
+
+  double squares = 0;
+  for (size_t i = 0; i < count; i++)
+    squares += (values[i] - *mean) * (values[i] - *mean);
+  *variance = count < 2 ? 0 : squares / (double)(count - 1);
+}
+
+// The two-sided p-value of the Mann-Whitney U test, using the normal approximation
+// with a correction for ties. values holds both samples and is sorted in place.
+static double perf_mann_whitney(perf_ranked_value_t *values, size_t baseline_count, size_t variant_count) {
+  size_t count = baseline_count + variant_count;
+  if (baseline_count == 0 || variant_count == 0)
+    return 1;
+
+  qsort(values, count, sizeof(perf_ranked_value_t), perf_compare_ranked_values);
+
+  // Tied values share the average of their ranks
+  double baseline_ranks = 0;
+  double ties = 0;
+  for (size_t i = 0; i < count;) {
+    size_t j = i;
+    while (j < count && values[j].value == values[i].value)
+      j++;
+
+    double rank = (double)(i + 1 + j) / 2;
+    for (size_t k = i; k < j; k++) {
+      if (values[k].sample == 0)
+        baseline_ranks += rank;
+    }
+
+    double tied = (double)(j - i);
+    ties += tied * tied * tied - tied;
+    i = j;
+  }
+
+  double n1 = (double)baseline_count;
+  double n2 = (double)variant_count;
+  double n = n1 + n2;
+  double u = baseline_ranks - n1 * (n1 + 1) / 2;
+  double mean = n1 * n2 / 2;
+  double variance = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+  if (variance <= 0)
+    return 1;
+
+  // Continuity correction towards the mean
+  double distance = fabs(u - mean) - 0.5;
+  if (distance < 0)
+    distance = 0;
+  return erfc(distance / sqrt(variance) / sqrt(2));
+}
+
+perf_comparison_t *perf_create_comparison(const perf_group_t *group, const char **variant_names, size_t count, size_t iterations) {
+  if (count == 0)
+    return NULL;
+
+  // The comparison, the counts and the samples are stored in a single allocation
+  size_t allocation = sizeof(perf_comparison_t) + sizeof(size_t) * count + sizeof(uint64_t) * count * iterations * group->size;
+  perf_comparison_t *comparison = (perf_comparison_t *)malloc(allocation);
+  if (comparison == NULL)
+    return NULL;
+
+  comparison->size = group->size;
+  comparison->names = group->names;
+  comparison->variants = count;
+  comparison->variant_names = variant_names;
+  comparison->capacity = iterations;
+  comparison->counts = (size_t *)(comparison + 1);
+  comparison->samples = (uint64_t *)(comparison->counts + count);
+  memset((void *)comparison->counts, 0, sizeof(size_t) * count);
+
+  return comparison;
+}
+
+int perf_comparison_add(perf_comparison_t *comparison, size_t variant, const uint64_t *values) {
+  if (variant >= comparison->variants || comparison->counts[variant] == comparison->capacity)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  uint64_t *sample = (uint64_t *)perf_comparison_sample(comparison, variant, comparison->counts[variant]++);
+  memcpy((void *)sample, (const void *)values, sizeof(uint64_t) * comparison->size);
+  return 0;
+}
+
+int perf_compare_variants(perf_comparison_t *comparison, perf_group_t *group, const perf_variant_t *variants, void *argument, size_t iterations) {
+  if (group->size != comparison->size)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  for (size_t i = 0; i < iterations; i++) {
+    for (size_t j = 0; j < comparison->variants; j++) {
+      // Rotate the order, so that no variant always runs first
+      size_t variant = (i + j) % comparison->variants;
+
+      perf_start_group(group);
+      variants[variant](argument);
+      perf_stop_group(group);
+
+      int status = perf_read_group(group);
+      if (status < 0)
+        return status;
+
+      status = perf_comparison_add(comparison, variant, group->values);
+      if (status < 0)
+        return status;
+    }
+  }
+
+  return 0;
+}
+
+int perf_compare_event(const perf_comparison_t *comparison, size_t variant, size_t slot, perf_comparison_result_t *result) {
+  if (variant >= comparison->variants || slot >= comparison->size)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  size_t baseline_count = comparison->counts[0];
+  size_t variant_count = comparison->counts[variant];
+
+  double *baseline = (double *)malloc(sizeof(double) * (baseline_count + variant_count + 1));
+  perf_ranked_value_t *ranked = (perf_ranked_value_t *)malloc(sizeof(perf_ranked_value_t) * (baseline_count + variant_count + 1));
+  if (baseline == NULL || ranked == NULL) {
+    free((void *)baseline);
+    free((void *)ranked);
+    return PERF_ERROR_LIBRARY_FAILURE;
+  }
+  double *values = baseline + baseline_count;
+
+  perf_comparison_column(comparison, 0, slot, baseline);
+  perf_comparison_column(comparison, variant, slot, values);
+
+  result->baseline_median = perf_median(baseline, baseline_count);
+  result->median = perf_median(values, variant_count);
+  result->change = result->baseline_median == 0 ? 0 : (result->median - result->baseline_median) / result->baseline_median;
+
+  // Welch's interval of the difference of the means, using the normal approximation
+  double baseline_mean, baseline_variance, mean, variance;
+  perf_mean_variance(baseline, baseline_count, &baseline_mean, &baseline_variance);
+  perf_mean_variance(values, variant_count, &mean, &variance);
+  double error = 0;
+  if (baseline_count > 0 && variant_count > 0)
+    error = 1.96 * sqrt(baseline_variance / (double)baseline_count + variance / (double)variant_count);
+  result->difference = mean - baseline_mean;
+  result->difference_low = result->difference - error;
+  result->difference_high = result->difference + error;
+
+  for (size_t i = 0; i < baseline_count; i++)
+    ranked[i] = (perf_ranked_value_t){baseline[i], 0};
+  for (size_t i = 0; i < variant_count; i++)
+    ranked[baseline_count + i] = (perf_ranked_value_t){values[i], 1};
+  result->p_value = perf_mann_whitney(ranked, baseline_count, variant_count);
+
+  free((void *)baseline);
+  free((void *)ranked);
+  return 0;
+}
+
+int perf_print_comparison(const perf_comparison_t *comparison, FILE *output) {
+  for (size_t variant = 1; variant < comparison->variants; variant++) {
+    fprintf(output, "%s (%zu iterations) vs %s (%zu iterations)\n", comparison->variant_names[variant], comparison->counts[variant], comparison->variant_names[0], comparison->counts[0]);
+    fprintf(output, "            event    baseline p50     variant p50      change         95%% CI of mean difference        p\n");
+
+    for (size_t slot = 0; slot < comparison->size; slot++) {
+      perf_comparison_result_t result;
+      int status = perf_compare_event(comparison, variant, slot, &result);
+      if (status < 0)
+        return status;
+
+      fprintf(output, "%17s%16.1f%16.1f%+11.2f%%   [%15.1f, %15.1f]%9.4f%s\n",
+              comparison->names[slot],
+              result.baseline_median,
+              result.median,
+              100 * result.change,
+              result.difference_low,
+              result.difference_high,
+              result.p_value,
+              result.p_value < 0.05 ? " *" : "");
+    }
+    fprintf(output, "\n");
+  }
+
+  return 0;
+}
+
+int perf_save_baseline(const perf_comparison_t *comparison, const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL)
+    return PERF_ERROR_IO;
+
+  double *values = (double *)malloc(sizeof(double) * (comparison->capacity + 1));
+  if (values == NULL) {
+    fclose(file);
+    return PERF_ERROR_LIBRARY_FAILURE;
+  }
+
+  fprintf(file, "# variant\tevent\tmedian\tmean\tstddev\tcount\n");
+  for (size_t variant = 0; variant < comparison->variants; variant++) {
+    for (size_t slot = 0; slot < comparison->size; slot++) {
+      perf_comparison_column(comparison, variant, slot, values);
+
+      double mean, variance;
+      perf_mean_variance(values, comparison->counts[variant], &mean, &variance);
+      fprintf(file, "%s\t%s\t%.3f\t%.3f\t%.3f\t%zu\n",
+              comparison->variant_names[variant],
+              comparison->names[slot],
+              perf_median(values, comparison->counts[variant]),
+              mean,
+              sqrt(variance),
+              comparison->counts[variant]);
+    }
+  }
+
+  free((void *)values);
+  if (fclose(file) != 0)
+    return PERF_ERROR_IO;
+
+  return 0;
+}
+
+// Copy a field of a baseline line, failing if it's missing or too long.
+// Returns <0 if an error occured.
+static int perf_baseline_field(char **line, char *field, size_t size) {
+  char *value = strsep(line, "\t\n");
+  if (value == NULL || strlen(value) >= size)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  strcpy(field, value);
+  return 0;
+}
+
+perf_baseline_t *perf_load_baseline(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+    return NULL;
+
+  size_t capacity = 16;
+  perf_baseline_t *baseline = (perf_baseline_t *)malloc(sizeof(perf_baseline_t) + sizeof(perf_baseline_entry_t) * capacity);
+  if (baseline == NULL) {
+    fclose(file);
+    return NULL;
+  }
+  baseline->size = 0;
+  baseline->entries = (perf_baseline_entry_t *)(baseline + 1);
+
+  char buffer[2 * PERF_BASELINE_MAX_NAME + 256];
+  while (fgets(buffer, sizeof(buffer), file) != NULL) {
+    if (buffer[0] == '#' || buffer[0] == '\n')
+      continue;
+
+    if (baseline->size == capacity) {
+      capacity *= 2;
+      perf_baseline_t *grown = (perf_baseline_t *)realloc(baseline, sizeof(perf_baseline_t) + sizeof(perf_baseline_entry_t) * capacity);
+      if (grown == NULL) {
+        free((void *)baseline);
+        fclose(file);
+        return NULL;
+      }
+      baseline = grown;
+      baseline->entries = (perf_baseline_entry_t *)(baseline + 1);
+    }
+
+    perf_baseline_entry_t *entry = &baseline->entries[baseline->size];
+    char *line = buffer;
+    char *end;
+    if (perf_baseline_field(&line, entry->variant, sizeof(entry->variant)) < 0 ||
+        perf_baseline_field(&line, entry->name, sizeof(entry->name)) < 0 ||
+        line == NULL) {
+      free((void *)baseline);
+      fclose(file);
+      return NULL;
+    }
+
+    entry->median = strtod(line, &end);
+    entry->mean = strtod(end, &end);
+    entry->stddev = strtod(end, &end);
+    entry->count = strtoull(end, &end, 10);
+    if (end == line) {
+      free((void *)baseline);
+      fclose(file);
+      return NULL;
+    }
+
+    baseline->size++;
+  }
+
+  fclose(file);
+  return baseline;
+}
+
+int perf_check_baseline(const perf_comparison_t *comparison, const perf_baseline_t *baseline, double threshold, FILE *output) {
+  double *values = (double *)malloc(sizeof(double) * (comparison->capacity + 1));
+  if (values == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  int regressions = 0;
+  for (size_t variant = 0; variant < comparison->variants; variant++) {
+    for (size_t slot = 0; slot < comparison->size; slot++) {
+      const perf_baseline_entry_t *entry = NULL;
+      for (size_t i = 0; i < baseline->size; i++) {
+        if (strcmp(baseline->entries[i].variant, comparison->variant_names[variant]) == 0 && strcmp(baseline->entries[i].name, comparison->names[slot]) == 0) {
+          entry = &baseline->entries[i];
+          break;
+        }
+      }
+
+      // Events that are new, or counted nothing in the baseline, such as unsupported events, are not compared
+      if (entry == NULL || entry->median <= 0 || comparison->counts[variant] == 0)
+        continue;
+
+      perf_comparison_column(comparison, variant, slot, values);
+      double median = perf_median(values, comparison->counts[variant]);
+      double change = (median - entry->median) / entry->median;
+      if (change <= threshold)
+        continue;
+
+      regressions++;
+      if (output != NULL)
+        fprintf(output, "regression: %s %s %.1f -> %.1f (%+.2f%%, threshold %.2f%%)\n", comparison->variant_names[variant], comparison->names[slot], entry->median, median, 100 * change, 100 * threshold);
+    }
+  }
+
+  free((void *)values);
+  return regressions;
+}
@@ -0,0 +1,104 @@
+#ifndef PERF_COMPARE_H
+#define PERF_COMPARE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "group.h"
+
+// The maximum length of a variant or event name in a baseline file
+#define PERF_BASELINE_MAX_NAME 128
+
+// A function measured as a variant of a comparison.
+typedef void (*perf_variant_t)(void *argument);
+
+// The values of each iteration of several variants of the same code, such as two
+// implementations of a function. The first variant is the baseline the others are compared to.
+typedef struct {
+  // The number of events, the members of the measured group
+  size_t size;
+  // The name of each event. Not owned by the comparison
+  const char **names;
+  // The number of variants and the name of each. Not owned by the comparison
+  size_t variants;
+  const char **variant_names;
+  // The maximum number of iterations per variant
+  size_t capacity;
+  // The number of iterations of each variant
+  size_t *counts;
+  // The values of each iteration, indexed by [variant][iteration][slot]
+  uint64_t *samples;
+} perf_comparison_t;
+
+// The comparison of a single event of a variant to the baseline variant.
+typedef struct {
+  // The medians of the baseline and the variant
+  double baseline_median;
+  double median;
+  // The relative change of the median, such as 0.05 for 5% more than the baseline
+  double change;
+  // The difference of the means (variant - baseline) and its 95% confidence interval
+  double difference;
+  double difference_low;
+  double difference_high;
+  // The two-sided p-value of the Mann-Whitney U test. Below 0.05 the variants likely differ
+  double p_value;
+} perf_comparison_result_t;
+
+// A summary of each event of each variant, saved to compare later runs against.
+typedef struct {
+  // The names of the variant and the event
+  char variant[PERF_BASELINE_MAX_NAME];
+  char name[PERF_BASELINE_MAX_NAME];
+  double median;
+  double mean;
+  double stddev;
+  uint64_t count;
+} perf_baseline_entry_t;
+
+typedef struct {
+  size_t size;
+  perf_baseline_entry_t *entries;
+} perf_baseline_t;
+
+// Create a comparison of count variants of the members of a group, holding up to
+// iterations values per variant. Should be freed.
+// Returns NULL if an error occured.
+perf_comparison_t *perf_create_comparison(const perf_group_t *group, const char **variant_names, size_t count, size_t iterations);
+
+// Add the values of an iteration of a variant, indexed by slot.
+// Returns <0 if an error occured.
+int perf_comparison_add(perf_comparison_t *comparison, size_t variant, const uint64_t *values);
+
+// Measure all variants using an opened group for iterations iterations. The variants
+// are interleaved, rotating the order every iteration, so that drift such as thermal
+// throttling or frequency changes affects all variants alike.
+// Returns <0 if an error occured.
+int perf_compare_variants(perf_comparison_t *comparison, perf_group_t *group, const perf_variant_t *variants, void *argument, size_t iterations);
+
+// Compare an event of a variant to the baseline variant.
+// Returns <0 if an error occured.
+int perf_compare_event(const perf_comparison_t *comparison, size_t variant, size_t slot, perf_comparison_result_t *result);
+
+// Print the comparison of each variant to the baseline variant. Significant changes are marked with *.
+// Returns <0 if an error occured.
+int perf_print_comparison(const perf_comparison_t *comparison, FILE *output);
+
+// Save a summary of all events of all variants as tab separated lines of
+// variant, event, median, mean, stddev and count.
+// Returns <0 if an error occured.
+int perf_save_baseline(const perf_comparison_t *comparison, const char *path);
+
+// Load a saved summary. Should be freed.
+// Returns NULL if an error occured.
+perf_baseline_t *perf_load_baseline(const char *path);
+
+// Compare the medians of a comparison to a baseline, matching events by the names
+// of the variant and the event. Lower is considered better, as for counts such as instructions. An event
+// regresses when its median exceeds the baseline's by more than threshold, such as
+// 0.02 for 2%. Each regression is printed to output unless it's NULL.
+// Returns <0 if an error occured, the number of regressed events otherwise.
+int perf_check_baseline(const perf_comparison_t *comparison, const perf_baseline_t *baseline, double threshold, FILE *output);
+
+#endif
@@ -0,0 +1,317 @@
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/capability.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "environment.h"
+#include "perf.h"
+#include "utilities.h"
+
+// CAP_PERFMON was added in Linux 5.8
+// https://elixir.bootlin.com/linux/latest/source/include/uapi/linux/capability.h
+#ifndef CAP_PERFMON
+#define CAP_PERFMON 38
+#endif
+
+// The version of the support cache format
+#define PERF_EVENT_SUPPORT_CACHE_VERSION 2
+
+static perf_environment_t environment;
+// 0 if the snapshot is not taken, 1 while it's being taken and 2 once it's available
+static int environment_state = 0;
+
+// Read both capabilities using a single call to cap_get_proc.
+static void perf_read_capabilities(perf_environment_t *snapshot) {
+  snapshot->has_cap_sys_admin = PERF_ERROR_LIBRARY_FAILURE;
+  snapshot->has_cap_perfmon = CAP_IS_SUPPORTED(CAP_PERFMON) ? PERF_ERROR_LIBRARY_FAILURE : PERF_ERROR_CAPABILITY_NOT_SUPPORTED;
+
+  cap_t capabilities = cap_get_proc();
+  if (capabilities == NULL)
+    return;
+
+  cap_flag_value_t value;
+  if (cap_get_flag(capabilities, CAP_SYS_ADMIN, CAP_EFFECTIVE, &value) == 0)
+    snapshot->has_cap_sys_admin = value == CAP_SET;
+
+  if (CAP_IS_SUPPORTED(CAP_PERFMON) && cap_get_flag(capabilities, CAP_PERFMON, CAP_EFFECTIVE, &value) == 0)
+    snapshot->has_cap_perfmon = value == CAP_SET;
+
+  cap_free(capabilities);
+}
+
+// Read the raw paranoia and derive its flags, reading the file only once.
+static void perf_read_paranoia(perf_environment_t *snapshot) {
+  snapshot->event_paranoia = PERF_ERROR_IO;
+
+  FILE *perf_event_paranoid = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+  if (perf_event_paranoid == NULL)
+    return;
+
+  if (fscanf(perf_event_paranoid, "%d", &snapshot->paranoia) == 1)
+    snapshot->event_paranoia = perf_event_paranoia_flags(snapshot->paranoia);
+  else
+    snapshot->paranoia = 0;
+
+  fclose(perf_event_paranoid);
+}
+
+static void perf_read_kernel(perf_environment_t *snapshot) {
+  snapshot->kernel_major = -1;
+  snapshot->kernel_minor = -1;
+  snapshot->kernel_patch = -1;
+
+  struct utsname name;
+  if (uname(&name) < 0)
+    return;
+
+  snprintf(snapshot->kernel_release, sizeof(snapshot->kernel_release), "%s", name.release);
+  if (sscanf(name.release, "%d.%d.%d", &snapshot->kernel_major, &snapshot->kernel_minor, &snapshot->kernel_patch) < 3) {
+    snapshot->kernel_major = -1;
+    snapshot->kernel_minor = -1;
+    snapshot->kernel_patch = -1;
+  }
+}
+
+static void perf_read_cpu_model(perf_environment_t *snapshot) {
+  strcpy(snapshot->cpu_model, "unknown");
+
+  FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+  if (cpuinfo == NULL)
+    return;
+
+  // x86 lists a "model name", other architectures identify the core by its part number
+  char line[256];
+  while (fgets(line, sizeof(line), cpuinfo) != NULL) {
+    if (strncmp(line, "model name", 10) != 0 && strncmp(line, "CPU part", 8) != 0 && strncmp(line, "cpu model", 9) != 0)
+      continue;
+
+    char *value = strchr(line, ':');
+    if (value == NULL)
+      continue;
+
+    value += strspn(value, ": \t");
+    value[strcspn(value, "\n")] = '\0';
+    snprintf(snapshot->cpu_model, sizeof(snapshot->cpu_model), "%s", value);
+    break;
+  }
+
+  fclose(cpuinfo);
+}
+
+static void perf_read_pmus(perf_environment_t *snapshot) {
+  DIR *devices = opendir("/sys/bus/event_source/devices");
+  if (devices == NULL)
+    return;
+
+  struct dirent *entry;
+  while ((entry = readdir(devices)) != NULL && snapshot->pmus < PERF_MAX_PMUS) {
+    if (entry->d_name[0] == '.')
+      continue;
+
+    char path[512];
+    snprintf(path, sizeof(path), "/sys/bus/event_source/devices/%s/type", entry->d_name);
+    FILE *type = fopen(path, "r");
+    if (type == NULL)
+      continue;
+
+    perf_pmu_t *pmu = &snapshot->pmu[snapshot->pmus];
+    if (fscanf(type, "%d", &pmu->type) == 1) {
+      // PMU names are short, longer names are truncated
+      snprintf(pmu->name, sizeof(pmu->name), "%.*s", (int)sizeof(pmu->name) - 1, entry->d_name);
+      snapshot->pmus++;
+    }
+
+    fclose(type);
+  }
+
+  closedir(devices);
+}
+
+static void perf_take_environment_snapshot(perf_environment_t *snapshot) {
+  memset((void *)snapshot, 0, sizeof(perf_environment_t));
+  perf_read_capabilities(snapshot);
+  perf_read_paranoia(snapshot);
+  perf_read_kernel(snapshot);
+  perf_read_cpu_model(snapshot);
+  perf_read_pmus(snapshot);
+}
+
+const perf_environment_t *perf_get_environment() {
+  if (__atomic_load_n(&environment_state, __ATOMIC_ACQUIRE) == 2)
+    return &environment;
+
+  // The first caller takes the snapshot, concurrent callers wait for it
+  int expected = 0;
+  if (__atomic_compare_exchange_n(&environment_state, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    perf_take_environment_snapshot(&environment);
+    __atomic_store_n(&environment_state, 2, __ATOMIC_RELEASE);
+  } else {
+    while (__atomic_load_n(&environment_state, __ATOMIC_ACQUIRE) != 2)
+      sched_yield();
+  }
+
+  return &environment;
+}
+
+void perf_refresh_environment() {
+  perf_take_environment_snapshot(&environment);
+  __atomic_store_n(&environment_state, 2, __ATOMIC_RELEASE);
+}
+
+int perf_get_pmu_type(const char *name) {
+  const perf_environment_t *snapshot = perf_get_environment();
+  for (size_t i = 0; i < snapshot->pmus; i++) {
+    if (strcmp(snapshot->pmu[i].name, name) == 0)
+      return snapshot->pmu[i].type;
+  }
+
+  return PERF_ERROR_NOT_SUPPORTED;
+}
+
+// Build the key identifying the system the support was probed on. Includes the
+// paranoia and capabilities, as events refused for lack of privilege are probed as
+// unsupported, and the catalogue dimensions, which depend on the kernel headers the
+// library was built with.
+static void perf_event_support_key(char *key, size_t size) {
+  const perf_environment_t *snapshot = perf_get_environment();
+  snprintf(key, size, "%s|%s|%d|%d%d|%d.%d.%d.%d.%d", snapshot->kernel_release, snapshot->cpu_model, snapshot->paranoia, snapshot->has_cap_sys_admin == 1, snapshot->has_cap_perfmon == 1, PERF_COUNT_HW_MAX, PERF_COUNT_SW_MAX, PERF_COUNT_HW_CACHE_MAX, PERF_COUNT_HW_CACHE_OP_MAX, PERF_COUNT_HW_CACHE_RESULT_MAX);
+}
+
+// Returns whether or not an event may be opened counting user space of the calling thread.
+static uint8_t perf_probe_event(int type, uint64_t config) {
+  perf_event_attr_t attribute;
+  memset((void *)&attribute, 0, sizeof(perf_event_attr_t));
+  attribute.size = sizeof(perf_event_attr_t);
+  attribute.type = type;
+  attribute.config = config;
+  attribute.disabled = 1;
+  attribute.exclude_kernel = 1;
+  attribute.exclude_hv = 1;
+
+  int file_descriptor = perf_event_open(&attribute, 0, -1, -1, 0);
+  if (file_descriptor < 0)
+    return 0;
+
+  close(file_descriptor);
+  return 1;
+}
+
+// Read a line of '0' and '1' characters into flags.
+static int perf_read_flags(FILE *file, uint8_t *flags, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    int character = fgetc(file);
+    if (character != '0' && character != '1')
+      return PERF_ERROR_IO;
+    flags[i] = character == '1';
+  }
+
+  return fgetc(file) == '\n' ? 0 : PERF_ERROR_IO;
+}
+
+static void perf_write_flags(FILE *file, const uint8_t *flags, size_t count) {
+  for (size_t i = 0; i < count; i++)
+    fputc(flags[i] ? '1' : '0', file);
+  fputc('\n', file);
+}
+
+// Load a cached catalogue.
+// Returns <0 if the cache could not be used.
+static int perf_load_event_support(perf_event_support_t *support, const char *cache_path) {
+  FILE *cache = fopen(cache_path, "r");
+  if (cache == NULL)
+    return PERF_ERROR_IO;
+
+  int version = 0;
+  char key[sizeof(support->key) + 2];
+  int status = PERF_ERROR_IO;
+  if (fscanf(cache, "perf-event-support %d\n", &version) == 1 && version == PERF_EVENT_SUPPORT_CACHE_VERSION && fgets(key, sizeof(key), cache) != NULL) {
+    key[strcspn(key, "\n")] = '\0';
+    if (strcmp(key, support->key) == 0 &&
+        perf_read_flags(cache, support->hardware, sizeof(support->hardware)) == 0 &&
+        perf_read_flags(cache, support->software, sizeof(support->software)) == 0 &&
+        perf_read_flags(cache, &support->hardware_cache[0][0][0], sizeof(support->hardware_cache)) == 0)
+      status = 0;
+  }
+
+  fclose(cache);
+  return status;
+}
+
+// Write a catalogue to the cache. The file is replaced atomically, so concurrent
+// readers never see a partial cache.
+static int perf_store_event_support(const perf_event_support_t *support, const char *cache_path) {
+  char temporary_path[4096];
+  snprintf(temporary_path, sizeof(temporary_path), "%s.%d", cache_path, (int)getpid());
+
+  FILE *cache = fopen(temporary_path, "w");
+  if (cache == NULL)
+    return PERF_ERROR_IO;
+
+  fprintf(cache, "perf-event-support %d\n%s\n", PERF_EVENT_SUPPORT_CACHE_VERSION, support->key);
+  perf_write_flags(cache, support->hardware, sizeof(support->hardware));
+  perf_write_flags(cache, support->software, sizeof(support->software));
+  perf_write_flags(cache, &support->hardware_cache[0][0][0], sizeof(support->hardware_cache));
+
+  if (fclose(cache) != 0 || rename(temporary_path, cache_path) < 0) {
+    unlink(temporary_path);
+    return PERF_ERROR_IO;
+  }
+
+  return 0;
+}
+
+int perf_probe_event_support(perf_event_support_t *support, const char *cache_path) {
+  memset((void *)support, 0, sizeof(perf_event_support_t));
+  perf_event_support_key(support->key, sizeof(support->key));
+
+  if (cache_path != NULL && perf_load_event_support(support, cache_path) == 0)
+    return 1;
+
+  for (int config = 0; config < PERF_COUNT_HW_MAX; config++)
+    support->hardware[config] = perf_probe_event(PERF_TYPE_HARDWARE, config);
+
+  for (int config = 0; config < PERF_COUNT_SW_MAX; config++)
+    support->software[config] = perf_probe_event(PERF_TYPE_SOFTWARE, config);
+
+  // Cache events are encoded as id | (op << 8) | (result << 16)
+  for (int id = 0; id < PERF_COUNT_HW_CACHE_MAX; id++) {
+    for (int op = 0; op < PERF_COUNT_HW_CACHE_OP_MAX; op++) {
+      for (int result = 0; result < PERF_COUNT_HW_CACHE_RESULT_MAX; result++)
+        support->hardware_cache[id][op][result] = perf_probe_event(PERF_TYPE_HW_CACHE, id | (op << 8) | (result << 16));
+    }
+  }
+
+  // A cache that can't be written only costs the next process a probe
+  if (cache_path != NULL)
+    perf_store_event_support(support, cache_path);
+
+  return 0;
+}
+
+int perf_event_support_lookup(const perf_event_support_t *support, int type, uint64_t config) {
+  switch (type) {
+  case PERF_TYPE_HARDWARE:
+    if (config >= PERF_COUNT_HW_MAX)
+      return PERF_ERROR_BAD_PARAMETERS;
+    return support->hardware[config];
+  case PERF_TYPE_SOFTWARE:
+    if (config >= PERF_COUNT_SW_MAX)
+      return PERF_ERROR_BAD_PARAMETERS;
+    return support->software[config];
+  case PERF_TYPE_HW_CACHE: {
+    uint64_t id = config & 0xff;
+    uint64_t op = (config >> 8) & 0xff;
+    uint64_t result = (config >> 16) & 0xff;
+    if (id >= PERF_COUNT_HW_CACHE_MAX || op >= PERF_COUNT_HW_CACHE_OP_MAX || result >= PERF_COUNT_HW_CACHE_RESULT_MAX)
+      return PERF_ERROR_BAD_PARAMETERS;
+    return support->hardware_cache[id][op][result];
+  }
+  default:
+    return PERF_ERROR_BAD_PARAMETERS;
+  }
+}
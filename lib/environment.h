@@ -0,0 +1,76 @@
+#ifndef PERF_ENVIRONMENT_H
+#define PERF_ENVIRONMENT_H
+
+#include <linux/perf_event.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "perf.h"
+
+// The maximum number of PMUs listed in the environment
+#define PERF_MAX_PMUS 64
+
+// A PMU registered under /sys/bus/event_source/devices.
+typedef struct {
+  // The name of the PMU, such as "cpu" or "uprobe"
+  char name[64];
+  // The type to use in perf_event_attr
+  int type;
+} perf_pmu_t;
+
+// A snapshot of everything that determines whether events may be opened. Taken
+// once, so that setting up many events doesn't repeat the same syscalls.
+typedef struct {
+  // Whether or not the process has CAP_SYS_ADMIN and CAP_PERFMON. <0 if an error occured
+  int has_cap_sys_admin;
+  int has_cap_perfmon;
+  // The raw value of /proc/sys/kernel/perf_event_paranoid
+  int paranoia;
+  // The PERF_EVENT_PARANOIA_ flags of the paranoia. <0 if an error occured
+  int event_paranoia;
+  // The kernel version. <0 if it could not be parsed
+  int kernel_major;
+  int kernel_minor;
+  int kernel_patch;
+  // The full kernel release, as reported by uname
+  char kernel_release[65];
+  // The CPU model, as reported by /proc/cpuinfo
+  char cpu_model[128];
+  // The registered PMUs
+  size_t pmus;
+  perf_pmu_t pmu[PERF_MAX_PMUS];
+} perf_environment_t;
+
+// Whether or not each generic event is supported.
+typedef struct {
+  // The kernel release and CPU model the support was probed on
+  char key[256];
+  uint8_t hardware[PERF_COUNT_HW_MAX];
+  uint8_t software[PERF_COUNT_SW_MAX];
+  uint8_t hardware_cache[PERF_COUNT_HW_CACHE_MAX][PERF_COUNT_HW_CACHE_OP_MAX][PERF_COUNT_HW_CACHE_RESULT_MAX];
+} perf_event_support_t;
+
+// Get the environment of the process. The snapshot is taken on the first call and
+// shared by all later calls. Safe to call from multiple threads.
+const perf_environment_t *perf_get_environment();
+
+// Take a new snapshot of the environment, such as after capabilities were dropped.
+// Not safe to call while other threads use the environment.
+void perf_refresh_environment();
+
+// Get the type of a PMU by name.
+// Returns <0 if the PMU does not exist.
+int perf_get_pmu_type(const char *name);
+
+// Probe the support of all generic hardware, software and hardware cache events of the calling thread.
+// Events are probed counting user space only, which is the most permissive setting.
+// If cache_path is not NULL, the result is loaded from the file when it was probed
+// on the same kernel and CPU model. Otherwise the result is probed and written to the file.
+// Returns <0 if an error occured, 1 if the support was loaded from the cache and 0 if it was probed.
+int perf_probe_event_support(perf_event_support_t *support, const char *cache_path);
+
+// Look up whether or not a generic event is supported.
+// Returns 1 if the event is supported, 0 if not and <0 if the event is not part of the catalogue.
+int perf_event_support_lookup(const perf_event_support_t *support, int type, uint64_t config);
+
+#endif
@@ -0,0 +1,242 @@
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "event_set.h"
+#include "group.h"
+#include "perf.h"
+#include "utilities.h"
+
+int perf_get_online_cpus(int *cpus, size_t capacity) {
+  FILE *online = fopen("/sys/devices/system/cpu/online", "r");
+  if (online == NULL)
+    return PERF_ERROR_IO;
+
+  // The list is formatted as comma-separated ranges, such as "0-3,5,7-9"
+  size_t count = 0;
+  int first, last;
+  while (fscanf(online, "%d", &first) == 1) {
+    last = first;
+    int separator = fgetc(online);
+    if (separator == '-') {
+      if (fscanf(online, "%d", &last) != 1)
+        break;
+      separator = fgetc(online);
+    }
+
+    for (int cpu = first; cpu <= last; cpu++) {
+      if (count >= capacity) {
+        fclose(online);
+        return PERF_ERROR_BAD_PARAMETERS;
+      }
+      cpus[count++] = cpu;
+    }
+
+    if (separator != ',')
+      break;
+  }
+
+  fclose(online);
+
+  if (count == 0)
+    return PERF_ERROR_IO;
+
+  return (int)count;
+}
+
+perf_event_set_t *perf_create_event_set(const perf_group_t *prototype, pid_t pid) {
+  int cpu_ids[PERF_MAX_CPUS];
+  int cpus = perf_get_online_cpus(cpu_ids, PERF_MAX_CPUS);
+  if (cpus < 0)
+    return NULL;
+
+  size_t size = prototype->size;
+
+  // The set and its arrays are a single allocation. Groups are allocated separately
+  size_t allocation = sizeof(perf_event_set_t) +
+                      sizeof(perf_group_t *) * cpus +
+                      sizeof(uint64_t) * cpus * size +
+                      sizeof(uint64_t) * size +
+                      sizeof(int) * cpus;
+
+  perf_event_set_t *set = (perf_event_set_t *)malloc(allocation);
+  if (set == NULL)
+    return NULL;
+
+  memset((void *)set, 0, allocation);
+
+  set->cpus = cpus;
+  set->size = size;
+  set->groups = (perf_group_t **)(set + 1);
+  set->values = (uint64_t *)(set->groups + cpus);
+  set->totals = set->values + cpus * size;
+  set->cpu_ids = (int *)(set->totals + size);
+  set->cgroup = -1;
+
+  for (int i = 0; i < cpus; i++) {
+    set->cpu_ids[i] = cpu_ids[i];
+    set->groups[i] = perf_clone_group(prototype, pid, cpu_ids[i]);
+    if (set->groups[i] == NULL) {
+      perf_free_event_set(set);
+      return NULL;
+    }
+  }
+
+  return set;
+}
+
+// Find the mount point of the cgroup v2 hierarchy, such as /sys/fs/cgroup or /sys/fs/cgroup/unified.
+// Returns <0 if an error occured.
+static int perf_get_cgroup_root(char *root, size_t size) {
+  FILE *mounts = fopen("/proc/self/mounts", "r");
+  if (mounts == NULL)
+    return PERF_ERROR_IO;
+
+  char line[4096];
+  while (fgets(line, sizeof(line), mounts) != NULL) {
+    char mount_point[4096];
+    char type[64];
+    if (sscanf(line, "%*s %4095s %63s", mount_point, type) != 2 || strcmp(type, "cgroup2") != 0)
+      continue;
+
+    fclose(mounts);
+    if (strlen(mount_point) >= size)
+      return PERF_ERROR_BAD_PARAMETERS;
+    strcpy(root, mount_point);
+    return 0;
+  }
+
+  fclose(mounts);
+  return PERF_ERROR_NOT_SUPPORTED;
+}
+
+perf_event_set_t *perf_create_cgroup_event_set(const perf_group_t *prototype, const char *path) {
+  char resolved[4096];
+  if (path[0] == '/') {
+    if (strlen(path) >= sizeof(resolved))
+      return NULL;
+    strcpy(resolved, path);
+  } else {
+    char root[4096];
+    if (perf_get_cgroup_root(root, sizeof(root)) < 0)
+      return NULL;
+    if (snprintf(resolved, sizeof(resolved), "%s/%s", root, path) >= (int)sizeof(resolved))
+      return NULL;
+  }
+
+  // The kernel identifies the cgroup by a file descriptor of its directory, passed as the pid
+  int cgroup = open(resolved, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (cgroup < 0)
+    return NULL;
+
+  perf_event_set_t *set = perf_create_event_set(prototype, cgroup);
+  if (set == NULL) {
+    close(cgroup);
+    return NULL;
+  }
+
+  set->cgroup = cgroup;
+  return set;
+}
+
+int perf_open_event_set(perf_event_set_t *set, int flags) {
+  // Privilege only depends on the event and the pid / cpu combination, so the first CPU is representative
+  if (set->cpus > 0) {
+    for (size_t slot = 0; slot < set->size; slot++) {
+      // A cgroup is measured across all of its processes, requiring the privilege of measuring all processes
+      perf_measurement_t measurement = set->groups[0]->members[slot];
+      if (set->cgroup >= 0)
+        measurement.pid = -1;
+
+      int status = perf_has_sufficient_privilege(&measurement);
+      if (status < 0)
+        return status;
+      if (status == 0)
+        return PERF_ERROR_INSUFFICIENT_PRIVILEGE;
+    }
+  }
+
+  if (set->cgroup >= 0)
+    flags |= PERF_FLAG_PID_CGROUP;
+
+  int unsupported = 0;
+  for (size_t i = 0; i < set->cpus; i++) {
+    int status = perf_open_group(set->groups[i], flags);
+    if (status < 0)
+      return status;
+    unsupported += status;
+  }
+
+  return unsupported;
+}
+
+int perf_start_event_set(const perf_event_set_t *set) {
+  // Reset all groups before enabling any, keeping the skew between CPUs small
+  for (size_t i = 0; i < set->cpus; i++) {
+    if (ioctl(set->groups[i]->leader->file_descriptor, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) < 0)
+      return PERF_ERROR_IO;
+  }
+
+  for (size_t i = 0; i < set->cpus; i++) {
+    if (ioctl(set->groups[i]->leader->file_descriptor, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) < 0)
+      return PERF_ERROR_IO;
+  }
+
+  return 0;
+}
+
+int perf_stop_event_set(const perf_event_set_t *set) {
+  for (size_t i = 0; i < set->cpus; i++) {
+    if (ioctl(set->groups[i]->leader->file_descriptor, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP) < 0)
+      return PERF_ERROR_IO;
+  }
+
+  return 0;
+}
+
+int perf_read_event_set(perf_event_set_t *set) {
+  memset((void *)set->totals, 0, sizeof(uint64_t) * set->size);
+
+  for (size_t i = 0; i < set->cpus; i++) {
+    uint64_t *values = set->values + i * set->size;
+
+    int status = perf_read_measurement(set->groups[i]->leader, set->groups[i]->buffer, set->groups[i]->read_size);
+    if (status < 0)
+      return PERF_ERROR_IO;
+
+    status = perf_decode_group(set->groups[i], set->groups[i]->buffer, values);
+    if (status < 0)
+      return status;
+
+    for (size_t slot = 0; slot < set->size; slot++)
+      set->totals[slot] += values[slot];
+  }
+
+  return 0;
+}
+
+int perf_close_event_set(perf_event_set_t *set) {
+  int status = 0;
+  for (size_t i = 0; i < set->cpus; i++) {
+    if (perf_close_group(set->groups[i]) < 0)
+      status = PERF_ERROR_IO;
+  }
+
+  return status;
+}
+
+void perf_free_event_set(perf_event_set_t *set) {
+  if (set == NULL)
+    return;
+
+  for (size_t i = 0; i < set->cpus; i++)
+    free((void *)set->groups[i]);
+
+  if (set->cgroup >= 0)
+    close(set->cgroup);
+  free((void *)set);
+}
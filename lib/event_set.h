@@ -0,0 +1,77 @@
+#ifndef PERF_EVENT_SET_H
+#define PERF_EVENT_SET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "group.h"
+#include "perf.h"
+#include "utilities.h"
+
+// The maximum number of CPUs supported by an event set
+#define PERF_MAX_CPUS 4096
+
+// A group expanded across every online CPU.
+typedef struct {
+  // The number of CPUs measured
+  size_t cpus;
+  // The number of members of each group
+  size_t size;
+  // The id of each measured CPU
+  int *cpu_ids;
+  // The group of each measured CPU, in the order of cpu_ids
+  perf_group_t **groups;
+  // The values of the last read, indexed by cpu * size + slot
+  uint64_t *values;
+  // The values of the last read summed across all CPUs, indexed by slot
+  uint64_t *totals;
+  // The file descriptor of the measured cgroup's directory. -1 unless measuring a cgroup
+  int cgroup;
+} perf_event_set_t;
+
+// Get the ids of all online CPUs, as listed by /sys/devices/system/cpu/online.
+// Returns <0 if an error occured, the number of CPUs otherwise.
+int perf_get_online_cpus(int *cpus, size_t capacity);
+
+// Create an event set measuring the members of prototype on every online CPU.
+// The prototype is not modified and may be freed once the set is created.
+// pid == -1 measures all processes / threads, which requires CAP_PERFMON (since Linux 5.8)
+// or CAP_SYS_ADMIN capability or a event paranoia value of less than 1.
+// The set should be freed using perf_free_event_set.
+// Returns NULL if an error occured.
+perf_event_set_t *perf_create_event_set(const perf_group_t *prototype, pid_t pid);
+
+// Create an event set measuring the members of prototype for all processes of a cgroup v2
+// and its descendants, such as a container, on every online CPU. path is the cgroup's
+// directory, either absolute or relative to the cgroup2 mount, such as "system.slice/docker-<id>.scope".
+// Measuring a cgroup requires the same privilege as measuring all processes.
+// The prototype is not modified and may be freed once the set is created.
+// The set should be freed using perf_free_event_set.
+// Returns NULL if an error occured. Use errno to gather more information.
+perf_event_set_t *perf_create_cgroup_event_set(const perf_group_t *prototype, const char *path);
+
+// Open the groups of all CPUs after ensuring sufficient privilege.
+// An opened event set should be closed using perf_close_event_set.
+// Returns <0 if an error occured, the number of unsupported measurements otherwise.
+int perf_open_event_set(perf_event_set_t *set, int flags);
+
+// Reset and start the groups of all CPUs.
+// Returns <0 if an error occured.
+int perf_start_event_set(const perf_event_set_t *set);
+
+// Stop the groups of all CPUs.
+// Returns <0 if an error occured.
+int perf_stop_event_set(const perf_event_set_t *set);
+
+// Read the groups of all CPUs into set->values and set->totals.
+// Returns <0 if an error occured.
+int perf_read_event_set(perf_event_set_t *set);
+
+// Close the groups of all CPUs.
+// Returns <0 if an error occured.
+int perf_close_event_set(perf_event_set_t *set);
+
+// Free an event set and its groups.
+void perf_free_event_set(perf_event_set_t *set);
+
+#endif
@@ -0,0 +1,712 @@
+#include <ctype.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "environment.h"
+#include "events.h"
+#include "perf.h"
+#include "symbols.h"
+#include "utilities.h"
+
+typedef struct {
+  const char *name;
+  uint64_t config;
+} perf_named_event_t;
+
+static const perf_named_event_t hardware_events[] = {
+    {"cpu-cycles", PERF_COUNT_HW_CPU_CYCLES},
+    {"cycles", PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache-references", PERF_COUNT_HW_CACHE_REFERENCES},
+    {"cache-misses", PERF_COUNT_HW_CACHE_MISSES},
+    {"branch-instructions", PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+    {"branches", PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+    {"branch-misses", PERF_COUNT_HW_BRANCH_MISSES},
+    {"bus-cycles", PERF_COUNT_HW_BUS_CYCLES},
+    {"stalled-cycles-frontend", PERF_COUNT_HW_STALLED_CYCLES_FRONTEND},
+    {"idle-cycles-frontend", PERF_COUNT_HW_STALLED_CYCLES_FRONTEND},
+    {"stalled-cycles-backend", PERF_COUNT_HW_STALLED_CYCLES_BACKEND},
+    {"idle-cycles-backend", PERF_COUNT_HW_STALLED_CYCLES_BACKEND},
+    {"ref-cycles", PERF_COUNT_HW_REF_CPU_CYCLES},
+};
+
+static const perf_named_event_t software_events[] = {
+    {"cpu-clock", PERF_COUNT_SW_CPU_CLOCK},
+    {"task-clock", PERF_COUNT_SW_TASK_CLOCK},
+    {"page-faults", PERF_COUNT_SW_PAGE_FAULTS},
+    {"faults", PERF_COUNT_SW_PAGE_FAULTS},
+    {"context-switches", PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"cs", PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"cpu-migrations", PERF_COUNT_SW_CPU_MIGRATIONS},
+    {"migrations", PERF_COUNT_SW_CPU_MIGRATIONS},
+    {"minor-faults", PERF_COUNT_SW_PAGE_FAULTS_MIN},
+    {"major-faults", PERF_COUNT_SW_PAGE_FAULTS_MAJ},
+    {"alignment-faults", PERF_COUNT_SW_ALIGNMENT_FAULTS},
+    {"emulation-faults", PERF_COUNT_SW_EMULATION_FAULTS},
+    {"dummy", PERF_COUNT_SW_DUMMY},
+    {"bpf-output", PERF_COUNT_SW_BPF_OUTPUT},
+};
+
+// The names of the hardware cache components use the same spelling as perf list
+static const perf_named_event_t cache_names[] = {
+    {"L1-dcache", PERF_COUNT_HW_CACHE_L1D},
+    {"l1-d", PERF_COUNT_HW_CACHE_L1D},
+    {"l1d", PERF_COUNT_HW_CACHE_L1D},
+    {"L1-data", PERF_COUNT_HW_CACHE_L1D},
+    {"L1-icache", PERF_COUNT_HW_CACHE_L1I},
+    {"l1-i", PERF_COUNT_HW_CACHE_L1I},
+    {"l1i", PERF_COUNT_HW_CACHE_L1I},
+    {"L1-instruction", PERF_COUNT_HW_CACHE_L1I},
+    {"LLC", PERF_COUNT_HW_CACHE_LL},
+    {"L2", PERF_COUNT_HW_CACHE_LL},
+    {"dTLB", PERF_COUNT_HW_CACHE_DTLB},
+    {"d-tlb", PERF_COUNT_HW_CACHE_DTLB},
+    {"Data-TLB", PERF_COUNT_HW_CACHE_DTLB},
+    {"iTLB", PERF_COUNT_HW_CACHE_ITLB},
+    {"i-tlb", PERF_COUNT_HW_CACHE_ITLB},
+    {"Instruction-TLB", PERF_COUNT_HW_CACHE_ITLB},
+    {"branch", PERF_COUNT_HW_CACHE_BPU},
+    {"branches", PERF_COUNT_HW_CACHE_BPU},
+    {"bpu", PERF_COUNT_HW_CACHE_BPU},
+    {"btb", PERF_COUNT_HW_CACHE_BPU},
+    {"bpc", PERF_COUNT_HW_CACHE_BPU},
+    {"node", PERF_COUNT_HW_CACHE_NODE},
+};
+
+static const perf_named_event_t cache_operations[] = {
+    {"load", PERF_COUNT_HW_CACHE_OP_READ},
+    {"loads", PERF_COUNT_HW_CACHE_OP_READ},
+    {"read", PERF_COUNT_HW_CACHE_OP_READ},
+    {"store", PERF_COUNT_HW_CACHE_OP_WRITE},
+    {"stores", PERF_COUNT_HW_CACHE_OP_WRITE},
+    {"write", PERF_COUNT_HW_CACHE_OP_WRITE},
+    {"prefetch", PERF_COUNT_HW_CACHE_OP_PREFETCH},
+    {"prefetches", PERF_COUNT_HW_CACHE_OP_PREFETCH},
+    {"speculative-read", PERF_COUNT_HW_CACHE_OP_PREFETCH},
+    {"speculative-load", PERF_COUNT_HW_CACHE_OP_PREFETCH},
+};
+
+static const perf_named_event_t cache_results[] = {
+    {"refs", PERF_COUNT_HW_CACHE_RESULT_ACCESS},
+    {"reference", PERF_COUNT_HW_CACHE_RESULT_ACCESS},
+    {"ops", PERF_COUNT_HW_CACHE_RESULT_ACCESS},
+    {"access", PERF_COUNT_HW_CACHE_RESULT_ACCESS},
+    {"accesses", PERF_COUNT_HW_CACHE_RESULT_ACCESS},
+    {"misses", PERF_COUNT_HW_CACHE_RESULT_MISS},
+    {"miss", PERF_COUNT_HW_CACHE_RESULT_MISS},
+};
+
+#define PERF_COUNT(array) (sizeof(array) / sizeof(array[0]))
+
+// Find a named event whose name matches exactly.
+// Returns NULL if there is no such event.
+static const perf_named_event_t *perf_find_named_event(const perf_named_event_t *events, size_t count, const char *name) {
+  for (size_t i = 0; i < count; i++) {
+    if (strcasecmp(events[i].name, name) == 0)
+      return &events[i];
+  }
+
+  return NULL;
+}
+
+// Find a named event which is a prefix of name, followed by a dash or the end of the name.
+// Returns NULL if there is no such event.
+static const perf_named_event_t *perf_find_named_prefix(const perf_named_event_t *events, size_t count, const char *name, const char **rest) {
+  for (size_t i = 0; i < count; i++) {
+    size_t length = strlen(events[i].name);
+    if (strncasecmp(events[i].name, name, length) == 0 && (name[length] == '-' || name[length] == '\0')) {
+      *rest = name[length] == '-' ? name + length + 1 : name + length;
+      return &events[i];
+    }
+  }
+
+  return NULL;
+}
+
+// Parse a hardware cache event such as "L1-dcache-load-misses", "LLC-loads" or "dTLB-misses".
+// Returns <0 if the name is not a hardware cache event.
+static int perf_parse_cache_event(const char *name, uint64_t *config) {
+  const char *rest = NULL;
+  const perf_named_event_t *cache = perf_find_named_prefix(cache_names, PERF_COUNT(cache_names), name, &rest);
+  if (cache == NULL || *rest == '\0')
+    return PERF_ERROR_NOT_SUPPORTED;
+
+  // The operation defaults to reads and the result to accesses, as in perf
+  uint64_t operation = PERF_COUNT_HW_CACHE_OP_READ;
+  uint64_t result = PERF_COUNT_HW_CACHE_RESULT_ACCESS;
+
+  const char *result_name = rest;
+  const perf_named_event_t *named_operation = perf_find_named_prefix(cache_operations, PERF_COUNT(cache_operations), rest, &result_name);
+  if (named_operation != NULL)
+    operation = named_operation->config;
+
+  if (*result_name != '\0') {
+    const perf_named_event_t *named_result = perf_find_named_event(cache_results, PERF_COUNT(cache_results), result_name);
+    if (named_result == NULL)
+      return PERF_ERROR_NOT_SUPPORTED;
+    result = named_result->config;
+  }
+
+  *config = cache->config | (operation << 8) | (result << 16);
+  return 0;
+}
+
+// Read a file of a PMU, such as format/umask or events/mem-loads, stripping the trailing newline.
+// Returns <0 if an error occured.
+static int perf_read_pmu_file(const char *pmu, const char *directory, const char *name, char *buffer, size_t size) {
+  // Never let a name escape the directory of the PMU
+  if (pmu[0] == '.' || name[0] == '.' || strchr(name, '/') != NULL)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  char path[512];
+  snprintf(path, sizeof(path), "/sys/bus/event_source/devices/%s/%s/%s", pmu, directory, name);
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+    return PERF_ERROR_NOT_SUPPORTED;
+
+  char *line = fgets(buffer, size, file);
+  fclose(file);
+  if (line == NULL)
+    return PERF_ERROR_IO;
+
+  buffer[strcspn(buffer, "\n")] = '\0';
+  return 0;
+}
+
+// Place value into the bits of the attribute described by a sysfs format, such as
+// "config:0-7,32-35". The low bits of the value fill the first range, the next bits the second.
+// Returns <0 if an error occured.
+static int perf_apply_format(perf_event_attr_t *attribute, const char *format, uint64_t value) {
+  __u64 *field = NULL;
+  size_t field_length = strcspn(format, ":");
+  if (format[field_length] != ':')
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  if (field_length == 6 && strncmp(format, "config", 6) == 0)
+    field = &attribute->config;
+  else if (field_length == 7 && strncmp(format, "config1", 7) == 0)
+    field = &attribute->config1;
+  else if (field_length == 7 && strncmp(format, "config2", 7) == 0)
+    field = &attribute->config2;
+  else
+    return PERF_ERROR_NOT_SUPPORTED;
+
+  const char *ranges = format + field_length + 1;
+  while (*ranges != '\0') {
+    char *end = NULL;
+    unsigned long low = strtoul(ranges, &end, 10);
+    unsigned long high = low;
+    if (end == ranges)
+      return PERF_ERROR_BAD_PARAMETERS;
+    if (*end == '-') {
+      ranges = end + 1;
+      high = strtoul(ranges, &end, 10);
+      if (end == ranges)
+        return PERF_ERROR_BAD_PARAMETERS;
+    }
+    if (high < low || high > 63)
+      return PERF_ERROR_BAD_PARAMETERS;
+
+    unsigned long width = high - low + 1;
+    uint64_t mask = width == 64 ? ~0llu : ((1llu << width) - 1);
+    *field = (*field & ~(mask << low)) | ((value & mask) << low);
+    value = width == 64 ? 0 : value >> width;
+
+    if (*end == ',')
+      end++;
+    else if (*end != '\0')
+      return PERF_ERROR_BAD_PARAMETERS;
+    ranges = end;
+  }
+
+  return 0;
+}
+
+static int perf_apply_terms(perf_event_attr_t *attribute, const char *pmu, const char *terms, int depth);
+
+// Apply a single term of a PMU event, such as "umask=0x20", "edge" or "mem-loads".
+// Returns <0 if an error occured.
+static int perf_apply_term(perf_event_attr_t *attribute, const char *pmu, char *term, int depth) {
+  uint64_t value = 1;
+  int has_value = 0;
+  char *separator = strchr(term, '=');
+  if (separator != NULL) {
+    *separator = '\0';
+    char *end = NULL;
+    value = strtoull(separator + 1, &end, 0);
+    if (end == separator + 1 || *end != '\0')
+      return PERF_ERROR_BAD_PARAMETERS;
+    has_value = 1;
+  }
+
+  // The config fields may always be set directly
+  if (strcmp(term, "config") == 0) {
+    attribute->config = value;
+    return 0;
+  } else if (strcmp(term, "config1") == 0) {
+    attribute->config1 = value;
+    return 0;
+  } else if (strcmp(term, "config2") == 0) {
+    attribute->config2 = value;
+    return 0;
+  }
+
+  char buffer[PERF_MAX_EVENT_SPECIFICATION];
+  int status = perf_read_pmu_file(pmu, "format", term, buffer, sizeof(buffer));
+  if (status == 0)
+    return perf_apply_format(attribute, buffer, value);
+  if (status != PERF_ERROR_NOT_SUPPORTED || has_value)
+    return status;
+
+  // A term without a value may be an event alias, which is itself a list of terms.
+  // Aliases never refer to other aliases, the depth only guards against broken PMUs
+  if (depth > 0)
+    return PERF_ERROR_NOT_SUPPORTED;
+  status = perf_read_pmu_file(pmu, "events", term, buffer, sizeof(buffer));
+  if (status < 0)
+    return status;
+
+  return perf_apply_terms(attribute, pmu, buffer, depth + 1);
+}
+
+// Apply a comma separated list of terms of a PMU event.
+// Returns <0 if an error occured.
+static int perf_apply_terms(perf_event_attr_t *attribute, const char *pmu, const char *terms, int depth) {
+  char buffer[PERF_MAX_EVENT_SPECIFICATION];
+  if (strlen(terms) >= sizeof(buffer))
+    return PERF_ERROR_BAD_PARAMETERS;
+  strcpy(buffer, terms);
+
+  char *saveptr = NULL;
+  for (char *term = strtok_r(buffer, ",", &saveptr); term != NULL; term = strtok_r(NULL, ",", &saveptr)) {
+    term += strspn(term, " \t");
+    int status = perf_apply_term(attribute, pmu, term, depth);
+    if (status < 0)
+      return status;
+  }
+
+  return 0;
+}
+
+// Apply modifiers such as "u", "k" or "ppp".
+// Returns <0 if an error occured.
+static int perf_apply_modifiers(perf_event_attr_t *attribute, const char *modifiers) {
+  // Naming a privilege level excludes all levels not named, as in perf
+  int privilege_levels = 0;
+  int virtualization = 0;
+  for (const char *modifier = modifiers; *modifier != '\0'; modifier++) {
+    switch (*modifier) {
+    case 'u':
+    case 'k':
+    case 'h':
+      if (!privilege_levels) {
+        attribute->exclude_user = 1;
+        attribute->exclude_kernel = 1;
+        attribute->exclude_hv = 1;
+        privilege_levels = 1;
+      }
+      if (*modifier == 'u')
+        attribute->exclude_user = 0;
+      else if (*modifier == 'k')
+        attribute->exclude_kernel = 0;
+      else
+        attribute->exclude_hv = 0;
+      break;
+    case 'H':
+    case 'G':
+      if (!virtualization) {
+        attribute->exclude_host = 1;
+        attribute->exclude_guest = 1;
+        virtualization = 1;
+      }
+      if (*modifier == 'H')
+        attribute->exclude_host = 0;
+      else
+        attribute->exclude_guest = 0;
+      break;
+    case 'p':
+      if (attribute->precise_ip >= 3)
+        return PERF_ERROR_BAD_PARAMETERS;
+      attribute->precise_ip++;
+      break;
+    case 'I':
+      attribute->exclude_idle = 1;
+      break;
+    case 'D':
+      attribute->pinned = 1;
+      break;
+    default:
+      return PERF_ERROR_BAD_PARAMETERS;
+    }
+  }
+
+  return 0;
+}
+
+// Parse a raw event such as "r1a8".
+// Returns <0 if the name is not a raw event.
+static int perf_parse_raw_event(const char *name, uint64_t *config) {
+  if (name[0] != 'r' || name[1] == '\0')
+    return PERF_ERROR_NOT_SUPPORTED;
+
+  for (const char *digit = name + 1; *digit != '\0'; digit++) {
+    if (!isxdigit((unsigned char)*digit))
+      return PERF_ERROR_NOT_SUPPORTED;
+  }
+
+  *config = strtoull(name + 1, NULL, 16);
+  return 0;
+}
+
+// Parse an event without a PMU, such as "cycles" or "energy-pkg".
+// Returns <0 if an error occured.
+static int perf_parse_named_event(perf_event_attr_t *attribute, const char *name) {
+  const perf_named_event_t *event = perf_find_named_event(hardware_events, PERF_COUNT(hardware_events), name);
+  if (event != NULL) {
+    attribute->type = PERF_TYPE_HARDWARE;
+    attribute->config = event->config;
+    return 0;
+  }
+
+  event = perf_find_named_event(software_events, PERF_COUNT(software_events), name);
+  if (event != NULL) {
+    attribute->type = PERF_TYPE_SOFTWARE;
+    attribute->config = event->config;
+    return 0;
+  }
+
+  uint64_t config = 0;
+  if (perf_parse_cache_event(name, &config) == 0) {
+    attribute->type = PERF_TYPE_HW_CACHE;
+    attribute->config = config;
+    return 0;
+  }
+
+  if (perf_parse_raw_event(name, &config) == 0) {
+    attribute->type = PERF_TYPE_RAW;
+    attribute->config = config;
+    return 0;
+  }
+
+  // Fall back to the aliases exported by any PMU
+  const perf_environment_t *environment = perf_get_environment();
+  char buffer[PERF_MAX_EVENT_SPECIFICATION];
+  for (size_t i = 0; i < environment->pmus; i++) {
+    const perf_pmu_t *pmu = &environment->pmu[i];
+    if (perf_read_pmu_file(pmu->name, "events", name, buffer, sizeof(buffer)) < 0)
+      continue;
+
+    attribute->type = pmu->type;
+    return perf_apply_terms(attribute, pmu->name, buffer, 1);
+  }
+
+  return PERF_ERROR_NOT_SUPPORTED;
+}
+
+// A tracepoint id resolved through tracefs
+typedef struct {
+  // The name of the tracepoint, such as "sched:sched_switch"
+  char *name;
+  uint64_t id;
+} perf_cached_tracepoint_t;
+
+// The mount points of tracefs, tried in order
+static const char *tracefs_roots[] = {
+    "/sys/kernel/tracing",
+    "/sys/kernel/debug/tracing",
+};
+
+// Resolved tracepoint ids, cached for the lifetime of the process
+static perf_cached_tracepoint_t *tracepoint_cache = NULL;
+static size_t tracepoint_cache_size = 0;
+
+// The binaries of uprobes. The kernel reads the path through a pointer in the
+// attribute, so paths are kept for the lifetime of the process
+static char **uprobe_paths = NULL;
+static size_t uprobe_paths_size = 0;
+
+// Guards both caches, as events may be parsed by several threads at once
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Whether or not a name may be used as a single component of a path.
+static int perf_is_path_component(const char *name) {
+  return name[0] != '\0' && name[0] != '.' && strchr(name, '/') == NULL;
+}
+
+int perf_get_tracepoint_id(const char *subsystem, const char *event, uint64_t *id) {
+  if (!perf_is_path_component(subsystem) || !perf_is_path_component(event))
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  char name[PERF_MAX_EVENT_SPECIFICATION];
+  if (snprintf(name, sizeof(name), "%s:%s", subsystem, event) >= (int)sizeof(name))
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  pthread_mutex_lock(&cache_lock);
+  for (size_t i = 0; i < tracepoint_cache_size; i++) {
+    if (strcmp(tracepoint_cache[i].name, name) == 0) {
+      *id = tracepoint_cache[i].id;
+      pthread_mutex_unlock(&cache_lock);
+      return 0;
+    }
+  }
+  pthread_mutex_unlock(&cache_lock);
+
+  for (size_t i = 0; i < PERF_COUNT(tracefs_roots); i++) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/events/%s/%s/id", tracefs_roots[i], subsystem, event);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+      continue;
+
+    unsigned long long value;
+    int read = fscanf(file, "%llu", &value);
+    fclose(file);
+    if (read != 1)
+      return PERF_ERROR_IO;
+
+    *id = value;
+
+    // Failing to cache only costs another lookup, as does a racing thread caching the id twice
+    pthread_mutex_lock(&cache_lock);
+    perf_cached_tracepoint_t *cache = (perf_cached_tracepoint_t *)realloc(tracepoint_cache, sizeof(perf_cached_tracepoint_t) * (tracepoint_cache_size + 1));
+    if (cache != NULL) {
+      tracepoint_cache = cache;
+      tracepoint_cache[tracepoint_cache_size].name = strdup(name);
+      tracepoint_cache[tracepoint_cache_size].id = value;
+      if (tracepoint_cache[tracepoint_cache_size].name != NULL)
+        tracepoint_cache_size++;
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    return 0;
+  }
+
+  return PERF_ERROR_NOT_SUPPORTED;
+}
+
+int perf_tracepoint_attribute(const char *subsystem, const char *event, perf_event_attr_t *attribute) {
+  uint64_t id;
+  int status = perf_get_tracepoint_id(subsystem, event, &id);
+  if (status < 0)
+    return status;
+
+  memset((void *)attribute, 0, sizeof(perf_event_attr_t));
+  attribute->size = sizeof(perf_event_attr_t);
+  attribute->type = PERF_TYPE_TRACEPOINT;
+  attribute->config = id;
+  return 0;
+}
+
+// Get a copy of a path which lives as long as the process. The cache lock must be held.
+// Returns NULL if an error occured.
+static const char *perf_intern_uprobe_path_locked(const char *path) {
+  for (size_t i = 0; i < uprobe_paths_size; i++) {
+    if (strcmp(uprobe_paths[i], path) == 0)
+      return uprobe_paths[i];
+  }
+
+  char **paths = (char **)realloc(uprobe_paths, sizeof(char *) * (uprobe_paths_size + 1));
+  if (paths == NULL)
+    return NULL;
+  uprobe_paths = paths;
+
+  char *copy = strdup(path);
+  if (copy == NULL)
+    return NULL;
+
+  uprobe_paths[uprobe_paths_size++] = copy;
+  return copy;
+}
+
+static const char *perf_intern_uprobe_path(const char *path) {
+  pthread_mutex_lock(&cache_lock);
+  const char *interned = perf_intern_uprobe_path_locked(path);
+  pthread_mutex_unlock(&cache_lock);
+  return interned;
+}
+
+int perf_uprobe_attribute(const char *path, const char *symbol, int retprobe, perf_event_attr_t *attribute) {
+  int type = perf_get_pmu_type("uprobe");
+  if (type < 0)
+    return PERF_ERROR_NOT_SUPPORTED;
+
+  uint64_t offset;
+  int status = perf_find_symbol_offset(path, symbol, &offset);
+  if (status < 0)
+    return status;
+
+  const char *interned = perf_intern_uprobe_path(path);
+  if (interned == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  memset((void *)attribute, 0, sizeof(perf_event_attr_t));
+  attribute->size = sizeof(perf_event_attr_t);
+  attribute->type = type;
+  // The uprobe PMU takes the path in config1 (uprobe_path) and the offset in config2 (probe_offset)
+  attribute->config1 = (uint64_t)(uintptr_t)interned;
+  attribute->config2 = offset;
+
+  if (retprobe) {
+    char format[PERF_MAX_EVENT_SPECIFICATION];
+    status = perf_read_pmu_file("uprobe", "format", "retprobe", format, sizeof(format));
+    if (status < 0)
+      return status;
+
+    status = perf_apply_format(attribute, format, 1);
+    if (status < 0)
+      return status;
+  }
+
+  return 0;
+}
+
+// Parse a probe such as "uprobe:/usr/bin/app:main" or "uretprobe:/usr/bin/app:main".
+// Returns <0 if an error occured.
+static int perf_parse_uprobe(perf_event_attr_t *attribute, char *probe, int retprobe) {
+  char *symbol = strrchr(probe, ':');
+  if (symbol == NULL || symbol == probe || symbol[1] == '\0')
+    return PERF_ERROR_BAD_PARAMETERS;
+  *symbol++ = '\0';
+
+  return perf_uprobe_attribute(probe, symbol, retprobe, attribute);
+}
+
+int perf_parse_event(const char *specification, perf_event_attr_t *attribute) {
+  char buffer[PERF_MAX_EVENT_SPECIFICATION];
+  if (strlen(specification) >= sizeof(buffer))
+    return PERF_ERROR_BAD_PARAMETERS;
+  strcpy(buffer, specification);
+
+  memset((void *)attribute, 0, sizeof(perf_event_attr_t));
+  attribute->size = sizeof(perf_event_attr_t);
+
+  // The path of a probe contains slashes, but it's not a PMU event. Probes take no modifiers
+  if (strncmp(buffer, "uprobe:", 7) == 0)
+    return perf_parse_uprobe(attribute, buffer + 7, 0);
+  if (strncmp(buffer, "uretprobe:", 10) == 0)
+    return perf_parse_uprobe(attribute, buffer + 10, 1);
+
+  int status = 0;
+  const char *modifiers = "";
+  char *pmu_end = strchr(buffer, '/');
+  if (pmu_end != NULL) {
+    // A PMU event: pmu/terms/modifiers or pmu/terms/:modifiers
+    char *terms = pmu_end + 1;
+    char *terms_end = strchr(terms, '/');
+    if (pmu_end == buffer || terms_end == NULL)
+      return PERF_ERROR_BAD_PARAMETERS;
+    *pmu_end = '\0';
+    *terms_end = '\0';
+
+    modifiers = terms_end[1] == ':' ? terms_end + 2 : terms_end + 1;
+
+    int type = perf_get_pmu_type(buffer);
+    if (type < 0)
+      return type;
+    attribute->type = type;
+
+    status = perf_apply_terms(attribute, buffer, terms, 0);
+  } else {
+    // A named event: name or name:modifiers, or a tracepoint: subsystem:event or subsystem:event:modifiers
+    char *separator = strchr(buffer, ':');
+    if (separator != NULL) {
+      *separator = '\0';
+      modifiers = separator + 1;
+    }
+
+    if (buffer[0] == '\0')
+      return PERF_ERROR_BAD_PARAMETERS;
+
+    char *event_end = separator == NULL ? NULL : strchr(separator + 1, ':');
+    if (event_end != NULL)
+      *event_end = '\0';
+
+    // Named events take precedence, such that "cycles:u" is never a tracepoint
+    status = perf_parse_named_event(attribute, buffer);
+    if (status == PERF_ERROR_NOT_SUPPORTED && separator != NULL && perf_tracepoint_attribute(buffer, separator + 1, attribute) == 0) {
+      modifiers = event_end != NULL ? event_end + 1 : "";
+      status = 0;
+    } else if (event_end != NULL) {
+      // Not a tracepoint, so the colon was part of the modifiers
+      *event_end = ':';
+    }
+  }
+
+  if (status < 0)
+    return status;
+
+  return perf_apply_modifiers(attribute, modifiers);
+}
+
+// Get the length of the next event of a list. Commas within the slashes of a PMU event separate terms, not events.
+static size_t perf_event_length(const char *specification) {
+  // The slashes of a probe's path do not enclose terms
+  int is_probe = strncmp(specification, "uprobe:", 7) == 0 || strncmp(specification, "uretprobe:", 10) == 0;
+  int within_pmu = 0;
+  size_t length = 0;
+  for (; specification[length] != '\0'; length++) {
+    if (specification[length] == '/' && !is_probe)
+      within_pmu = !within_pmu;
+    else if (specification[length] == ',' && !within_pmu)
+      break;
+  }
+
+  return length;
+}
+
+int perf_parse_event_list(const char *specification, perf_event_list_t **list) {
+  *list = NULL;
+
+  size_t count = 0;
+  for (const char *event = specification;; event++) {
+    count++;
+    event += perf_event_length(event);
+    if (*event == '\0')
+      break;
+  }
+
+  // The list, its attributes, names and the text of the names is a single allocation
+  size_t size = sizeof(perf_event_list_t) +
+                sizeof(perf_event_attr_t) * count +
+                sizeof(char *) * count +
+                strlen(specification) + 1;
+
+  perf_event_list_t *events = (perf_event_list_t *)malloc(size);
+  if (events == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  memset((void *)events, 0, size);
+  events->attributes = (perf_event_attr_t *)(events + 1);
+  events->names = (char **)(events->attributes + count);
+  char *names = (char *)(events->names + count);
+
+  const char *event = specification;
+  for (size_t i = 0; i < count; i++) {
+    size_t length = perf_event_length(event);
+    if (length == 0 || length >= PERF_MAX_EVENT_SPECIFICATION) {
+      free((void *)events);
+      return PERF_ERROR_BAD_PARAMETERS;
+    }
+
+    memcpy(names, event, length);
+    names[length] = '\0';
+    events->names[i] = names;
+    names += length + 1;
+
+    int status = perf_parse_event(events->names[i], &events->attributes[i]);
+    if (status < 0) {
+      free((void *)events);
+      return status;
+    }
+
+    events->size++;
+    event += length + 1;
+  }
+
+  *list = events;
+  return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef PERF_EVENTS_H
+#define PERF_EVENTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "perf.h"
+
+// The maximum length of a single event specification
+#define PERF_MAX_EVENT_SPECIFICATION 256
+
+// A list of parsed events.
+typedef struct {
+  // The number of events
+  size_t size;
+  // The specification of each event, used as its name
+  char **names;
+  // The attribute of each event
+  perf_event_attr_t *attributes;
+} perf_event_list_t;
+
+// Parse a single event specification into an attribute. Supports:
+// - named events such as "cycles", "task-clock" or "L1-dcache-load-misses"
+// - raw events such as "r1a8"
+// - PMU events such as "cpu/event=0xd1,umask=0x20/" or "cpu/mem-loads/", whose
+//   terms are resolved through /sys/bus/event_source/devices/<pmu>/format and events
+// - event aliases exported by a PMU, such as "energy-pkg"
+// - modifiers such as "cycles:u", "instructions:k", "cycles:ppp" or "cpu/event=0x3c/u"
+// - tracepoints such as "sched:sched_switch" or "syscalls:sys_enter_write", see perf_tracepoint_attribute
+// - uprobes such as "uprobe:/usr/bin/app:main" or "uretprobe:/usr/bin/app:main", see perf_uprobe_attribute
+// Returns <0 if an error occured. PERF_ERROR_NOT_SUPPORTED if an event or PMU does not exist.
+int perf_parse_event(const char *specification, perf_event_attr_t *attribute);
+
+// Resolve the id of a tracepoint, such as subsystem "sched" and event "sched_switch",
+// through tracefs. Ids are cached for the lifetime of the process.
+// Returns <0 if an error occured. PERF_ERROR_NOT_SUPPORTED if the tracepoint does not exist or tracefs is not mounted.
+int perf_get_tracepoint_id(const char *subsystem, const char *event, uint64_t *id);
+
+// Create an attribute counting hits of a tracepoint.
+// Returns <0 if an error occured. See perf_get_tracepoint_id.
+int perf_tracepoint_attribute(const char *subsystem, const char *event, perf_event_attr_t *attribute);
+
+// Create an attribute counting calls of a function symbol of an ELF binary, or
+// returns from it if retprobe is set, using the dynamic uprobe PMU. The path is
+// kept for the lifetime of the process, as the kernel reads it when the event is opened.
+// Returns <0 if an error occured. PERF_ERROR_NOT_SUPPORTED if uprobes or the symbol are not available.
+int perf_uprobe_attribute(const char *path, const char *symbol, int retprobe, perf_event_attr_t *attribute);
+
+// Parse a comma separated list of event specifications, such as
+// "cycles:u,instructions:k,cpu/event=0xd1,umask=0x20/". Should be freed.
+// Returns <0 if an error occured, in which case list is set to NULL.
+int perf_parse_event_list(const char *specification, perf_event_list_t **list);
+
+#endif
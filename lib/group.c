@@ -0,0 +1,280 @@
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "group.h"
+#include "perf.h"
+#include "utilities.h"
+
+// Returns the size of a group read in 64-bit words for the given read format.
+static size_t perf_group_read_words(uint64_t read_format, size_t measurements) {
+  size_t words = 1;
+  if (read_format & PERF_FORMAT_TOTAL_TIME_ENABLED)
+    words++;
+  if (read_format & PERF_FORMAT_TOTAL_TIME_RUNNING)
+    words++;
+
+  size_t per_value = 1;
+  if (read_format & PERF_FORMAT_ID)
+    per_value++;
+  if (read_format & PERF_FORMAT_LOST)
+    per_value++;
+
+  return words + measurements * per_value;
+}
+
+perf_group_t *perf_create_group(size_t capacity, pid_t pid, int cpu) {
+  // Keep the id map at most half full, so that probing stays short
+  uint64_t id_map_size = 1;
+  while (id_map_size < 2 * (capacity + 1))
+    id_map_size <<= 1;
+
+  // Enough room for any read format, with a value, an id and a lost count per measurement
+  size_t buffer_words = 3 + 3 * (capacity + 1);
+
+  // The group and all of its storage is a single allocation
+  size_t size = sizeof(perf_group_t) +
+                sizeof(perf_measurement_t) * (capacity + 1) +
+                sizeof(const char *) * capacity +
+                sizeof(perf_group_id_t) * id_map_size +
+                sizeof(uint64_t) * buffer_words +
+                sizeof(uint64_t) * capacity;
+
+  perf_group_t *group = (perf_group_t *)malloc(size);
+  if (group == NULL)
+    return NULL;
+
+  memset((void *)group, 0, size);
+
+  group->capacity = capacity;
+  group->leader = (perf_measurement_t *)(group + 1);
+  group->members = group->leader + 1;
+  group->names = (const char **)(group->members + capacity);
+  group->id_map = (perf_group_id_t *)(group->names + capacity);
+  group->id_map_mask = id_map_size - 1;
+  group->buffer = (uint64_t *)(group->id_map + id_map_size);
+  group->values = group->buffer + buffer_words;
+
+  // Use a dummy measurement (measures nothing) as the leader, so that any member may be unsupported
+  perf_measurement_t *leader = group->leader;
+  leader->pid = pid;
+  leader->cpu = cpu;
+  leader->group = -1;
+  leader->file_descriptor = -1;
+  leader->attribute.size = sizeof(perf_event_attr_t);
+  leader->attribute.type = PERF_TYPE_SOFTWARE;
+  leader->attribute.config = PERF_COUNT_SW_DUMMY;
+  leader->attribute.disabled = 1;
+  // Request the enabled and running times, so that multiplexing can be detected and scaled
+  leader->attribute.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  group->read_size = sizeof(uint64_t) * perf_group_read_words(leader->attribute.read_format, 1);
+
+  return group;
+}
+
+int perf_group_add_measurement(perf_group_t *group, const char *name, int type, uint64_t config) {
+  if (group->size >= group->capacity)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  size_t slot = group->size++;
+  perf_measurement_t *measurement = &group->members[slot];
+
+  measurement->pid = group->leader->pid;
+  measurement->cpu = group->leader->cpu;
+  measurement->file_descriptor = -1;
+  measurement->attribute.size = sizeof(perf_event_attr_t);
+  measurement->attribute.type = type;
+  measurement->attribute.config = config;
+  measurement->attribute.disabled = 1;
+  measurement->attribute.read_format = group->leader->attribute.read_format;
+
+  group->names[slot] = name;
+  group->read_size = sizeof(uint64_t) * perf_group_read_words(group->leader->attribute.read_format, group->size + 1);
+
+  return (int)slot;
+}
+
+int perf_group_add_attribute(perf_group_t *group, const char *name, const perf_event_attr_t *attribute) {
+  int slot = perf_group_add_measurement(group, name, attribute->type, attribute->config);
+  if (slot < 0)
+    return slot;
+
+  perf_measurement_t *measurement = &group->members[slot];
+  measurement->attribute = *attribute;
+  measurement->attribute.size = sizeof(perf_event_attr_t);
+  measurement->attribute.disabled = 1;
+  measurement->attribute.read_format = group->leader->attribute.read_format;
+
+  return slot;
+}
+
+perf_group_t *perf_clone_group(const perf_group_t *group, pid_t pid, int cpu) {
+  perf_group_t *clone = perf_create_group(group->capacity, pid, cpu);
+  if (clone == NULL)
+    return NULL;
+
+  clone->leader->attribute = group->leader->attribute;
+
+  for (size_t slot = 0; slot < group->size; slot++)
+    perf_group_add_attribute(clone, group->names[slot], &group->members[slot].attribute);
+
+  return clone;
+}
+
+// Insert the id of an opened member into the id map.
+static void perf_group_map_id(perf_group_t *group, uint64_t id, size_t slot) {
+  uint64_t index = (id * 11400714819323198485llu) >> 32;
+  for (;; index++) {
+    perf_group_id_t *entry = &group->id_map[index & group->id_map_mask];
+    if (entry->id == 0 || entry->id == id) {
+      entry->id = id;
+      entry->slot = slot;
+      return;
+    }
+  }
+}
+
+int perf_open_group(perf_group_t *group, int flags) {
+  // Decoding requires the id of each value
+  uint64_t read_format = group->leader->attribute.read_format;
+  if (!(read_format & PERF_FORMAT_GROUP) || !(read_format & PERF_FORMAT_ID))
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  int status = perf_open_measurement(group->leader, -1, flags);
+  if (status < 0)
+    return status;
+
+  int unsupported = 0;
+  for (size_t slot = 0; slot < group->size; slot++) {
+    perf_measurement_t *measurement = &group->members[slot];
+    // The kernel formats group reads according to the leader
+    measurement->attribute.read_format = read_format;
+
+    status = perf_open_measurement(measurement, group->leader->file_descriptor, flags);
+    if (status == PERF_ERROR_NOT_SUPPORTED) {
+      measurement->file_descriptor = -1;
+      unsupported++;
+      continue;
+    } else if (status < 0) {
+      return status;
+    }
+
+    perf_group_map_id(group, measurement->id, slot);
+  }
+
+  group->read_size = sizeof(uint64_t) * perf_group_read_words(read_format, group->size + 1);
+
+  return unsupported;
+}
+
+int perf_read_group(perf_group_t *group) {
+  ssize_t bytes = read(group->leader->file_descriptor, group->buffer, group->read_size);
+  if (bytes < 0)
+    return PERF_ERROR_IO;
+
+  int status = perf_decode_group_times(group, group->buffer, &group->time_enabled, &group->time_running);
+  if (status < 0)
+    return status;
+
+  return perf_decode_group(group, group->buffer, group->values);
+}
+
+int perf_decode_group(const perf_group_t *group, const void *buffer, uint64_t *values) {
+  uint64_t read_format = group->leader->attribute.read_format;
+  const uint64_t *words = (const uint64_t *)buffer;
+
+  // { nr, [time_enabled], [time_running], { value, id, [lost] } * nr }
+  uint64_t count = *words++;
+  if (count > group->size + 1)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  if (read_format & PERF_FORMAT_TOTAL_TIME_ENABLED)
+    words++;
+  if (read_format & PERF_FORMAT_TOTAL_TIME_RUNNING)
+    words++;
+
+  // Unsupported members are not part of the read
+  memset((void *)values, 0, sizeof(uint64_t) * group->size);
+
+  uint64_t per_value = 2 + !!(read_format & PERF_FORMAT_LOST);
+  for (uint64_t i = 0; i < count; i++) {
+    uint64_t value = words[0];
+    uint64_t id = words[1];
+    words += per_value;
+
+    // The leader is not part of the id map
+    int slot = perf_group_slot(group, id);
+    if (slot >= 0)
+      values[slot] = value;
+  }
+
+  return 0;
+}
+
+int perf_decode_group_times(const perf_group_t *group, const void *buffer, uint64_t *time_enabled, uint64_t *time_running) {
+  uint64_t read_format = group->leader->attribute.read_format;
+  const uint64_t *words = (const uint64_t *)buffer + 1;
+
+  // Without the times, the group is assumed to be running whenever enabled
+  uint64_t enabled = 0;
+  uint64_t running = 0;
+  if (read_format & PERF_FORMAT_TOTAL_TIME_ENABLED)
+    enabled = *words++;
+  if (read_format & PERF_FORMAT_TOTAL_TIME_RUNNING)
+    running = *words++;
+  else
+    running = enabled;
+
+  if (time_enabled != NULL)
+    *time_enabled = enabled;
+  if (time_running != NULL)
+    *time_running = running;
+
+  return 0;
+}
+
+double perf_group_running_ratio(const perf_group_t *group) {
+  if (group->time_enabled == 0)
+    return 1.0;
+
+  return (double)group->time_running / (double)group->time_enabled;
+}
+
+uint64_t perf_scale_value(uint64_t value, uint64_t time_enabled, uint64_t time_running) {
+  // A group that never ran has nothing to scale, one that always ran needs no scaling
+  if (time_running == 0 || time_running >= time_enabled)
+    return value;
+
+  // value * enabled / running, without overflowing the intermediate product
+  return (uint64_t)((double)value * (double)time_enabled / (double)time_running);
+}
+
+void perf_scale_group(const perf_group_t *group, const uint64_t *values, uint64_t *scaled) {
+  for (size_t slot = 0; slot < group->size; slot++)
+    scaled[slot] = perf_scale_value(values[slot], group->time_enabled, group->time_running);
+}
+
+int perf_close_group(perf_group_t *group) {
+  int status = 0;
+
+  for (size_t slot = 0; slot < group->size; slot++) {
+    if (group->members[slot].file_descriptor < 0)
+      continue;
+    if (perf_close_measurement(&group->members[slot]) < 0)
+      status = PERF_ERROR_IO;
+    group->members[slot].file_descriptor = -1;
+  }
+
+  if (group->leader->file_descriptor >= 0) {
+    if (perf_close_measurement(group->leader) < 0)
+      status = PERF_ERROR_IO;
+    group->leader->file_descriptor = -1;
+  }
+
+  // Allow the group to be reopened
+  memset((void *)group->id_map, 0, sizeof(perf_group_id_t) * (group->id_map_mask + 1));
+
+  return status;
+}
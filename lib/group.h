@@ -0,0 +1,123 @@
+#ifndef PERF_GROUP_H
+#define PERF_GROUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "perf.h"
+#include "utilities.h"
+
+// An entry of a group's id map.
+typedef struct {
+  // The id of the measurement. 0 marks an empty entry
+  uint64_t id;
+  // The slot of the measurement
+  uint64_t slot;
+} perf_group_id_t;
+
+// A group of measurements, scheduled onto the CPU together and read at once.
+// The group owns a dummy software leader and its members, stored in a single allocation.
+typedef struct {
+  // The number of added members, excluding the leader
+  size_t size;
+  // The maximum number of members
+  size_t capacity;
+  // The size of a single read of the group in bytes
+  size_t read_size;
+  // The leader of the group. Measures nothing
+  perf_measurement_t *leader;
+  // The members of the group, indexed by slot. A member which could not be opened
+  // due to lacking support has a file descriptor of -1
+  perf_measurement_t *members;
+  // The name of each member, indexed by slot. Not owned by the group
+  const char **names;
+  // The number of entries of the id map minus one. The number of entries is a power of two
+  uint64_t id_map_mask;
+  // Maps the id of a member to its slot. Open addressing with linear probing
+  perf_group_id_t *id_map;
+  // The buffer used by perf_read_group
+  uint64_t *buffer;
+  // The values of the last call to perf_read_group, indexed by slot
+  uint64_t *values;
+  // The time the group was enabled and actually running on the PMU as of the last
+  // call to perf_read_group, in nanoseconds. Differs when the kernel multiplexes counters
+  uint64_t time_enabled;
+  uint64_t time_running;
+} perf_group_t;
+
+// Create a group able to hold capacity members. Should be freed.
+// See perf_create_measurement for pid and cpu.
+// Returns NULL if an error occured.
+perf_group_t *perf_create_group(size_t capacity, pid_t pid, int cpu);
+
+// Add a measurement to a group. Must be called before the group is opened.
+// The attribute of the added member may be modified through group->members[slot].
+// Returns <0 if an error occured, the slot of the measurement otherwise.
+int perf_group_add_measurement(perf_group_t *group, const char *name, int type, uint64_t config);
+
+// Add a measurement described by a complete attribute to a group. Must be called before the group is opened.
+// The attribute is copied. The measurement is always created disabled.
+// Returns <0 if an error occured, the slot of the measurement otherwise.
+int perf_group_add_attribute(perf_group_t *group, const char *name, const perf_event_attr_t *attribute);
+
+// Create a new, unopened group with the same members as an existing group. Should be freed.
+// The attributes and names of the members are copied. See perf_create_measurement for pid and cpu.
+// Returns NULL if an error occured.
+perf_group_t *perf_clone_group(const perf_group_t *group, pid_t pid, int cpu);
+
+// Open the group and all of its members.
+// Members not supported by the system are left unopened and will read as zero.
+// An opened group should be closed using perf_close_group.
+// Returns <0 if an error occured, the number of unsupported members otherwise.
+int perf_open_group(perf_group_t *group, int flags);
+
+// Start measuring all members of the group. Resets the counters and starts them.
+#define perf_start_group(group) perf_start_measurement((group)->leader)
+
+// Stop measuring all members of the group.
+#define perf_stop_group(group) perf_stop_measurement((group)->leader)
+
+// Read all members of the group into group->values.
+// Returns <0 if an error occured.
+int perf_read_group(perf_group_t *group);
+
+// Decode a raw read of group->read_size bytes into values, indexed by slot.
+// values must hold group->size values.
+// Returns <0 if an error occured.
+int perf_decode_group(const perf_group_t *group, const void *buffer, uint64_t *values);
+
+// Decode the time enabled and running of a raw read of group->read_size bytes. Use NULL to ignore a value.
+// Returns <0 if an error occured.
+int perf_decode_group_times(const perf_group_t *group, const void *buffer, uint64_t *time_enabled, uint64_t *time_running);
+
+// Returns the share of the enabled time the group was actually counting, between 0 and 1.
+// A ratio below 1 means the group was multiplexed and its values are partial.
+double perf_group_running_ratio(const perf_group_t *group);
+
+// Scale a value counted for time_running out of time_enabled nanoseconds to the full enabled time.
+uint64_t perf_scale_value(uint64_t value, uint64_t time_enabled, uint64_t time_running);
+
+// Scale values read while the group was multiplexed, estimating what would have
+// been counted had the group been running the entire time it was enabled.
+// values and scaled may be the same array.
+void perf_scale_group(const perf_group_t *group, const uint64_t *values, uint64_t *scaled);
+
+// Get the slot of a member by its id.
+// Returns <0 if the id is not part of the group.
+static inline int perf_group_slot(const perf_group_t *group, uint64_t id) {
+  // Fibonacci hashing spreads the sequential ids handed out by the kernel
+  uint64_t index = (id * 11400714819323198485llu) >> 32;
+  for (;; index++) {
+    const perf_group_id_t *entry = &group->id_map[index & group->id_map_mask];
+    if (entry->id == id)
+      return (int)entry->slot;
+    if (entry->id == 0)
+      return -1;
+  }
+}
+
+// Close the group and all of its members.
+// Returns <0 if an error occured.
+int perf_close_group(perf_group_t *group);
+
+#endif
@@ -0,0 +1,293 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "heatmap.h"
+#include "symbols.h"
+#include "utilities.h"
+
+// The initial number of pages. Always a power of two
+#define PERF_HEATMAP_INITIAL_PAGES 1024
+
+// The characters of a heat row, from cold to hot
+#define PERF_HEATMAP_SCALE " .:-=+*#%@"
+#define PERF_HEATMAP_LEVELS (sizeof(PERF_HEATMAP_SCALE) - 2)
+
+perf_heatmap_t *perf_create_heatmap() {
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (page_size < 0)
+    return NULL;
+
+  perf_heatmap_t *heatmap = (perf_heatmap_t *)malloc(sizeof(perf_heatmap_t));
+  if (heatmap == NULL)
+    return NULL;
+
+  memset((void *)heatmap, 0, sizeof(perf_heatmap_t));
+  heatmap->page_size = page_size;
+  heatmap->pages = (perf_heatmap_page_t *)calloc(PERF_HEATMAP_INITIAL_PAGES, sizeof(perf_heatmap_page_t));
+  heatmap->mask = PERF_HEATMAP_INITIAL_PAGES - 1;
+  if (heatmap->pages == NULL) {
+    free((void *)heatmap);
+    return NULL;
+  }
+
+  return heatmap;
+}
+
+static uint64_t perf_hash_page(const perf_heatmap_t *heatmap, uint64_t page) {
+  return ((page / heatmap->page_size) * 11400714819323198485llu) >> 32;
+}
+
+// Grow the pages to twice their size.
+// Returns <0 if an error occured.
+static int perf_grow_heatmap(perf_heatmap_t *heatmap) {
+  size_t capacity = 2 * (heatmap->mask + 1);
+  perf_heatmap_page_t *pages = (perf_heatmap_page_t *)calloc(capacity, sizeof(perf_heatmap_page_t));
+  if (pages == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  for (size_t i = 0; i <= heatmap->mask; i++) {
+    const perf_heatmap_page_t *page = &heatmap->pages[i];
+    if (page->page == 0)
+      continue;
+
+    uint64_t index = perf_hash_page(heatmap, page->page);
+    while (pages[index & (capacity - 1)].page != 0)
+      index++;
+    pages[index & (capacity - 1)] = *page;
+  }
+
+  free((void *)heatmap->pages);
+  heatmap->pages = pages;
+  heatmap->mask = capacity - 1;
+  return 0;
+}
+
+int perf_heatmap_add(perf_heatmap_t *heatmap, uint64_t address, uint64_t ip) {
+  uint64_t page = address & ~(heatmap->page_size - 1);
+  if (page == 0)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  // Keep the pages at most half full, so that probing stays short
+  if (2 * (heatmap->size + 1) > heatmap->mask + 1 && perf_grow_heatmap(heatmap) < 0)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  uint64_t index = perf_hash_page(heatmap, page);
+  for (;; index++) {
+    perf_heatmap_page_t *entry = &heatmap->pages[index & heatmap->mask];
+    if (entry->page == 0) {
+      entry->page = page;
+      entry->samples = 1;
+      entry->first_ip = ip;
+      heatmap->size++;
+      break;
+    }
+
+    if (entry->page == page) {
+      entry->samples++;
+      break;
+    }
+  }
+
+  heatmap->samples++;
+  return 0;
+}
+
+void perf_reset_heatmap(perf_heatmap_t *heatmap) {
+  memset((void *)heatmap->pages, 0, sizeof(perf_heatmap_page_t) * (heatmap->mask + 1));
+  heatmap->size = 0;
+  heatmap->samples = 0;
+}
+
+static int perf_compare_pages(const void *a, const void *b) {
+  uint64_t first = ((const perf_heatmap_page_t *)a)->page;
+  uint64_t second = ((const perf_heatmap_page_t *)b)->page;
+  return first < second ? -1 : first > second;
+}
+
+// Copy the pages, sorted by address. Should be freed.
+// Returns NULL if an error occured.
+static perf_heatmap_page_t *perf_sort_heatmap(const perf_heatmap_t *heatmap) {
+  perf_heatmap_page_t *sorted = (perf_heatmap_page_t *)malloc(sizeof(perf_heatmap_page_t) * (heatmap->size + 1));
+  if (sorted == NULL)
+    return NULL;
+
+  size_t count = 0;
+  for (size_t i = 0; i <= heatmap->mask; i++) {
+    if (heatmap->pages[i].page != 0)
+      sorted[count++] = heatmap->pages[i];
+  }
+
+  qsort(sorted, count, sizeof(perf_heatmap_page_t), perf_compare_pages);
+  return sorted;
+}
+
+// Print the heat row of the sampled pages of a mapping.
+static void perf_print_heat_row(const perf_heatmap_t *heatmap, const perf_heatmap_page_t *pages, size_t count, uint64_t start, uint64_t end, uint64_t *columns, size_t width, FILE *output) {
+  uint64_t mapping_pages = (end - start) / heatmap->page_size;
+  size_t used = mapping_pages < width ? (size_t)mapping_pages : width;
+  memset((void *)columns, 0, sizeof(uint64_t) * used);
+
+  uint64_t hottest = 0;
+  for (size_t i = 0; i < count; i++) {
+    size_t column = (size_t)((pages[i].page - start) / heatmap->page_size * used / mapping_pages);
+    columns[column] += pages[i].samples;
+    if (columns[column] > hottest)
+      hottest = columns[column];
+  }
+
+  // Scale each column relative to the hottest column of the mapping, so that any sample is visible
+  fprintf(output, "%33s|", "");
+  for (size_t i = 0; i < used; i++)
+    fputc(PERF_HEATMAP_SCALE[(columns[i] * PERF_HEATMAP_LEVELS + hottest - 1) / hottest], output);
+  fprintf(output, "|\n");
+}
+
+int perf_print_heatmap(const perf_heatmap_t *heatmap, pid_t pid, size_t width, FILE *output) {
+  if (width == 0)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  char path[64];
+  if (pid == 0)
+    strcpy(path, "/proc/self/maps");
+  else
+    snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+
+  perf_heatmap_page_t *sorted = perf_sort_heatmap(heatmap);
+  uint64_t *columns = (uint64_t *)malloc(sizeof(uint64_t) * width);
+  if (sorted == NULL || columns == NULL) {
+    free((void *)sorted);
+    free((void *)columns);
+    return PERF_ERROR_LIBRARY_FAILURE;
+  }
+
+  FILE *maps = fopen(path, "r");
+  if (maps == NULL) {
+    free((void *)sorted);
+    free((void *)columns);
+    return PERF_ERROR_IO;
+  }
+
+  fprintf(output, "samples: %" PRIu64 " over %zu pages of %" PRIu64 " bytes\n", heatmap->samples, heatmap->size, heatmap->page_size);
+  fprintf(output, "        samples  touched    pages  mapping\n");
+
+  // Both the maps file and the pages are sorted by address, so walk them side by side
+  size_t next = 0;
+  size_t unmapped_pages = 0;
+  uint64_t unmapped_samples = 0;
+  char line[4096 + 128];
+  while (fgets(line, sizeof(line), maps) != NULL && next < heatmap->size) {
+    unsigned long start, end;
+    int path_offset = 0;
+    if (sscanf(line, "%lx-%lx %*s %*s %*s %*s %n", &start, &end, &path_offset) < 2)
+      continue;
+
+    for (; next < heatmap->size && sorted[next].page < start; next++) {
+      unmapped_pages++;
+      unmapped_samples += sorted[next].samples;
+    }
+
+    size_t first = next;
+    uint64_t samples = 0;
+    for (; next < heatmap->size && sorted[next].page < end; next++)
+      samples += sorted[next].samples;
+    if (next == first)
+      continue;
+
+    char *name = line + path_offset;
+    name[strcspn(name, "\n")] = '\0';
+    if (name[0] == '\0')
+      name = "[anonymous]";
+
+    fprintf(output, "%15" PRIu64 "%9zu%9lu  %s (0x%lx-0x%lx)\n", samples, next - first, (end - start) / heatmap->page_size, name, start, end);
+    perf_print_heat_row(heatmap, &sorted[first], next - first, start, end, columns, width, output);
+  }
+  fclose(maps);
+
+  for (; next < heatmap->size; next++) {
+    unmapped_pages++;
+    unmapped_samples += sorted[next].samples;
+  }
+  if (unmapped_pages > 0)
+    fprintf(output, "%15" PRIu64 "%9zu%9s  [unmapped]\n", unmapped_samples, unmapped_pages, "-");
+
+  free((void *)sorted);
+  free((void *)columns);
+  return ferror(output) ? PERF_ERROR_IO : 0;
+}
+
+// The pages first touched by a function.
+typedef struct {
+  // The address of the function, or of its mapping if unresolved. 0 if the mapping is unknown
+  uint64_t address;
+  const char *name;
+  const char *module;
+  uint64_t pages;
+} perf_first_touch_t;
+
+static int perf_compare_touch_addresses(const void *a, const void *b) {
+  const perf_first_touch_t *first = (const perf_first_touch_t *)a;
+  const perf_first_touch_t *second = (const perf_first_touch_t *)b;
+  if (first->address != second->address)
+    return first->address < second->address ? -1 : 1;
+  return strcmp(first->module, second->module);
+}
+
+static int perf_compare_touch_pages(const void *a, const void *b) {
+  const perf_first_touch_t *first = (const perf_first_touch_t *)a;
+  const perf_first_touch_t *second = (const perf_first_touch_t *)b;
+  if (first->pages != second->pages)
+    return first->pages > second->pages ? -1 : 1;
+  return strcmp(first->name, second->name);
+}
+
+int perf_print_first_touches(const perf_heatmap_t *heatmap, const perf_symbol_table_t *symbols, size_t top, FILE *output) {
+  perf_first_touch_t *touches = (perf_first_touch_t *)malloc(sizeof(perf_first_touch_t) * (heatmap->size + 1));
+  if (touches == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  size_t count = 0;
+  for (size_t i = 0; i <= heatmap->mask; i++) {
+    const perf_heatmap_page_t *page = &heatmap->pages[i];
+    if (page->page == 0)
+      continue;
+
+    const perf_mapping_t *mapping = NULL;
+    const perf_symbol_t *symbol = perf_resolve_symbol(symbols, page->first_ip, &mapping);
+    perf_first_touch_t *touch = &touches[count++];
+    touch->address = symbol != NULL ? symbol->start : mapping != NULL ? mapping->start : 0;
+    touch->name = symbol != NULL ? symbol->name : "[unknown]";
+    touch->module = mapping != NULL ? mapping->path : "[unknown]";
+    touch->pages = 1;
+  }
+
+  // Merge the pages of each function
+  qsort(touches, count, sizeof(perf_first_touch_t), perf_compare_touch_addresses);
+  size_t merged = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (merged > 0 && perf_compare_touch_addresses(&touches[merged - 1], &touches[i]) == 0)
+      touches[merged - 1].pages++;
+    else
+      touches[merged++] = touches[i];
+  }
+
+  qsort(touches, merged, sizeof(perf_first_touch_t), perf_compare_touch_pages);
+  if (top == 0 || top > merged)
+    top = merged;
+
+  fprintf(output, "first touches of %zu pages\n", heatmap->size);
+  fprintf(output, "          pages  percent  function\n");
+  for (size_t i = 0; i < top; i++) {
+    double percent = heatmap->size > 0 ? 100.0 * (double)touches[i].pages / (double)heatmap->size : 0;
+    fprintf(output, "%15" PRIu64 "%8.2f%%  %s (%s)\n", touches[i].pages, percent, touches[i].name, touches[i].module);
+  }
+
+  free((void *)touches);
+  return ferror(output) ? PERF_ERROR_IO : 0;
+}
+
+void perf_free_heatmap(perf_heatmap_t *heatmap) {
+  free((void *)heatmap->pages);
+  free((void *)heatmap);
+}
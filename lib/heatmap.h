@@ -0,0 +1,57 @@
+#ifndef PERF_HEATMAP_H
+#define PERF_HEATMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "symbols.h"
+
+// The sampled addresses within a single page.
+typedef struct {
+  // The address of the page. 0 marks an empty entry, the zero page is never mapped
+  uint64_t page;
+  // The number of samples
+  uint64_t samples;
+  // The instruction pointer of the first sample, such as the code touching the page first
+  uint64_t first_ip;
+} perf_heatmap_page_t;
+
+// A map of sampled data addresses, such as faulting addresses, counted per page.
+typedef struct {
+  uint64_t page_size;
+  // The pages. Open addressing with linear probing, keyed by page address
+  size_t size;
+  size_t mask;
+  perf_heatmap_page_t *pages;
+  // The total number of samples
+  uint64_t samples;
+} perf_heatmap_t;
+
+// Create an empty heatmap. Should be freed using perf_free_heatmap.
+// Returns NULL if an error occured.
+perf_heatmap_t *perf_create_heatmap();
+
+// Count a sampled address and the instruction pointer accessing it.
+// Returns <0 if an error occured.
+int perf_heatmap_add(perf_heatmap_t *heatmap, uint64_t address, uint64_t ip);
+
+// Clear all pages.
+void perf_reset_heatmap(perf_heatmap_t *heatmap);
+
+// Print the samples of each mapping of a process and a row of width characters
+// showing how they spread over the mapping, denser characters marking hotter parts.
+// Use pid 0 for the calling process. The mappings are read when printing, so
+// samples of since unmapped memory are summarized as [unmapped].
+// Returns <0 if an error occured.
+int perf_print_heatmap(const perf_heatmap_t *heatmap, pid_t pid, size_t width, FILE *output);
+
+// Print the top functions first touching pages, sorted by the number of pages. A top of 0 prints all functions.
+// Returns <0 if an error occured.
+int perf_print_first_touches(const perf_heatmap_t *heatmap, const perf_symbol_table_t *symbols, size_t top, FILE *output);
+
+// Free the heatmap.
+void perf_free_heatmap(perf_heatmap_t *heatmap);
+
+#endif
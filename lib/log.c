@@ -0,0 +1,260 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "group.h"
+#include "log.h"
+#include "statistics.h"
+#include "utilities.h"
+
+static uint64_t perf_log_time(clockid_t clock) {
+  struct timespec time;
+  clock_gettime(clock, &time);
+  return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+}
+
+// Write an entire buffer, retrying on partial writes.
+// Returns <0 if an error occured.
+static int perf_log_write_all(int file_descriptor, const void *buffer, size_t bytes) {
+  const uint8_t *offset = (const uint8_t *)buffer;
+  while (bytes > 0) {
+    ssize_t written = write(file_descriptor, offset, bytes);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return PERF_ERROR_IO;
+    }
+    offset += written;
+    bytes -= (size_t)written;
+  }
+
+  return 0;
+}
+
+perf_log_writer_t *perf_create_log(const char *path, const perf_group_t *group, uint32_t flags) {
+  size_t record_size = sizeof(perf_log_record_t) + sizeof(uint64_t) * group->size;
+
+  // Describe each event, each name padded to keep the records aligned
+  size_t header_size = sizeof(perf_log_header_t);
+  for (size_t i = 0; i < group->size; i++) {
+    const char *name = group->names[i] == NULL ? "" : group->names[i];
+    header_size += sizeof(perf_log_event_t) + ((strlen(name) + 1 + 7) & ~(size_t)7);
+  }
+
+  uint8_t *header = (uint8_t *)calloc(1, header_size);
+  if (header == NULL)
+    return NULL;
+
+  perf_log_header_t *log_header = (perf_log_header_t *)header;
+  memcpy((void *)log_header->magic, PERF_LOG_MAGIC, sizeof(PERF_LOG_MAGIC));
+  log_header->version = PERF_LOG_VERSION;
+  log_header->flags = flags;
+  log_header->events = (uint32_t)group->size;
+  log_header->record_size = (uint32_t)record_size;
+  log_header->header_size = header_size;
+  log_header->start_time = perf_log_time(CLOCK_REALTIME);
+
+  uint8_t *offset = header + sizeof(perf_log_header_t);
+  for (size_t i = 0; i < group->size; i++) {
+    const char *name = group->names[i] == NULL ? "" : group->names[i];
+    perf_log_event_t *event = (perf_log_event_t *)offset;
+    event->type = group->members[i].attribute.type;
+    event->config = group->members[i].attribute.config;
+    event->id = group->members[i].id;
+    event->name_size = (uint32_t)((strlen(name) + 1 + 7) & ~(size_t)7);
+    memcpy((void *)(event + 1), (const void *)name, strlen(name));
+    offset += sizeof(perf_log_event_t) + event->name_size;
+  }
+
+  // The writer, the previous values and the buffer are stored in a single allocation
+  size_t allocation = sizeof(perf_log_writer_t) + sizeof(uint64_t) * group->size + PERF_LOG_BUFFER_SIZE + record_size;
+  perf_log_writer_t *writer = (perf_log_writer_t *)malloc(allocation);
+  if (writer == NULL) {
+    free((void *)header);
+    return NULL;
+  }
+
+  memset((void *)writer, 0, sizeof(perf_log_writer_t) + sizeof(uint64_t) * group->size);
+  writer->flags = flags;
+  writer->size = group->size;
+  writer->record_size = record_size;
+  writer->previous = (uint64_t *)(writer + 1);
+  writer->buffer = (uint8_t *)(writer->previous + group->size);
+
+  writer->file_descriptor = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (writer->file_descriptor < 0) {
+    free((void *)header);
+    free((void *)writer);
+    return NULL;
+  }
+
+  if (perf_log_write_all(writer->file_descriptor, header, header_size) < 0) {
+    close(writer->file_descriptor);
+    free((void *)header);
+    free((void *)writer);
+    return NULL;
+  }
+
+  free((void *)header);
+  writer->start = perf_log_time(CLOCK_MONOTONIC);
+  return writer;
+}
+
+int perf_log_write(perf_log_writer_t *writer, const uint64_t *values, uint64_t time_enabled, uint64_t time_running) {
+  perf_log_record_t *record = (perf_log_record_t *)(writer->buffer + writer->buffered);
+  record->timestamp = perf_log_time(CLOCK_MONOTONIC) - writer->start;
+
+  if (writer->flags & PERF_LOG_CUMULATIVE) {
+    record->time_enabled = time_enabled - writer->previous_time_enabled;
+    record->time_running = time_running - writer->previous_time_running;
+    writer->previous_time_enabled = time_enabled;
+    writer->previous_time_running = time_running;
+    for (size_t i = 0; i < writer->size; i++) {
+      record->values[i] = values[i] - writer->previous[i];
+      writer->previous[i] = values[i];
+    }
+  } else {
+    record->time_enabled = time_enabled;
+    record->time_running = time_running;
+    memcpy((void *)record->values, (const void *)values, sizeof(uint64_t) * writer->size);
+  }
+
+  writer->buffered += writer->record_size;
+  // The buffer holds at least one record beyond PERF_LOG_BUFFER_SIZE
+  if (writer->buffered >= PERF_LOG_BUFFER_SIZE)
+    return perf_flush_log(writer);
+
+  return 0;
+}
+
+int perf_flush_log(perf_log_writer_t *writer) {
+  if (writer->buffered == 0)
+    return 0;
+
+  int status = perf_log_write_all(writer->file_descriptor, writer->buffer, writer->buffered);
+  writer->buffered = 0;
+  return status;
+}
+
+int perf_close_log(perf_log_writer_t *writer) {
+  int status = perf_flush_log(writer);
+  if (close(writer->file_descriptor) < 0 && status == 0)
+    status = PERF_ERROR_IO;
+
+  free((void *)writer);
+  return status;
+}
+
+// Map the file and point the reader into it.
+// Returns <0 if an error occured or if the file is not a valid log.
+static int perf_map_log(perf_log_reader_t *reader, size_t events) {
+  struct stat status;
+  if (fstat(reader->file_descriptor, &status) < 0)
+    return PERF_ERROR_IO;
+
+  size_t size = (size_t)status.st_size;
+  if (size < sizeof(perf_log_header_t))
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, reader->file_descriptor, 0);
+  if (mapping == MAP_FAILED)
+    return PERF_ERROR_IO;
+
+  const perf_log_header_t *header = (const perf_log_header_t *)mapping;
+  if (memcmp(header->magic, PERF_LOG_MAGIC, sizeof(PERF_LOG_MAGIC)) != 0 ||
+      header->version != PERF_LOG_VERSION ||
+      header->events != events ||
+      header->record_size != sizeof(perf_log_record_t) + sizeof(uint64_t) * events ||
+      header->header_size > size) {
+    munmap(mapping, size);
+    return PERF_ERROR_BAD_PARAMETERS;
+  }
+
+  // Validate each description, ensuring names are terminated within the header
+  const uint8_t *offset = (const uint8_t *)mapping + sizeof(perf_log_header_t);
+  const uint8_t *end = (const uint8_t *)mapping + header->header_size;
+  for (size_t i = 0; i < events; i++) {
+    const perf_log_event_t *event = (const perf_log_event_t *)offset;
+    if (offset + sizeof(perf_log_event_t) > end ||
+        event->name_size == 0 ||
+        offset + sizeof(perf_log_event_t) + event->name_size > end ||
+        ((const char *)(event + 1))[event->name_size - 1] != '\0') {
+      munmap(mapping, size);
+      return PERF_ERROR_BAD_PARAMETERS;
+    }
+
+    offset += sizeof(perf_log_event_t) + event->name_size;
+  }
+
+  if (reader->mapping != NULL)
+    munmap(reader->mapping, reader->mapping_size);
+
+  offset = (const uint8_t *)mapping + sizeof(perf_log_header_t);
+  for (size_t i = 0; i < events; i++) {
+    const perf_log_event_t *event = (const perf_log_event_t *)offset;
+    reader->events[i] = event;
+    reader->names[i] = (const char *)(event + 1);
+    offset += sizeof(perf_log_event_t) + event->name_size;
+  }
+
+  reader->mapping = mapping;
+  reader->mapping_size = size;
+  reader->header = header;
+  // A trailing, partially written record is ignored
+  reader->size = (size - header->header_size) / header->record_size;
+  return 0;
+}
+
+perf_log_reader_t *perf_open_log(const char *path) {
+  int file_descriptor = open(path, O_RDONLY | O_CLOEXEC);
+  if (file_descriptor < 0)
+    return NULL;
+
+  // The number of events is needed to size the reader
+  perf_log_header_t header;
+  if (read(file_descriptor, &header, sizeof(header)) != sizeof(header) || memcmp(header.magic, PERF_LOG_MAGIC, sizeof(PERF_LOG_MAGIC)) != 0) {
+    close(file_descriptor);
+    return NULL;
+  }
+
+  // The reader and the event and name arrays are stored in a single allocation
+  size_t allocation = sizeof(perf_log_reader_t) + (sizeof(perf_log_event_t *) + sizeof(char *)) * header.events;
+  perf_log_reader_t *reader = (perf_log_reader_t *)malloc(allocation);
+  if (reader == NULL) {
+    close(file_descriptor);
+    return NULL;
+  }
+
+  memset((void *)reader, 0, sizeof(perf_log_reader_t));
+  reader->file_descriptor = file_descriptor;
+  reader->events = (const perf_log_event_t **)(reader + 1);
+  reader->names = (const char **)(reader->events + header.events);
+
+  if (perf_map_log(reader, header.events) < 0) {
+    close(file_descriptor);
+    free((void *)reader);
+    return NULL;
+  }
+
+  return reader;
+}
+
+int perf_refresh_log(perf_log_reader_t *reader) {
+  return perf_map_log(reader, reader->header->events);
+}
+
+void perf_aggregate_log(const perf_log_reader_t *reader, perf_statistics_t *statistics) {
+  for (size_t i = 0; i < reader->size; i++)
+    perf_statistics_add(statistics, perf_log_record(reader, i)->values);
+}
+
+void perf_close_log_reader(perf_log_reader_t *reader) {
+  munmap(reader->mapping, reader->mapping_size);
+  close(reader->file_descriptor);
+  free((void *)reader);
+}
@@ -0,0 +1,142 @@
+#ifndef PERF_LOG_H
+#define PERF_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "group.h"
+#include "statistics.h"
+
+// An append-only binary log of group reads. A log is a header, describing each
+// event, followed by fixed-size records. Each record holds the counts of a single
+// interval, so a log may be aggregated without decoding anything but the records
+// themselves. A record cut short by a crash is ignored by the reader.
+// All fields use the byte order of the writing machine.
+
+#define PERF_LOG_MAGIC "PERFLOG"
+#define PERF_LOG_VERSION 1
+
+// The values passed to the writer are cumulative counters, such as those of a group
+// started once and read periodically. Records hold the difference between consecutive reads.
+// Without the flag the values are already the counts of an interval, such as those
+// of a group started and stopped around each region
+#define PERF_LOG_CUMULATIVE (1 << 0)
+
+// The size of the writer's buffer in bytes
+#define PERF_LOG_BUFFER_SIZE (64 * 1024)
+
+// The header of a log file.
+typedef struct {
+  // PERF_LOG_MAGIC, including the terminating null byte
+  char magic[8];
+  // PERF_LOG_VERSION
+  uint32_t version;
+  // PERF_LOG_ flags
+  uint32_t flags;
+  // The number of events
+  uint32_t events;
+  // The size of each record in bytes
+  uint32_t record_size;
+  // The size of the header, including event descriptions, in bytes. Records start at this offset
+  uint64_t header_size;
+  // The wall-clock time the log was created, in nanoseconds since the epoch
+  uint64_t start_time;
+} perf_log_header_t;
+
+// The description of an event, following the header. Followed by the null
+// terminated name of the event, padded to a multiple of 8 bytes.
+typedef struct {
+  // The type and config of the event's attribute
+  uint32_t type;
+  // The size of the padded name in bytes
+  uint32_t name_size;
+  uint64_t config;
+  // The id of the measurement as assigned by the kernel
+  uint64_t id;
+} perf_log_event_t;
+
+// A record of a log.
+typedef struct {
+  // The time of the read in nanoseconds since the log was created
+  uint64_t timestamp;
+  // The time enabled and running during the interval in nanoseconds
+  uint64_t time_enabled;
+  uint64_t time_running;
+  // The counts of the interval, indexed by slot
+  uint64_t values[];
+} perf_log_record_t;
+
+// A buffered writer of a log.
+typedef struct {
+  int file_descriptor;
+  uint32_t flags;
+  // The number of events
+  size_t size;
+  size_t record_size;
+  // The monotonic time the log was created in nanoseconds
+  uint64_t start;
+  // The previous cumulative values, used with PERF_LOG_CUMULATIVE
+  uint64_t *previous;
+  uint64_t previous_time_enabled;
+  uint64_t previous_time_running;
+  // Records not yet written to the file
+  size_t buffered;
+  uint8_t *buffer;
+} perf_log_writer_t;
+
+// A reader of a log, mapping the file into memory.
+typedef struct {
+  int file_descriptor;
+  // The mapped file
+  void *mapping;
+  size_t mapping_size;
+  // The header of the log. Points into the mapping
+  const perf_log_header_t *header;
+  // The description and name of each event, indexed by slot. Point into the mapping
+  const perf_log_event_t **events;
+  const char **names;
+  // The number of complete records
+  size_t size;
+} perf_log_reader_t;
+
+// Create a log, truncating any existing file, for the members of a group. flags are PERF_LOG_ flags.
+// Should be closed using perf_close_log.
+// Returns NULL if an error occured.
+perf_log_writer_t *perf_create_log(const char *path, const perf_group_t *group, uint32_t flags);
+
+// Append a record of values, indexed by slot, read at the current time.
+// Returns <0 if an error occured.
+int perf_log_write(perf_log_writer_t *writer, const uint64_t *values, uint64_t time_enabled, uint64_t time_running);
+
+// Append a record of the last read of a group.
+#define perf_log_append_group(writer, group) perf_log_write((writer), (group)->values, (group)->time_enabled, (group)->time_running)
+
+// Write all buffered records to the file.
+// Returns <0 if an error occured.
+int perf_flush_log(perf_log_writer_t *writer);
+
+// Flush and close a log and free the writer.
+// Returns <0 if an error occured.
+int perf_close_log(perf_log_writer_t *writer);
+
+// Open and map a log for reading. Should be closed using perf_close_log_reader.
+// Returns NULL if an error occured or if the file is not a valid log.
+perf_log_reader_t *perf_open_log(const char *path);
+
+// Map records appended since the log was opened or last refreshed, such as by a writer still running.
+// Pointers to records are invalidated.
+// Returns <0 if an error occured.
+int perf_refresh_log(perf_log_reader_t *reader);
+
+// Get a record of a log. index must be less than reader->size.
+static inline const perf_log_record_t *perf_log_record(const perf_log_reader_t *reader, size_t index) {
+  return (const perf_log_record_t *)((const uint8_t *)reader->mapping + reader->header->header_size + index * reader->header->record_size);
+}
+
+// Add the values of all records to statistics of reader->header->events events.
+void perf_aggregate_log(const perf_log_reader_t *reader, perf_statistics_t *statistics);
+
+// Unmap and close a log and free the reader.
+void perf_close_log_reader(perf_log_reader_t *reader);
+
+#endif
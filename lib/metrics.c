@@ -0,0 +1,313 @@
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#include "events.h"
+#include "group.h"
+#include "metrics.h"
+#include "multiplex.h"
+#include "utilities.h"
+
+const perf_metric_definition_t perf_default_metrics[PERF_DEFAULT_METRICS] = {
+    {"IPC", "instructions:u", "cycles:u", 1, "insn/cycle"},
+    {"branch miss rate", "branch-misses:u", "branches:u", 100, "%"},
+    {"L1D miss rate", "L1-dcache-load-misses:u", "L1-dcache-loads:u", 100, "%"},
+    {"LLC miss rate", "LLC-load-misses:u", "LLC-loads:u", 100, "%"},
+    {"frontend stalls", "stalled-cycles-frontend:u", "cycles:u", 100, "%"},
+    {"backend stalls", "stalled-cycles-backend:u", "cycles:u", 100, "%"},
+};
+
+// Find the slot of an event in a group, or add it.
+// Returns <0 if an error occured, the slot of the event otherwise.
+static int perf_metrics_add_event(perf_group_t *group, const char *specification, perf_event_attr_t *attribute) {
+  // Members are stored disabled and with the read format of the group, so compare them as such
+  attribute->read_format = group->leader->attribute.read_format;
+  for (size_t slot = 0; slot < group->size; slot++) {
+    if (memcmp((void *)&group->members[slot].attribute, (void *)attribute, sizeof(perf_event_attr_t)) == 0)
+      return (int)slot;
+  }
+
+  return perf_group_add_attribute(group, specification, attribute);
+}
+
+// Returns whether or not an event is one of the events of the metrics first up to, but excluding, event.
+static int perf_metrics_is_duplicate(const perf_event_attr_t *attributes, size_t first, size_t event) {
+  for (size_t i = 2 * first; i < event; i++) {
+    if (memcmp((const void *)&attributes[i], (const void *)&attributes[event], sizeof(perf_event_attr_t)) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+int perf_create_metrics(const perf_metric_definition_t *definitions, size_t count, int budget, pid_t pid, int cpu, perf_metrics_t **metrics) {
+  *metrics = NULL;
+
+  if (budget <= 0)
+    budget = perf_get_counter_budget();
+  if (budget <= 0)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  // The numerator and denominator of metric i, normalized so that equal events compare equal
+  perf_event_attr_t *attributes = (perf_event_attr_t *)malloc(sizeof(perf_event_attr_t) * (2 * count + 1));
+  if (attributes == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  for (size_t i = 0; i < count; i++) {
+    int status = perf_parse_event(definitions[i].numerator, &attributes[2 * i]);
+    if (status >= 0)
+      status = perf_parse_event(definitions[i].denominator, &attributes[2 * i + 1]);
+    if (status < 0) {
+      free((void *)attributes);
+      return status;
+    }
+    attributes[2 * i].disabled = 1;
+    attributes[2 * i + 1].disabled = 1;
+  }
+
+  // Pack the metrics into groups in order, starting a new group once the hardware
+  // events a metric adds to the current group would exceed the budget
+  int *group_of = (int *)malloc(sizeof(int) * (count + 1));
+  if (group_of == NULL) {
+    free((void *)attributes);
+    return PERF_ERROR_LIBRARY_FAILURE;
+  }
+
+  size_t groups_count = 0;
+  size_t first = 0;
+  int used = 0;
+  for (size_t i = 0; i < count; i++) {
+    int needed = 0;
+    int fresh = 0;
+    for (size_t event = 2 * i; event < 2 * i + 2; event++) {
+      if (!perf_event_uses_counter(&attributes[event]))
+        continue;
+      if (!perf_metrics_is_duplicate(attributes, first, event))
+        needed++;
+      if (!perf_metrics_is_duplicate(attributes, i, event))
+        fresh++;
+    }
+
+    if (i == 0 || used + needed > budget) {
+      // The events of a single metric must be scheduled together
+      if (fresh > budget) {
+        free((void *)attributes);
+        free((void *)group_of);
+        return PERF_ERROR_BAD_PARAMETERS;
+      }
+      groups_count++;
+      first = i;
+      used = fresh;
+    } else {
+      used += needed;
+    }
+    group_of[i] = (int)groups_count - 1;
+  }
+
+  // The metrics and all of their storage is a single allocation
+  size_t size = sizeof(perf_metrics_t) +
+                sizeof(perf_group_t *) * groups_count +
+                sizeof(double) * count +
+                sizeof(perf_metric_statistic_t) * count +
+                sizeof(uint64_t) * count * 2 +
+                sizeof(int) * count * 3;
+
+  perf_metrics_t *created = (perf_metrics_t *)malloc(size);
+  if (created == NULL) {
+    free((void *)attributes);
+    free((void *)group_of);
+    return PERF_ERROR_LIBRARY_FAILURE;
+  }
+
+  memset((void *)created, 0, size);
+
+  created->size = count;
+  created->definitions = definitions;
+  created->groups_count = groups_count;
+  created->groups = (perf_group_t **)(created + 1);
+  created->values = (double *)(created->groups + groups_count);
+  created->statistics = (perf_metric_statistic_t *)(created->values + count);
+  created->numerator_totals = (uint64_t *)(created->statistics + count);
+  created->denominator_totals = created->numerator_totals + count;
+  created->group_of = (int *)(created->denominator_totals + count);
+  created->numerators = created->group_of + count;
+  created->denominators = created->numerators + count;
+  memcpy((void *)created->group_of, (const void *)group_of, sizeof(int) * count);
+  free((void *)group_of);
+
+  int status = 0;
+  for (size_t i = 0; i < count && status >= 0; i++) {
+    int group = created->group_of[i];
+    if (created->groups[group] == NULL) {
+      // Room for the events of every metric of the group
+      size_t capacity = 0;
+      for (size_t j = i; j < count && created->group_of[j] == group; j++)
+        capacity += 2;
+      created->groups[group] = perf_create_group(capacity, pid, cpu);
+      if (created->groups[group] == NULL) {
+        status = PERF_ERROR_LIBRARY_FAILURE;
+        break;
+      }
+    }
+
+    created->numerators[i] = perf_metrics_add_event(created->groups[group], definitions[i].numerator, &attributes[2 * i]);
+    created->denominators[i] = perf_metrics_add_event(created->groups[group], definitions[i].denominator, &attributes[2 * i + 1]);
+    if (created->numerators[i] < 0)
+      status = created->numerators[i];
+    else if (created->denominators[i] < 0)
+      status = created->denominators[i];
+  }
+  free((void *)attributes);
+
+  if (status < 0) {
+    perf_free_metrics(created);
+    return status;
+  }
+
+  perf_reset_metrics(created);
+  *metrics = created;
+  return 0;
+}
+
+int perf_open_metrics(perf_metrics_t *metrics, int flags) {
+  int unsupported = 0;
+  for (size_t i = 0; i < metrics->groups_count; i++) {
+    int status = perf_open_group(metrics->groups[i], flags);
+    if (status < 0)
+      return status;
+    unsupported += status;
+  }
+
+  return unsupported;
+}
+
+int perf_start_metrics(const perf_metrics_t *metrics) {
+  for (size_t i = 0; i < metrics->groups_count; i++) {
+    if (ioctl(metrics->groups[i]->leader->file_descriptor, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) < 0)
+      return PERF_ERROR_IO;
+  }
+
+  // All groups are enabled at once, the kernel rotates them onto the PMU
+  for (size_t i = 0; i < metrics->groups_count; i++) {
+    if (ioctl(metrics->groups[i]->leader->file_descriptor, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) < 0)
+      return PERF_ERROR_IO;
+  }
+
+  return 0;
+}
+
+int perf_stop_metrics(const perf_metrics_t *metrics) {
+  for (size_t i = 0; i < metrics->groups_count; i++) {
+    if (ioctl(metrics->groups[i]->leader->file_descriptor, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP) < 0)
+      return PERF_ERROR_IO;
+  }
+
+  return 0;
+}
+
+static void perf_metric_statistic_add(perf_metric_statistic_t *statistic, double value) {
+  if (statistic->count == 0 || value < statistic->min)
+    statistic->min = value;
+  if (statistic->count == 0 || value > statistic->max)
+    statistic->max = value;
+
+  statistic->count++;
+  double delta = value - statistic->mean;
+  statistic->mean += delta / (double)statistic->count;
+  statistic->m2 += delta * (value - statistic->mean);
+}
+
+int perf_read_metrics(perf_metrics_t *metrics) {
+  for (size_t i = 0; i < metrics->groups_count; i++) {
+    int status = perf_read_group(metrics->groups[i]);
+    if (status < 0)
+      return status;
+  }
+
+  for (size_t i = 0; i < metrics->size; i++) {
+    // Both events are members of the same group, so they ran for the same time and
+    // the ratio of the raw values needs no scaling
+    const uint64_t *values = metrics->groups[metrics->group_of[i]]->values;
+    uint64_t numerator = values[metrics->numerators[i]];
+    uint64_t denominator = values[metrics->denominators[i]];
+
+    metrics->numerator_totals[i] += numerator;
+    metrics->denominator_totals[i] += denominator;
+
+    // Unsupported members read as zero, which also yields NaN
+    if (denominator == 0) {
+      metrics->values[i] = NAN;
+      continue;
+    }
+
+    metrics->values[i] = metrics->definitions[i].scale * (double)numerator / (double)denominator;
+    perf_metric_statistic_add(&metrics->statistics[i], metrics->values[i]);
+  }
+
+  return 0;
+}
+
+double perf_metric_aggregate(const perf_metrics_t *metrics, size_t index) {
+  if (metrics->denominator_totals[index] == 0)
+    return NAN;
+
+  return metrics->definitions[index].scale * (double)metrics->numerator_totals[index] / (double)metrics->denominator_totals[index];
+}
+
+double perf_metric_stddev(const perf_metric_statistic_t *statistic) {
+  if (statistic->count < 2)
+    return 0;
+
+  return sqrt(statistic->m2 / (double)(statistic->count - 1));
+}
+
+void perf_reset_metrics(perf_metrics_t *metrics) {
+  memset((void *)metrics->statistics, 0, sizeof(perf_metric_statistic_t) * metrics->size);
+  memset((void *)metrics->numerator_totals, 0, sizeof(uint64_t) * metrics->size);
+  memset((void *)metrics->denominator_totals, 0, sizeof(uint64_t) * metrics->size);
+  for (size_t i = 0; i < metrics->size; i++)
+    metrics->values[i] = NAN;
+}
+
+void perf_print_metrics(const perf_metrics_t *metrics, FILE *output) {
+  fprintf(output, "           metric      aggregate          count            min           mean         stddev            max  unit\n");
+  for (size_t i = 0; i < metrics->size; i++) {
+    const perf_metric_statistic_t *statistic = &metrics->statistics[i];
+    if (statistic->count == 0) {
+      fprintf(output, "%17s%15s%15d%15s%15s%15s%15s  %s\n", metrics->definitions[i].name, "n/a", 0, "-", "-", "-", "-", metrics->definitions[i].unit);
+      continue;
+    }
+
+    fprintf(output, "%17s%15.3f%15" PRIu64 "%15.3f%15.3f%15.3f%15.3f  %s\n",
+            metrics->definitions[i].name,
+            perf_metric_aggregate(metrics, i),
+            statistic->count,
+            statistic->min,
+            statistic->mean,
+            perf_metric_stddev(statistic),
+            statistic->max,
+            metrics->definitions[i].unit);
+  }
+}
+
+int perf_close_metrics(perf_metrics_t *metrics) {
+  int status = 0;
+  for (size_t i = 0; i < metrics->groups_count; i++) {
+    if (perf_close_group(metrics->groups[i]) < 0)
+      status = PERF_ERROR_IO;
+  }
+
+  return status;
+}
+
+void perf_free_metrics(perf_metrics_t *metrics) {
+  if (metrics == NULL)
+    return;
+
+  for (size_t i = 0; i < metrics->groups_count; i++)
+    free((void *)metrics->groups[i]);
+
+  free((void *)metrics);
+}
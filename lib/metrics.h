@@ -0,0 +1,110 @@
+#ifndef PERF_METRICS_H
+#define PERF_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "group.h"
+
+// A metric derived from two events, computed as scale * numerator / denominator.
+typedef struct {
+  // The name of the metric
+  const char *name;
+  // The specifications of the events, see perf_parse_event
+  const char *numerator;
+  const char *denominator;
+  // The factor applied to the ratio, such as 100 for percentages
+  double scale;
+  // The unit of the scaled ratio
+  const char *unit;
+} perf_metric_definition_t;
+
+// The number of default metrics
+#define PERF_DEFAULT_METRICS 6
+
+// IPC, branch miss rate, L1D and LLC load miss rates and the share of frontend and
+// backend stalled cycles, all counting user space.
+extern const perf_metric_definition_t perf_default_metrics[PERF_DEFAULT_METRICS];
+
+// Streaming statistics of the per iteration values of a metric.
+typedef struct {
+  // The number of iterations where the metric could be computed
+  uint64_t count;
+  double min;
+  double max;
+  // The running mean and sum of squared differences from the mean (Welford's algorithm)
+  double mean;
+  double m2;
+} perf_metric_statistic_t;
+
+// Metrics measured by groups of their own.
+typedef struct {
+  // The number of metrics
+  size_t size;
+  // The definition of each metric. Not owned by the metrics
+  const perf_metric_definition_t *definitions;
+  // The groups measuring the events of the metrics. Owned by the metrics
+  size_t groups_count;
+  perf_group_t **groups;
+  // The group of each metric, and the slot of its numerator and denominator within that group
+  int *group_of;
+  int *numerators;
+  int *denominators;
+  // The value of each metric as of the last call to perf_read_metrics. NaN if it
+  // could not be computed, such as when an event is unsupported or the denominator is zero
+  double *values;
+  // The per iteration distribution of each metric
+  perf_metric_statistic_t *statistics;
+  // The sum of the numerators and denominators of all iterations, used for the aggregate value
+  uint64_t *numerator_totals;
+  uint64_t *denominator_totals;
+} perf_metrics_t;
+
+// Create metrics and the groups measuring their events. Only the numerator and
+// denominator of a metric need to be scheduled together for their ratio to be
+// consistent, so the pairs are packed into groups of at most budget hardware events,
+// which the kernel multiplexes when enabled together. Events shared by several metrics
+// of a group are only added once. Use a budget of 0 to detect it using perf_get_counter_budget.
+// See perf_create_measurement for pid and cpu. Should be freed using perf_free_metrics.
+// Returns <0 if an error occured, in which case metrics is set to NULL.
+// PERF_ERROR_BAD_PARAMETERS if the events of a single metric do not fit the budget.
+int perf_create_metrics(const perf_metric_definition_t *definitions, size_t count, int budget, pid_t pid, int cpu, perf_metrics_t **metrics);
+
+// Open the groups of the metrics.
+// Returns <0 if an error occured, the number of unsupported events otherwise.
+int perf_open_metrics(perf_metrics_t *metrics, int flags);
+
+// Reset and start the groups of the metrics.
+// Returns <0 if an error occured.
+int perf_start_metrics(const perf_metrics_t *metrics);
+
+// Stop the groups of the metrics.
+// Returns <0 if an error occured.
+int perf_stop_metrics(const perf_metrics_t *metrics);
+
+// Read the groups of the metrics and compute the metrics of a single iteration.
+// Returns <0 if an error occured.
+int perf_read_metrics(perf_metrics_t *metrics);
+
+// Returns the metric computed over the sum of all iterations. NaN if it could not be computed.
+double perf_metric_aggregate(const perf_metrics_t *metrics, size_t index);
+
+// Returns the sample standard deviation of the per iteration values of a metric.
+double perf_metric_stddev(const perf_metric_statistic_t *statistic);
+
+// Reset the statistics and totals of all metrics.
+void perf_reset_metrics(perf_metrics_t *metrics);
+
+// Print a summary table of the metrics.
+void perf_print_metrics(const perf_metrics_t *metrics, FILE *output);
+
+// Close the groups of the metrics.
+// Returns <0 if an error occured.
+int perf_close_metrics(perf_metrics_t *metrics);
+
+// Free the metrics and their groups.
+void perf_free_metrics(perf_metrics_t *metrics);
+
+#endif
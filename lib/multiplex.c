@@ -0,0 +1,208 @@
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "group.h"
+#include "multiplex.h"
+#include "perf.h"
+#include "utilities.h"
+
+// The number of counters assumed when they cannot be detected. Most PMUs have at least four
+#define PERF_DEFAULT_COUNTER_BUDGET 4
+
+// Returns whether or not the NMI watchdog is enabled. It permanently occupies a counter.
+static int perf_nmi_watchdog_enabled() {
+  FILE *nmi_watchdog = fopen("/proc/sys/kernel/nmi_watchdog", "r");
+  if (nmi_watchdog == NULL)
+    return 0;
+
+  int value = 0;
+  if (fscanf(nmi_watchdog, "%d", &value) < 1)
+    value = 0;
+
+  fclose(nmi_watchdog);
+  return value != 0;
+}
+
+int perf_get_counter_budget() {
+  int budget = PERF_DEFAULT_COUNTER_BUDGET;
+
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax, ebx, ecx, edx;
+  unsigned int vendor[3];
+  if (__get_cpuid(0, &eax, &vendor[0], &vendor[2], &vendor[1])) {
+    unsigned int max_leaf = eax;
+    if (memcmp(vendor, "GenuineIntel", 12) == 0 && max_leaf >= 0xa) {
+      // The architectural performance monitoring leaf. EAX[15:8] holds the number of
+      // general-purpose counters per logical processor
+      __cpuid(0xa, eax, ebx, ecx, edx);
+      if (((eax >> 8) & 0xff) > 0)
+        budget = (eax >> 8) & 0xff;
+    } else if (memcmp(vendor, "AuthenticAMD", 12) == 0 || memcmp(vendor, "HygonGenuine", 12) == 0) {
+      // The core performance counter extensions (PerfCtrExtCore) provide six counters
+      if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 23)))
+        budget = 6;
+    }
+  }
+#endif
+
+  if (budget > 1 && perf_nmi_watchdog_enabled())
+    budget--;
+
+  return budget;
+}
+
+int perf_event_uses_counter(const perf_event_attr_t *attribute) {
+  switch (attribute->type) {
+  case PERF_TYPE_SOFTWARE:
+  case PERF_TYPE_TRACEPOINT:
+  case PERF_TYPE_BREAKPOINT:
+    return 0;
+  default:
+    // Hardware, cache, raw and dynamic PMU events
+    return 1;
+  }
+}
+
+perf_multiplex_t *perf_create_multiplex(const perf_event_attr_t *attributes, const char **names, size_t count, int budget, pid_t pid, int cpu) {
+  if (budget <= 0)
+    budget = perf_get_counter_budget();
+  if (budget <= 0)
+    return NULL;
+
+  size_t hardware_events = 0;
+  for (size_t i = 0; i < count; i++)
+    hardware_events += perf_event_uses_counter(&attributes[i]);
+  size_t software_events = count - hardware_events;
+
+  size_t hardware_groups = (hardware_events + budget - 1) / budget;
+  size_t groups_count = hardware_groups + (software_events > 0 ? 1 : 0);
+
+  size_t allocation = sizeof(perf_multiplex_t) +
+                      sizeof(perf_group_t *) * groups_count +
+                      sizeof(uint64_t) * count * 2 +
+                      sizeof(double) * count +
+                      sizeof(uint32_t) * count * 2;
+
+  perf_multiplex_t *multiplex = (perf_multiplex_t *)malloc(allocation);
+  if (multiplex == NULL)
+    return NULL;
+
+  memset((void *)multiplex, 0, allocation);
+
+  multiplex->size = count;
+  multiplex->groups_count = groups_count;
+  multiplex->groups = (perf_group_t **)(multiplex + 1);
+  multiplex->values = (uint64_t *)(multiplex->groups + groups_count);
+  multiplex->scaled = multiplex->values + count;
+  multiplex->ratios = (double *)(multiplex->scaled + count);
+  multiplex->group_of = (uint32_t *)(multiplex->ratios + count);
+  multiplex->slot_of = multiplex->group_of + count;
+
+  for (size_t i = 0; i < groups_count; i++) {
+    size_t capacity = i < hardware_groups ? (size_t)budget : software_events;
+    multiplex->groups[i] = perf_create_group(capacity, pid, cpu);
+    if (multiplex->groups[i] == NULL) {
+      perf_free_multiplex(multiplex);
+      return NULL;
+    }
+  }
+
+  // Fill the hardware groups in order, keeping related events listed together in the same group
+  size_t hardware_index = 0;
+  for (size_t i = 0; i < count; i++) {
+    size_t group = perf_event_uses_counter(&attributes[i]) ? hardware_index++ / budget : hardware_groups;
+
+    int slot = perf_group_add_attribute(multiplex->groups[group], names == NULL ? NULL : names[i], &attributes[i]);
+    if (slot < 0) {
+      perf_free_multiplex(multiplex);
+      return NULL;
+    }
+
+    multiplex->group_of[i] = group;
+    multiplex->slot_of[i] = slot;
+  }
+
+  return multiplex;
+}
+
+int perf_open_multiplex(perf_multiplex_t *multiplex, int flags) {
+  int unsupported = 0;
+  for (size_t i = 0; i < multiplex->groups_count; i++) {
+    int status = perf_open_group(multiplex->groups[i], flags);
+    if (status < 0)
+      return status;
+    unsupported += status;
+  }
+
+  return unsupported;
+}
+
+int perf_start_multiplex(const perf_multiplex_t *multiplex) {
+  for (size_t i = 0; i < multiplex->groups_count; i++) {
+    if (ioctl(multiplex->groups[i]->leader->file_descriptor, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) < 0)
+      return PERF_ERROR_IO;
+  }
+
+  // All groups are enabled at once, the kernel rotates them onto the PMU
+  for (size_t i = 0; i < multiplex->groups_count; i++) {
+    if (ioctl(multiplex->groups[i]->leader->file_descriptor, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) < 0)
+      return PERF_ERROR_IO;
+  }
+
+  return 0;
+}
+
+int perf_stop_multiplex(const perf_multiplex_t *multiplex) {
+  for (size_t i = 0; i < multiplex->groups_count; i++) {
+    if (ioctl(multiplex->groups[i]->leader->file_descriptor, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP) < 0)
+      return PERF_ERROR_IO;
+  }
+
+  return 0;
+}
+
+int perf_read_multiplex(perf_multiplex_t *multiplex) {
+  for (size_t i = 0; i < multiplex->groups_count; i++) {
+    int status = perf_read_group(multiplex->groups[i]);
+    if (status < 0)
+      return status;
+  }
+
+  for (size_t i = 0; i < multiplex->size; i++) {
+    const perf_group_t *group = multiplex->groups[multiplex->group_of[i]];
+    uint64_t value = group->values[multiplex->slot_of[i]];
+
+    multiplex->values[i] = value;
+    multiplex->ratios[i] = perf_group_running_ratio(group);
+    multiplex->scaled[i] = perf_scale_value(value, group->time_enabled, group->time_running);
+  }
+
+  return 0;
+}
+
+int perf_close_multiplex(perf_multiplex_t *multiplex) {
+  int status = 0;
+  for (size_t i = 0; i < multiplex->groups_count; i++) {
+    if (perf_close_group(multiplex->groups[i]) < 0)
+      status = PERF_ERROR_IO;
+  }
+
+  return status;
+}
+
+void perf_free_multiplex(perf_multiplex_t *multiplex) {
+  if (multiplex == NULL)
+    return;
+
+  for (size_t i = 0; i < multiplex->groups_count; i++)
+    free((void *)multiplex->groups[i]);
+
+  free((void *)multiplex);
+}
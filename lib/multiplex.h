@@ -0,0 +1,73 @@
+#ifndef PERF_MULTIPLEX_H
+#define PERF_MULTIPLEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "group.h"
+#include "perf.h"
+#include "utilities.h"
+
+// A list of events split into groups that each fit the hardware counters of the
+// PMU. When enabled together, the kernel rotates the groups onto the PMU. Values
+// are scaled by the share of time each group was running.
+typedef struct {
+  // The number of events
+  size_t size;
+  // The number of groups
+  size_t groups_count;
+  // The groups the events were split into
+  perf_group_t **groups;
+  // The group and slot of each event, indexed by event
+  uint32_t *group_of;
+  uint32_t *slot_of;
+  // The raw values of the last read, indexed by event
+  uint64_t *values;
+  // The scaled estimates of the last read, indexed by event
+  uint64_t *scaled;
+  // The share of time each event was counting during the last read, indexed by event
+  double *ratios;
+} perf_multiplex_t;
+
+// Get the number of general-purpose hardware counters available per CPU.
+// On x86 this is read using CPUID, taking the NMI watchdog into account. Elsewhere,
+// a conservative default is returned.
+// Returns <0 if an error occured.
+int perf_get_counter_budget();
+
+// Whether or not an event occupies a hardware counter. Software events, tracepoints
+// and breakpoints do not.
+int perf_event_uses_counter(const perf_event_attr_t *attribute);
+
+// Split events into groups of at most budget hardware events. Events not using a
+// hardware counter are placed in a group of their own, which is never multiplexed.
+// Use a budget of 0 to detect it using perf_get_counter_budget.
+// names may be NULL. See perf_create_measurement for pid and cpu.
+// Should be freed using perf_free_multiplex.
+// Returns NULL if an error occured.
+perf_multiplex_t *perf_create_multiplex(const perf_event_attr_t *attributes, const char **names, size_t count, int budget, pid_t pid, int cpu);
+
+// Open all groups.
+// Returns <0 if an error occured, the number of unsupported events otherwise.
+int perf_open_multiplex(perf_multiplex_t *multiplex, int flags);
+
+// Reset and start all groups.
+// Returns <0 if an error occured.
+int perf_start_multiplex(const perf_multiplex_t *multiplex);
+
+// Stop all groups.
+// Returns <0 if an error occured.
+int perf_stop_multiplex(const perf_multiplex_t *multiplex);
+
+// Read all groups into multiplex->values, multiplex->scaled and multiplex->ratios.
+// Returns <0 if an error occured.
+int perf_read_multiplex(perf_multiplex_t *multiplex);
+
+// Close all groups.
+// Returns <0 if an error occured.
+int perf_close_multiplex(perf_multiplex_t *multiplex);
+
+// Free the multiplexed groups.
+void perf_free_multiplex(perf_multiplex_t *multiplex);
+
+#endif
@@ -0,0 +1,233 @@
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "environment.h"
+#include "off_cpu.h"
+#include "sampling.h"
+#include "symbols.h"
+#include "utilities.h"
+
+// Set on switch out records when the thread was preempted while runnable. Added in Linux 4.17
+#ifndef PERF_RECORD_MISC_SWITCH_OUT_PREEMPT
+#define PERF_RECORD_MISC_SWITCH_OUT_PREEMPT (1 << 14)
+#endif
+
+const char *perf_off_cpu_names[PERF_OFF_CPU_VALUES] = {"wall time (ns)", "on-CPU (ns)", "off-CPU (ns)", "off-CPU intervals"};
+
+perf_off_cpu_t *perf_create_off_cpu(size_t capacity, uint16_t max_depth) {
+  if (capacity == 0 || max_depth > PERF_OFF_CPU_MAX_DEPTH)
+    return NULL;
+
+  perf_off_cpu_t *tracker = (perf_off_cpu_t *)malloc(sizeof(perf_off_cpu_t));
+  if (tracker == NULL)
+    return NULL;
+
+  memset((void *)tracker, 0, sizeof(perf_off_cpu_t));
+  tracker->capacity = capacity;
+
+  // Switches are only sampled where the kernel may be sampled, as the kernel performs them
+  const perf_environment_t *environment = perf_get_environment();
+  int exclude_kernel = environment->has_cap_sys_admin != 1 && environment->has_cap_perfmon != 1 && environment->paranoia >= 2;
+  if (exclude_kernel)
+    max_depth = 0;
+
+  uint64_t sample_type = PERF_SAMPLE_TIME | (max_depth > 0 ? PERF_SAMPLE_CALLCHAIN : 0);
+  tracker->measurement = perf_create_sampling_measurement(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, 0, -1, max_depth > 0 ? 1 : 0, sample_type);
+  tracker->intervals = (perf_off_cpu_interval_t *)malloc(sizeof(perf_off_cpu_interval_t) * capacity);
+  if (tracker->measurement == NULL || tracker->intervals == NULL) {
+    perf_free_off_cpu(tracker);
+    return NULL;
+  }
+
+  // Not opened yet
+  tracker->measurement->file_descriptor = -1;
+
+  perf_event_attr_t *attribute = &tracker->measurement->attribute;
+  // Write a record for every switch, timestamped on the clock of perf_off_cpu_snapshot
+  attribute->context_switch = 1;
+  attribute->sample_id_all = 1;
+  attribute->use_clockid = 1;
+  attribute->clockid = CLOCK_MONOTONIC;
+  // The buffer is only ever polled, so there's no reader to wake up
+  attribute->wakeup_events = 0;
+  attribute->exclude_kernel = exclude_kernel;
+  attribute->exclude_hv = 1;
+  // Only the user space frames tell where the thread blocked
+  attribute->exclude_callchain_kernel = 1;
+  attribute->sample_max_stack = max_depth;
+
+  return tracker;
+}
+
+int perf_open_off_cpu(perf_off_cpu_t *tracker, size_t pages) {
+  tracker->measurement->attribute.disabled = 0;
+  int status = perf_open_measurement(tracker->measurement, -1, 0);
+  if (status < 0)
+    return status;
+
+  tracker->ring_buffer = perf_map_ring_buffer(tracker->measurement, pages);
+  if (tracker->ring_buffer == NULL)
+    return PERF_ERROR_IO;
+
+  return 0;
+}
+
+// Keep the user space frames of a sampled callchain until the switch record following it.
+static void perf_off_cpu_sample(perf_off_cpu_t *tracker, const perf_sample_t *sample) {
+  tracker->pending_length = 0;
+  for (uint64_t i = 0; i < sample->callchain_length && tracker->pending_length < PERF_OFF_CPU_MAX_DEPTH; i++) {
+    // Skip the PERF_CONTEXT_ markers
+    if (sample->callchain[i] < PERF_CONTEXT_MAX)
+      tracker->pending[tracker->pending_length++] = sample->callchain[i];
+  }
+}
+
+// Returns 1 if an interval ended, 0 otherwise.
+static int perf_off_cpu_switch(perf_off_cpu_t *tracker, const struct perf_event_header *record) {
+  // The record is followed by its sample_id, holding nothing but the time
+  uint64_t time = *(const uint64_t *)(record + 1);
+
+  if (record->misc & PERF_RECORD_MISC_SWITCH_OUT) {
+    tracker->switched_out = time;
+    tracker->preempted = (record->misc & PERF_RECORD_MISC_SWITCH_OUT_PREEMPT) != 0;
+    return 0;
+  }
+
+  if (tracker->switched_out == 0)
+    return 0;
+
+  perf_off_cpu_interval_t *interval = &tracker->intervals[tracker->intervals_count % tracker->capacity];
+  interval->start = tracker->switched_out;
+  interval->end = time;
+  interval->preempted = tracker->preempted;
+  interval->callchain_length = tracker->pending_length;
+  memcpy((void *)interval->callchain, (const void *)tracker->pending, sizeof(uint64_t) * tracker->pending_length);
+
+  tracker->off_cpu_time += time - tracker->switched_out;
+  tracker->intervals_count++;
+  tracker->switched_out = 0;
+  tracker->pending_length = 0;
+  return 1;
+}
+
+int perf_poll_off_cpu(perf_off_cpu_t *tracker) {
+  int added = 0;
+
+  perf_ring_buffer_begin_read(tracker->ring_buffer);
+  const struct perf_event_header *record;
+  while ((record = perf_ring_buffer_next(tracker->ring_buffer)) != NULL) {
+    if (record->type == PERF_RECORD_SWITCH) {
+      added += perf_off_cpu_switch(tracker, record);
+    } else if (record->type == PERF_RECORD_SAMPLE) {
+      perf_sample_t sample;
+      if (perf_parse_sample(tracker->ring_buffer, record, &sample) == 0)
+        perf_off_cpu_sample(tracker, &sample);
+    } else if (record->type == PERF_RECORD_LOST) {
+      tracker->lost += ((const perf_record_lost_t *)record)->lost;
+      // The lost records may include the switch back in, so the pending interval can't be trusted
+      tracker->switched_out = 0;
+      tracker->pending_length = 0;
+    }
+  }
+  perf_ring_buffer_end_read(tracker->ring_buffer);
+
+  return added;
+}
+
+static uint64_t perf_off_cpu_now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+void perf_off_cpu_snapshot(perf_off_cpu_t *tracker, perf_off_cpu_snapshot_t *snapshot) {
+  perf_poll_off_cpu(tracker);
+  snapshot->time = perf_off_cpu_now();
+  snapshot->off_cpu_time = tracker->off_cpu_time;
+  snapshot->intervals_count = tracker->intervals_count;
+}
+
+void perf_off_cpu_since(perf_off_cpu_t *tracker, const perf_off_cpu_snapshot_t *snapshot, uint64_t values[PERF_OFF_CPU_VALUES]) {
+  // The thread runs both when taking the snapshot and now, so every interval
+  // ended since the snapshot was polled also started after it
+  uint64_t now = perf_off_cpu_now();
+  perf_poll_off_cpu(tracker);
+
+  values[PERF_OFF_CPU_WALL_TIME] = now - snapshot->time;
+  values[PERF_OFF_CPU_OFF_CPU_TIME] = tracker->off_cpu_time - snapshot->off_cpu_time;
+  // Guard against clock skew between the kernel's timestamps and the clock read
+  if (values[PERF_OFF_CPU_OFF_CPU_TIME] > values[PERF_OFF_CPU_WALL_TIME])
+    values[PERF_OFF_CPU_OFF_CPU_TIME] = values[PERF_OFF_CPU_WALL_TIME];
+  values[PERF_OFF_CPU_ON_CPU_TIME] = values[PERF_OFF_CPU_WALL_TIME] - values[PERF_OFF_CPU_OFF_CPU_TIME];
+  values[PERF_OFF_CPU_INTERVALS] = tracker->intervals_count - snapshot->intervals_count;
+}
+
+static int perf_compare_intervals(const void *a, const void *b) {
+  const perf_off_cpu_interval_t *first = *(const perf_off_cpu_interval_t **)a;
+  const perf_off_cpu_interval_t *second = *(const perf_off_cpu_interval_t **)b;
+  uint64_t first_duration = first->end - first->start;
+  uint64_t second_duration = second->end - second->start;
+  if (first_duration != second_duration)
+    return first_duration > second_duration ? -1 : 1;
+  return first->start < second->start ? -1 : first->start > second->start;
+}
+
+int perf_print_off_cpu_intervals(const perf_off_cpu_t *tracker, const perf_symbol_table_t *symbols, size_t top, FILE *output) {
+  size_t count = tracker->intervals_count < tracker->capacity ? (size_t)tracker->intervals_count : tracker->capacity;
+  const perf_off_cpu_interval_t **sorted = (const perf_off_cpu_interval_t **)malloc(sizeof(perf_off_cpu_interval_t *) * (count + 1));
+  if (sorted == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  for (size_t i = 0; i < count; i++)
+    sorted[i] = &tracker->intervals[i];
+
+  qsort(sorted, count, sizeof(perf_off_cpu_interval_t *), perf_compare_intervals);
+  if (top == 0 || top > count)
+    top = count;
+
+  fprintf(output, "off-CPU intervals: %" PRIu64 " (%zu retained), lost: %" PRIu64 "\n", tracker->intervals_count, count, tracker->lost);
+  fprintf(output, "    duration (ms)  reason     callchain\n");
+  for (size_t i = 0; i < top; i++) {
+    const perf_off_cpu_interval_t *interval = sorted[i];
+    fprintf(output, "%17.3f  %-9s  ", (double)(interval->end - interval->start) / 1e6, interval->preempted ? "preempted" : "blocked");
+
+    for (uint16_t j = 0; j < interval->callchain_length; j++) {
+      // Callers are listed by their return address, which may lie past the end of the calling function
+      uint64_t ip = j == 0 ? interval->callchain[j] : interval->callchain[j] - 1;
+      const perf_mapping_t *mapping = NULL;
+      const perf_symbol_t *symbol = symbols != NULL ? perf_resolve_symbol(symbols, ip, &mapping) : NULL;
+      if (j > 0)
+        fputs(" <- ", output);
+      if (symbol != NULL) {
+        fputs(symbol->name, output);
+      } else if (mapping != NULL) {
+        const char *name = strrchr(mapping->path, '/');
+        fprintf(output, "[%s]", name != NULL ? name + 1 : mapping->path);
+      } else {
+        fputs("[unknown]", output);
+      }
+    }
+    if (interval->callchain_length == 0)
+      fputs("-", output);
+    fputc('\n', output);
+  }
+
+  free((void *)sorted);
+  return ferror(output) ? PERF_ERROR_IO : 0;
+}
+
+void perf_free_off_cpu(perf_off_cpu_t *tracker) {
+  // Always unmap the ring buffer before closing its measurement
+  if (tracker->ring_buffer != NULL)
+    perf_unmap_ring_buffer(tracker->ring_buffer);
+  if (tracker->measurement != NULL) {
+    if (tracker->measurement->file_descriptor >= 0)
+      perf_close_measurement(tracker->measurement);
+    free((void *)tracker->measurement);
+  }
+  free((void *)tracker->intervals);
+  free((void *)tracker);
+}
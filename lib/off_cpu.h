@@ -0,0 +1,98 @@
+#ifndef PERF_OFF_CPU_H
+#define PERF_OFF_CPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sampling.h"
+#include "symbols.h"
+#include "utilities.h"
+
+// The maximum number of frames kept of a blocking callchain
+#define PERF_OFF_CPU_MAX_DEPTH 32
+
+// The slots of the values computed by perf_off_cpu_since
+#define PERF_OFF_CPU_WALL_TIME 0
+#define PERF_OFF_CPU_ON_CPU_TIME 1
+#define PERF_OFF_CPU_OFF_CPU_TIME 2
+#define PERF_OFF_CPU_INTERVALS 3
+#define PERF_OFF_CPU_VALUES 4
+
+// The names of the values computed by perf_off_cpu_since, indexed by slot.
+extern const char *perf_off_cpu_names[PERF_OFF_CPU_VALUES];
+
+// An interval during which the thread was switched out.
+typedef struct {
+  // The CLOCK_MONOTONIC times of switching out and back in, in nanoseconds
+  uint64_t start;
+  uint64_t end;
+  // Whether the thread was preempted while runnable, rather than blocking
+  int preempted;
+  // The user space callchain of the thread as it was switched out, innermost frame
+  // first. Empty unless recording callchains
+  uint16_t callchain_length;
+  uint64_t callchain[PERF_OFF_CPU_MAX_DEPTH];
+} perf_off_cpu_interval_t;
+
+// Tracks when the calling thread is switched out, using the PERF_RECORD_SWITCH records of the kernel.
+typedef struct {
+  // Samples each switch of the thread, and writes the switch records
+  perf_measurement_t *measurement;
+  perf_ring_buffer_t *ring_buffer;
+  // The time the thread was last switched out. 0 while the thread is on CPU
+  uint64_t switched_out;
+  int preempted;
+  // The callchain of the last switch, written by the kernel just before the switch record
+  uint16_t pending_length;
+  uint64_t pending[PERF_OFF_CPU_MAX_DEPTH];
+  // The total off-CPU time in nanoseconds and the number of off-CPU intervals since opened
+  uint64_t off_cpu_time;
+  uint64_t intervals_count;
+  // The most recent intervals, a ring of capacity intervals indexed by intervals_count
+  size_t capacity;
+  perf_off_cpu_interval_t *intervals;
+  // The number of records lost due to a full ring buffer
+  uint64_t lost;
+} perf_off_cpu_t;
+
+// The state of a tracker at a point in time, such as when entering a region.
+typedef struct {
+  uint64_t time;
+  uint64_t off_cpu_time;
+  uint64_t intervals_count;
+} perf_off_cpu_snapshot_t;
+
+// Create a tracker of the calling thread, keeping the capacity most recent off-CPU
+// intervals. If max_depth is not 0, the callchain of each switch is recorded, up to
+// max_depth frames (at most PERF_OFF_CPU_MAX_DEPTH). The kernel only samples switches
+// where sampling the kernel is allowed, otherwise intervals are tracked without callchains.
+// The measurement's attribute may be modified before the tracker is opened. Should be freed using perf_free_off_cpu.
+// Returns NULL if an error occured.
+perf_off_cpu_t *perf_create_off_cpu(size_t capacity, uint16_t max_depth);
+
+// Open the tracker, mapping pages data pages. pages must be a power of two. The
+// tracker is enabled immediately, requiring Linux 4.3 or newer.
+// Returns <0 if an error occured.
+int perf_open_off_cpu(perf_off_cpu_t *tracker, size_t pages);
+
+// Process the switch records written by the kernel. Must be called often enough for
+// the ring buffer not to fill up. Never makes a system call.
+// Returns the number of new off-CPU intervals.
+int perf_poll_off_cpu(perf_off_cpu_t *tracker);
+
+// Poll the tracker and take a snapshot of its state. The calling thread must be the tracked thread.
+void perf_off_cpu_snapshot(perf_off_cpu_t *tracker, perf_off_cpu_snapshot_t *snapshot);
+
+// Poll the tracker and compute the wall, on-CPU and off-CPU time in nanoseconds and the
+// number of off-CPU intervals since a snapshot, indexed by PERF_OFF_CPU_ slot.
+void perf_off_cpu_since(perf_off_cpu_t *tracker, const perf_off_cpu_snapshot_t *snapshot, uint64_t values[PERF_OFF_CPU_VALUES]);
+
+// Print the top retained intervals, longest first, resolving their callchains using symbols. A top of 0 prints all intervals.
+// Returns <0 if an error occured.
+int perf_print_off_cpu_intervals(const perf_off_cpu_t *tracker, const perf_symbol_table_t *symbols, size_t top, FILE *output);
+
+// Close and free the tracker.
+void perf_free_off_cpu(perf_off_cpu_t *tracker);
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef PERF_HPP
+#define PERF_HPP
+
+// A header-only C++17 layer over the library. Measurements own their file
+// descriptors and are closed when destroyed, also when an exception is thrown.
+// The events of a group are template parameters, so the layout of a read, the
+// slot of each event and the result are all fixed at compile time.
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <linux/perf_event.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+
+extern "C" {
+#include "perf.h"
+#include "self_monitoring.h"
+#include "utilities.h"
+}
+
+namespace perf {
+
+// An event, identified by its type and config at compile time.
+template <uint32_t Type, uint64_t Config, bool ExcludeKernel = false>
+struct event {
+  static constexpr uint32_t type = Type;
+  static constexpr uint64_t config = Config;
+  static constexpr bool exclude_kernel = ExcludeKernel;
+};
+
+namespace events {
+using instructions = event<PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS>;
+using cycles = event<PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES>;
+using branch_misses = event<PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES>;
+using cache_misses = event<PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES>;
+using task_clock = event<PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK>;
+using context_switches = event<PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES>;
+using page_faults = event<PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS>;
+} // namespace events
+
+namespace detail {
+// The index of Event within Events. Fails to compile if Event is not part of Events
+template <typename Event, typename... Events>
+struct index_of;
+
+template <typename Event, typename... Events>
+struct index_of<Event, Event, Events...> : std::integral_constant<std::size_t, 0> {};
+
+template <typename Event, typename Other, typename... Events>
+struct index_of<Event, Other, Events...> : std::integral_constant<std::size_t, 1 + index_of<Event, Events...>::value> {};
+
+// Throws the error of a library call, a PERF_ERROR_ value
+inline void check(int status, const char *what) {
+  if (status >= 0)
+    return;
+
+  switch (status) {
+  case PERF_ERROR_BAD_PARAMETERS:
+    throw std::system_error(EINVAL, std::generic_category(), what);
+  case PERF_ERROR_NOT_SUPPORTED:
+    throw std::system_error(EOPNOTSUPP, std::generic_category(), what);
+  default:
+    throw std::system_error(errno, std::generic_category(), what);
+  }
+}
+} // namespace detail
+
+// An opened measurement. Move-only, closed and freed when destroyed.
+class measurement {
+public:
+  measurement() = default;
+
+  // Create and open a measurement. See perf_create_measurement and perf_open_measurement.
+  // Throws std::system_error if an error occured.
+  measurement(const perf_event_attr_t &attribute, pid_t pid, int cpu, int group, int flags = 0) {
+    value_ = perf_create_measurement(attribute.type, attribute.config, pid, cpu);
+    if (value_ == nullptr)
+      throw std::system_error(errno, std::generic_category(), "unable to create measurement");
+
+    value_->attribute = attribute;
+    value_->attribute.size = sizeof(perf_event_attr_t);
+    int status = perf_open_measurement(value_, group, flags);
+    if (status < 0) {
+      std::free(value_);
+      value_ = nullptr;
+      detail::check(status, "unable to open measurement");
+    }
+  }
+
+  measurement(const measurement &) = delete;
+  measurement &operator=(const measurement &) = delete;
+
+  measurement(measurement &&other) noexcept : value_(std::exchange(other.value_, nullptr)) {}
+
+  measurement &operator=(measurement &&other) noexcept {
+    if (this != &other) {
+      reset();
+      value_ = std::exchange(other.value_, nullptr);
+    }
+    return *this;
+  }
+
+  ~measurement() {
+    reset();
+  }
+
+  int file_descriptor() const noexcept {
+    return value_->file_descriptor;
+  }
+
+  const perf_measurement_t *get() const noexcept {
+    return value_;
+  }
+
+private:
+  void reset() noexcept {
+    if (value_ == nullptr)
+      return;
+
+    perf_close_measurement(value_);
+    std::free(value_);
+    value_ = nullptr;
+  }
+
+  perf_measurement_t *value_ = nullptr;
+};
+
+// The values of a read of a group, indexed at compile time by event.
+template <typename... Events>
+struct values {
+  std::array<uint64_t, sizeof...(Events)> raw{};
+
+  template <typename Event>
+  constexpr uint64_t get() const noexcept {
+    return raw[detail::index_of<Event, Events...>::value];
+  }
+
+  // The values counted between two reads
+  constexpr values operator-(const values &other) const noexcept {
+    values difference;
+    for (std::size_t i = 0; i < sizeof...(Events); i++)
+      difference.raw[i] = raw[i] - other.raw[i];
+    return difference;
+  }
+};
+
+// A group of events, scheduled onto the CPU together and read at once. Like
+// perf_group_t it owns a dummy software leader. Move-only.
+template <typename... Events>
+class group {
+public:
+  static_assert(sizeof...(Events) > 0, "a group requires at least one event");
+
+  static constexpr std::size_t size = sizeof...(Events);
+
+  // The slot of an event, known at compile time
+  template <typename Event>
+  static constexpr std::size_t slot = detail::index_of<Event, Events...>::value;
+
+  // Open the group and all of its members. See perf_create_measurement for pid and cpu.
+  // Throws std::system_error if an error occured, such as when an event is not supported.
+  explicit group(pid_t pid = 0, int cpu = -1)
+      : leader_(attribute(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_DUMMY, false, true), pid, cpu, -1),
+        members_{measurement(attribute(Events::type, Events::config, Events::exclude_kernel, false), pid, cpu, leader_.file_descriptor())...} {}
+
+  group(group &&) noexcept = default;
+  group &operator=(group &&) noexcept = default;
+
+  // Reset the counters and start them.
+  void start() const noexcept {
+    ioctl(leader_.file_descriptor(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_.file_descriptor(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  // Stop the counters.
+  void stop() const noexcept {
+    ioctl(leader_.file_descriptor(), PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  // Read all members using a single read. The kernel lists the leader first and the
+  // members in the order they were opened, so each value is at a fixed offset.
+  // Throws std::system_error if an error occured.
+  values<Events...> read() const {
+    // nr, then a value and id per measurement. See perf_create_measurement for the read format
+    std::array<uint64_t, 1 + 2 * (size + 1)> buffer;
+    if (::read(leader_.file_descriptor(), buffer.data(), sizeof(buffer)) != (ssize_t)sizeof(buffer))
+      throw std::system_error(errno, std::generic_category(), "unable to read group");
+
+    values<Events...> result;
+    for (std::size_t i = 0; i < size; i++)
+      result.raw[i] = buffer[1 + 2 * (i + 1)];
+    return result;
+  }
+
+  const measurement &leader() const noexcept {
+    return leader_;
+  }
+
+  const measurement &member(std::size_t index) const noexcept {
+    return members_[index];
+  }
+
+private:
+  static perf_event_attr_t attribute(uint32_t type, uint64_t config, bool exclude_kernel, bool disabled) {
+    perf_event_attr_t attribute{};
+    attribute.size = sizeof(perf_event_attr_t);
+    attribute.type = type;
+    attribute.config = config;
+    attribute.exclude_kernel = exclude_kernel;
+    // Members follow the leader, which is created disabled
+    attribute.disabled = disabled;
+    attribute.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+    return attribute;
+  }
+
+  measurement leader_;
+  std::array<measurement, size> members_;
+};
+
+// A single event of the calling thread, read in userspace using rdpmc when
+// possible. See perf_self_monitor_t. Move-only.
+template <typename Event>
+class counter {
+public:
+  // Open and enable the counter.
+  // Throws std::system_error if an error occured.
+  counter() : measurement_(attribute(), 0, -1, -1) {
+    monitor_ = perf_map_self_monitor(measurement_.get());
+    if (monitor_ == nullptr)
+      throw std::system_error(errno, std::generic_category(), "unable to map counter");
+  }
+
+  counter(const counter &) = delete;
+  counter &operator=(const counter &) = delete;
+
+  counter(counter &&other) noexcept : measurement_(std::move(other.measurement_)), monitor_(std::exchange(other.monitor_, nullptr)) {
+    // The monitor refers to the measurement it was mapped from
+    if (monitor_ != nullptr)
+      monitor_->measurement = measurement_.get();
+  }
+
+  counter &operator=(counter &&) = delete;
+
+  ~counter() {
+    if (monitor_ != nullptr)
+      perf_unmap_self_monitor(monitor_);
+  }
+
+  // Read the current, cumulative value. Inlined down to rdpmc when available.
+  uint64_t read() const noexcept {
+    return perf_self_monitor_read(monitor_);
+  }
+
+  // Whether or not reads are served by rdpmc rather than the read syscall.
+  bool is_userspace() const noexcept {
+    return perf_self_monitor_is_userspace(monitor_) == 1;
+  }
+
+private:
+  static perf_event_attr_t attribute() {
+    perf_event_attr_t attribute{};
+    attribute.size = sizeof(perf_event_attr_t);
+    attribute.type = Event::type;
+    attribute.config = Event::config;
+    attribute.exclude_kernel = Event::exclude_kernel;
+    attribute.disabled = 1;
+    return attribute;
+  }
+
+  measurement measurement_;
+  perf_self_monitor_t *monitor_ = nullptr;
+};
+
+} // namespace perf
+
+#endif
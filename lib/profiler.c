@@ -0,0 +1,692 @@
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "environment.h"
+#include "event_set.h"
+#include "heatmap.h"
+#include "profiler.h"
+#include "sampling.h"
+#include "symbols.h"
+#include "utilities.h"
+
+// The initial number of histogram entries. Always a power of two
+#define PERF_PROFILER_INITIAL_ENTRIES 1024
+// The initial number of stack table nodes. Always a power of two
+#define PERF_PROFILER_INITIAL_STACKS 4096
+
+// Instruction pointers at or above this address belong to the kernel on all supported 64-bit architectures
+#define PERF_KERNEL_ADDRESS 0xffff000000000000llu
+
+perf_profiler_t *perf_create_profiler(int type, uint64_t config, uint64_t frequency) {
+  perf_profiler_t *profiler = (perf_profiler_t *)malloc(sizeof(perf_profiler_t));
+  if (profiler == NULL)
+    return NULL;
+
+  memset((void *)profiler, 0, sizeof(perf_profiler_t));
+
+  profiler->entries = (perf_profile_entry_t *)calloc(PERF_PROFILER_INITIAL_ENTRIES, sizeof(perf_profile_entry_t));
+  profiler->mask = PERF_PROFILER_INITIAL_ENTRIES - 1;
+  profiler->symbols = perf_load_symbol_table(0);
+  if (profiler->entries == NULL || profiler->symbols == NULL) {
+    perf_free_profiler(profiler);
+    return NULL;
+  }
+
+  perf_event_attr_t *attribute = &profiler->attribute;
+  attribute->size = sizeof(perf_event_attr_t);
+  attribute->type = type;
+  attribute->config = config;
+  attribute->disabled = 1;
+  attribute->sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID;
+  // Sample at a fixed frequency, letting the kernel adjust the period
+  attribute->freq = 1;
+  attribute->sample_freq = frequency;
+  // Include threads created by the calling thread
+  attribute->inherit = 1;
+  attribute->exclude_hv = 1;
+
+  // Only sample the kernel when allowed to, rather than failing to open
+  const perf_environment_t *environment = perf_get_environment();
+  if (environment->has_cap_sys_admin != 1 && environment->has_cap_perfmon != 1 && environment->paranoia >= 2)
+    attribute->exclude_kernel = 1;
+
+  return profiler;
+}
+
+// Open a measurement per CPU for a thread of the calling process, writing its samples
+// to the ring buffers of the profiler.
+// Returns <0 if an error occured.
+static int perf_open_thread_measurements(perf_profiler_t *profiler, pid_t tid) {
+  perf_measurement_t **measurements = (perf_measurement_t **)realloc(profiler->thread_measurements, sizeof(perf_measurement_t *) * (profiler->thread_measurements_size + profiler->cpus));
+  if (measurements == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+  profiler->thread_measurements = measurements;
+
+  for (size_t i = 0; i < profiler->cpus; i++) {
+    const perf_measurement_t *output = profiler->measurements[i];
+    perf_measurement_t *measurement = perf_create_measurement(profiler->attribute.type, profiler->attribute.config, tid, output->cpu);
+    if (measurement == NULL)
+      return PERF_ERROR_LIBRARY_FAILURE;
+    measurement->attribute = profiler->attribute;
+
+    int status = perf_open_measurement(measurement, -1, 0);
+    if (status < 0) {
+      free((void *)measurement);
+      // The thread exited since it was listed
+      return errno == ESRCH ? 0 : status;
+    }
+    profiler->thread_measurements[profiler->thread_measurements_size++] = measurement;
+
+    // Share the ring buffer of the CPU instead of mapping one per thread
+    if (ioctl(measurement->file_descriptor, PERF_EVENT_IOC_SET_OUTPUT, output->file_descriptor) < 0)
+      return PERF_ERROR_IO;
+  }
+
+  return 0;
+}
+
+int perf_open_profiler(perf_profiler_t *profiler, size_t pages) {
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (page_size < 0)
+    return PERF_ERROR_IO;
+
+  int cpu_ids[PERF_MAX_CPUS];
+  int cpus = perf_get_online_cpus(cpu_ids, PERF_MAX_CPUS);
+  if (cpus < 0)
+    return cpus;
+
+  profiler->measurements = (perf_measurement_t **)calloc(cpus, sizeof(perf_measurement_t *));
+  profiler->ring_buffers = (perf_ring_buffer_t **)calloc(cpus, sizeof(perf_ring_buffer_t *));
+  if (profiler->measurements == NULL || profiler->ring_buffers == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  // Wake a waiting reader once a buffer is half full instead of for every sample
+  profiler->attribute.watermark = 1;
+  profiler->attribute.wakeup_watermark = pages * page_size / 2;
+
+  for (int i = 0; i < cpus; i++) {
+    perf_measurement_t *measurement = perf_create_measurement(profiler->attribute.type, profiler->attribute.config, 0, cpu_ids[i]);
+    if (measurement == NULL)
+      return PERF_ERROR_LIBRARY_FAILURE;
+    measurement->attribute = profiler->attribute;
+    profiler->measurements[i] = measurement;
+    profiler->cpus++;
+
+    int status = perf_open_measurement(measurement, -1, 0);
+    if (status < 0) {
+      measurement->file_descriptor = -1;
+      return status;
+    }
+
+    profiler->ring_buffers[i] = perf_map_ring_buffer(measurement, pages);
+    if (profiler->ring_buffers[i] == NULL)
+      return PERF_ERROR_IO;
+  }
+
+  // The measurements above only follow the calling thread and the threads it creates,
+  // so measure the threads which already exist as well
+  DIR *tasks = opendir("/proc/self/task");
+  if (tasks == NULL)
+    return PERF_ERROR_IO;
+
+  pid_t self = (pid_t)syscall(SYS_gettid);
+  struct dirent *entry;
+  while ((entry = readdir(tasks)) != NULL) {
+    if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+      continue;
+
+    pid_t tid = (pid_t)atoi(entry->d_name);
+    if (tid == self)
+      continue;
+
+    int status = perf_open_thread_measurements(profiler, tid);
+    if (status < 0) {
+      closedir(tasks);
+      return status;
+    }
+  }
+  closedir(tasks);
+
+  return 0;
+}
+
+int perf_start_profiler(const perf_profiler_t *profiler) {
+  for (size_t i = 0; i < profiler->cpus; i++) {
+    if (ioctl(profiler->measurements[i]->file_descriptor, PERF_EVENT_IOC_ENABLE, 0) < 0)
+      return PERF_ERROR_IO;
+  }
+  for (size_t i = 0; i < profiler->thread_measurements_size; i++) {
+    if (ioctl(profiler->thread_measurements[i]->file_descriptor, PERF_EVENT_IOC_ENABLE, 0) < 0)
+      return PERF_ERROR_IO;
+  }
+
+  return 0;
+}
+
+int perf_stop_profiler(const perf_profiler_t *profiler) {
+  for (size_t i = 0; i < profiler->cpus; i++) {
+    if (ioctl(profiler->measurements[i]->file_descriptor, PERF_EVENT_IOC_DISABLE, 0) < 0)
+      return PERF_ERROR_IO;
+  }
+  for (size_t i = 0; i < profiler->thread_measurements_size; i++) {
+    if (ioctl(profiler->thread_measurements[i]->file_descriptor, PERF_EVENT_IOC_DISABLE, 0) < 0)
+      return PERF_ERROR_IO;
+  }
+
+  return 0;
+}
+
+int perf_profiler_wait(const perf_profiler_t *profiler, int timeout) {
+  struct pollfd descriptors[PERF_MAX_CPUS];
+  for (size_t i = 0; i < profiler->cpus; i++) {
+    descriptors[i].fd = profiler->measurements[i]->file_descriptor;
+    descriptors[i].events = POLLIN;
+    descriptors[i].revents = 0;
+  }
+
+  int status = poll(descriptors, profiler->cpus, timeout);
+  if (status < 0)
+    return PERF_ERROR_IO;
+
+  return status > 0 ? 1 : 0;
+}
+
+static uint64_t perf_hash_string(const char *string) {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037llu;
+  for (; *string != '\0'; string++)
+    hash = (hash ^ (uint8_t)*string) * 1099511628211llu;
+  return hash;
+}
+
+// Grow the histogram to twice its size.
+// Returns <0 if an error occured.
+static int perf_grow_profile(perf_profiler_t *profiler) {
+  size_t capacity = 2 * (profiler->mask + 1);
+  perf_profile_entry_t *entries = (perf_profile_entry_t *)calloc(capacity, sizeof(perf_profile_entry_t));
+  if (entries == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  for (size_t i = 0; i <= profiler->mask; i++) {
+    const perf_profile_entry_t *entry = &profiler->entries[i];
+    if (entry->name == NULL)
+      continue;
+
+    uint64_t index = ((entry->address ^ perf_hash_string(entry->module)) * 11400714819323198485llu) >> 32;
+    while (entries[index & (capacity - 1)].name != NULL)
+      index++;
+    entries[index & (capacity - 1)] = *entry;
+  }
+
+  free((void *)profiler->entries);
+  profiler->entries = entries;
+  profiler->mask = capacity - 1;
+  return 0;
+}
+
+// Count a sample of a function. Functions are identified by their address and module, so
+// that entries outlive the symbols they were resolved from.
+// Returns <0 if an error occured.
+static int perf_profile_add(perf_profiler_t *profiler, uint64_t address, const char *name, const char *module) {
+  // Keep the histogram at most half full, so that probing stays short
+  if (2 * (profiler->size + 1) > profiler->mask + 1 && perf_grow_profile(profiler) < 0)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  uint64_t index = ((address ^ perf_hash_string(module)) * 11400714819323198485llu) >> 32;
+  for (;; index++) {
+    perf_profile_entry_t *entry = &profiler->entries[index & profiler->mask];
+    if (entry->name == NULL) {
+      entry->name = strdup(name);
+      entry->module = strdup(module);
+      if (entry->name == NULL || entry->module == NULL) {
+        free((void *)entry->name);
+        free((void *)entry->module);
+        memset((void *)entry, 0, sizeof(perf_profile_entry_t));
+        return PERF_ERROR_LIBRARY_FAILURE;
+      }
+      entry->address = address;
+      entry->samples = 1;
+      profiler->size++;
+      return 0;
+    }
+
+    if (entry->address == address && strcmp(entry->module, module) == 0) {
+      entry->samples++;
+      return 0;
+    }
+  }
+}
+
+// A resolved frame.
+typedef struct {
+  perf_frame_kind_t kind;
+  // The address identifying the frame, see perf_frame_kind_t
+  uint64_t address;
+  const char *name;
+  const char *module;
+} perf_frame_t;
+
+// Resolve an instruction pointer.
+static void perf_resolve_frame(perf_profiler_t *profiler, uint64_t ip, int *updated, perf_frame_t *frame) {
+  if (ip >= PERF_KERNEL_ADDRESS) {
+    // Reading kallsyms is slow, so only do so once a kernel address is sampled
+    if (!profiler->kernel_loaded) {
+      profiler->kernel = perf_load_kernel_symbols();
+      profiler->kernel_loaded = 1;
+    }
+
+    const perf_symbol_t *symbol = profiler->kernel != NULL && ip < profiler->kernel->end ? perf_resolve_mapping_symbol(profiler->kernel, ip) : NULL;
+    frame->kind = PERF_FRAME_KERNEL;
+    frame->address = symbol != NULL ? symbol->start : 0;
+    frame->name = symbol != NULL ? symbol->name : "[kernel]";
+    frame->module = "[kernel]";
+    return;
+  }
+
+  const perf_mapping_t *mapping = NULL;
+  const perf_symbol_t *symbol = perf_resolve_symbol(profiler->symbols, ip, &mapping);
+
+  // The address may belong to a library loaded after the mappings were read. Read them at most once per poll
+  if (mapping == NULL && !*updated) {
+    *updated = 1;
+    if (perf_update_symbol_table(profiler->symbols) == 0)
+      symbol = perf_resolve_symbol(profiler->symbols, ip, &mapping);
+  }
+
+  if (mapping == NULL) {
+    frame->kind = PERF_FRAME_UNKNOWN;
+    frame->address = 0;
+    frame->name = "[unknown]";
+    frame->module = "[unknown]";
+  } else if (symbol == NULL) {
+    frame->kind = PERF_FRAME_MAPPING;
+    frame->address = mapping->start;
+    frame->name = "[unknown]";
+    frame->module = mapping->path;
+  } else {
+    frame->kind = PERF_FRAME_FUNCTION;
+    frame->address = symbol->start;
+    frame->name = symbol->name;
+    frame->module = mapping->path;
+  }
+}
+
+int perf_profiler_record_callchains(perf_profiler_t *profiler, uint16_t max_depth) {
+  if (profiler->stacks == NULL) {
+    profiler->stacks = (perf_stack_node_t *)malloc(sizeof(perf_stack_node_t) * PERF_PROFILER_INITIAL_STACKS);
+    profiler->stack_map = (uint32_t *)calloc(2 * PERF_PROFILER_INITIAL_STACKS, sizeof(uint32_t));
+    if (profiler->stacks == NULL || profiler->stack_map == NULL)
+      return PERF_ERROR_LIBRARY_FAILURE;
+
+    profiler->stacks_capacity = PERF_PROFILER_INITIAL_STACKS;
+    profiler->stack_map_mask = 2 * PERF_PROFILER_INITIAL_STACKS - 1;
+    memset((void *)profiler->stacks, 0, sizeof(perf_stack_node_t));
+    profiler->stacks_size = 1;
+  }
+
+  profiler->attribute.sample_type |= PERF_SAMPLE_CALLCHAIN;
+  profiler->attribute.sample_max_stack = max_depth;
+  // Kernel stacks can't be walked without being allowed to sample the kernel
+  if (profiler->attribute.exclude_kernel)
+    profiler->attribute.exclude_callchain_kernel = 1;
+
+  return 0;
+}
+
+int perf_profiler_record_addresses(perf_profiler_t *profiler) {
+  if (profiler->heatmap == NULL) {
+    profiler->heatmap = perf_create_heatmap();
+    if (profiler->heatmap == NULL)
+      return PERF_ERROR_LIBRARY_FAILURE;
+  }
+
+  profiler->attribute.sample_type |= PERF_SAMPLE_ADDR;
+  return 0;
+}
+
+static uint64_t perf_hash_stack_node(uint32_t parent, uint32_t kind, uint64_t address, const char *module) {
+  return ((address ^ perf_hash_string(module) ^ ((uint64_t)parent << 32) ^ kind) * 11400714819323198485llu) >> 32;
+}
+
+// Free the names of all nodes of the stack table but the root.
+static void perf_free_stack_names(perf_profiler_t *profiler) {
+  for (size_t i = 1; i < profiler->stacks_size; i++) {
+    free((void *)profiler->stacks[i].name);
+    free((void *)profiler->stacks[i].module);
+  }
+}
+
+// Grow the stack table and its map to twice their size.
+// Returns <0 if an error occured.
+static int perf_grow_stacks(perf_profiler_t *profiler) {
+  size_t capacity = 2 * profiler->stacks_capacity;
+  perf_stack_node_t *stacks = (perf_stack_node_t *)realloc(profiler->stacks, sizeof(perf_stack_node_t) * capacity);
+  if (stacks == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+  profiler->stacks = stacks;
+  profiler->stacks_capacity = capacity;
+
+  uint32_t *map = (uint32_t *)calloc(2 * capacity, sizeof(uint32_t));
+  if (map == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  size_t mask = 2 * capacity - 1;
+  for (size_t i = 1; i < profiler->stacks_size; i++) {
+    const perf_stack_node_t *node = &stacks[i];
+    uint64_t index = perf_hash_stack_node(node->parent, node->kind, node->address, node->module);
+    while (map[index & mask] != 0)
+      index++;
+    map[index & mask] = (uint32_t)i;
+  }
+
+  free((void *)profiler->stack_map);
+  profiler->stack_map = map;
+  profiler->stack_map_mask = mask;
+  return 0;
+}
+
+// Find the node of a frame called by parent, or add it. Frames are identified by their
+// address and module, as are the entries of the histogram.
+// Returns <0 if an error occured, the index of the node otherwise.
+static int64_t perf_intern_stack_node(perf_profiler_t *profiler, uint32_t parent, const perf_frame_t *frame) {
+  uint64_t index = perf_hash_stack_node(parent, frame->kind, frame->address, frame->module);
+  for (;; index++) {
+    uint32_t *entry = &profiler->stack_map[index & profiler->stack_map_mask];
+    if (*entry == 0)
+      break;
+
+    const perf_stack_node_t *node = &profiler->stacks[*entry];
+    if (node->parent == parent && node->kind == frame->kind && node->address == frame->address && strcmp(node->module, frame->module) == 0)
+      return *entry;
+  }
+
+  if (profiler->stacks_size == UINT32_MAX)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  if (profiler->stacks_size == profiler->stacks_capacity) {
+    if (perf_grow_stacks(profiler) < 0)
+      return PERF_ERROR_LIBRARY_FAILURE;
+    // The map was rebuilt, so find the free entry again
+    index = perf_hash_stack_node(parent, frame->kind, frame->address, frame->module);
+    while (profiler->stack_map[index & profiler->stack_map_mask] != 0)
+      index++;
+  }
+
+  uint32_t node_index = (uint32_t)profiler->stacks_size;
+  perf_stack_node_t *node = &profiler->stacks[node_index];
+  // Keep copies, as the symbols may be freed once their mapping disappears
+  node->name = strdup(frame->name);
+  node->module = strdup(frame->module);
+  if (node->name == NULL || node->module == NULL) {
+    free((void *)node->name);
+    free((void *)node->module);
+    return PERF_ERROR_LIBRARY_FAILURE;
+  }
+  node->parent = parent;
+  node->kind = frame->kind;
+  node->address = frame->address;
+  node->samples = 0;
+  profiler->stacks_size++;
+  profiler->stack_map[index & profiler->stack_map_mask] = node_index;
+  return node_index;
+}
+
+// Add the callchain of a sample to the stack table.
+// Returns <0 if an error occured.
+static int perf_profile_callchain(perf_profiler_t *profiler, const perf_sample_t *sample, int *updated) {
+  // The callchain lists the innermost frame first, interleaved with PERF_CONTEXT_ markers
+  size_t leaf = sample->callchain_length;
+  for (size_t i = 0; i < sample->callchain_length; i++) {
+    if (sample->callchain[i] < PERF_CONTEXT_MAX) {
+      leaf = i;
+      break;
+    }
+  }
+
+  uint32_t node = 0;
+  for (size_t i = sample->callchain_length; i-- > leaf;) {
+    uint64_t ip = sample->callchain[i];
+    if (ip >= PERF_CONTEXT_MAX)
+      continue;
+
+    // Callers are listed by their return address, which may lie past the end of
+    // the calling function. Resolve the call instruction instead
+    perf_frame_t frame;
+    perf_resolve_frame(profiler, i == leaf ? ip : ip - 1, updated, &frame);
+    int64_t index = perf_intern_stack_node(profiler, node, &frame);
+    if (index < 0)
+      return (int)index;
+    node = (uint32_t)index;
+  }
+
+  if (node != 0)
+    profiler->stacks[node].samples++;
+  return 0;
+}
+
+int perf_poll_profiler(perf_profiler_t *profiler) {
+  int added = 0;
+  int updated = 0;
+
+  for (size_t i = 0; i < profiler->cpus; i++) {
+    perf_ring_buffer_t *ring_buffer = profiler->ring_buffers[i];
+    perf_ring_buffer_begin_read(ring_buffer);
+    const struct perf_event_header *record;
+    while ((record = perf_ring_buffer_next(ring_buffer)) != NULL) {
+      if (record->type == PERF_RECORD_LOST) {
+        profiler->lost += ((const perf_record_lost_t *)record)->lost;
+        continue;
+      } else if (record->type != PERF_RECORD_SAMPLE) {
+        continue;
+      }
+
+      perf_sample_t sample;
+      if (perf_parse_sample(ring_buffer, record, &sample) < 0)
+        continue;
+
+      perf_frame_t frame;
+      perf_resolve_frame(profiler, sample.ip, &updated, &frame);
+      int status = perf_profile_add(profiler, frame.address, frame.name, frame.module);
+      if (status >= 0 && profiler->stacks != NULL && sample.callchain_length > 0)
+        status = perf_profile_callchain(profiler, &sample, &updated);
+      // Addresses within the zero page, such as of NULL dereferences, are left out of the heatmap
+      if (status >= 0 && profiler->heatmap != NULL && sample.addr >= profiler->heatmap->page_size)
+        status = perf_heatmap_add(profiler->heatmap, sample.addr, sample.ip);
+      if (status < 0) {
+        perf_ring_buffer_end_read(ring_buffer);
+        return status;
+      }
+
+      profiler->samples++;
+      added++;
+    }
+    perf_ring_buffer_end_read(ring_buffer);
+  }
+
+  return added;
+}
+
+void perf_reset_profiler(perf_profiler_t *profiler) {
+  for (size_t i = 0; i <= profiler->mask; i++) {
+    free((void *)profiler->entries[i].name);
+    free((void *)profiler->entries[i].module);
+  }
+
+  memset((void *)profiler->entries, 0, sizeof(perf_profile_entry_t) * (profiler->mask + 1));
+  profiler->size = 0;
+
+  if (profiler->stacks != NULL) {
+    perf_free_stack_names(profiler);
+    memset((void *)profiler->stack_map, 0, sizeof(uint32_t) * (profiler->stack_map_mask + 1));
+    profiler->stacks_size = 1;
+  }
+
+  if (profiler->heatmap != NULL)
+    perf_reset_heatmap(profiler->heatmap);
+
+  profiler->samples = 0;
+  profiler->lost = 0;
+}
+
+static int perf_compare_entries(const void *a, const void *b) {
+  const perf_profile_entry_t *first = *(const perf_profile_entry_t **)a;
+  const perf_profile_entry_t *second = *(const perf_profile_entry_t **)b;
+  if (first->samples != second->samples)
+    return first->samples > second->samples ? -1 : 1;
+  return strcmp(first->name, second->name);
+}
+
+int perf_print_profile(const perf_profiler_t *profiler, size_t top, FILE *output) {
+  const perf_profile_entry_t **sorted = (const perf_profile_entry_t **)malloc(sizeof(perf_profile_entry_t *) * (profiler->size + 1));
+  if (sorted == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  size_t count = 0;
+  for (size_t i = 0; i <= profiler->mask; i++) {
+    if (profiler->entries[i].name != NULL)
+      sorted[count++] = &profiler->entries[i];
+  }
+
+  qsort(sorted, count, sizeof(perf_profile_entry_t *), perf_compare_entries);
+  if (top == 0 || top > count)
+    top = count;
+
+  fprintf(output, "samples: %" PRIu64 ", lost: %" PRIu64 "\n", profiler->samples, profiler->lost);
+  fprintf(output, "        samples  percent  function\n");
+  for (size_t i = 0; i < top; i++) {
+    double percent = profiler->samples > 0 ? 100.0 * (double)sorted[i]->samples / (double)profiler->samples : 0;
+    fprintf(output, "%15" PRIu64 "%8.2f%%  %s (%s)\n", sorted[i]->samples, percent, sorted[i]->name, sorted[i]->module);
+  }
+
+  free((void *)sorted);
+  return 0;
+}
+
+// Write the name of a frame of the stack table.
+static void perf_write_frame(const perf_stack_node_t *node, FILE *output) {
+  // Name unresolved frames after their module, such as [libc.so.6]
+  if (node->kind == PERF_FRAME_MAPPING) {
+    const char *name = strrchr(node->module, '/');
+    fprintf(output, "[%s]", name != NULL ? name + 1 : node->module);
+    return;
+  }
+
+  fputs(node->name, output);
+}
+
+int perf_write_folded_stacks(perf_profiler_t *profiler, FILE *output) {
+  if (profiler->stacks == NULL)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  // A path can't be deeper than the number of nodes
+  uint32_t *path = (uint32_t *)malloc(sizeof(uint32_t) * profiler->stacks_size);
+  if (path == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  for (size_t i = 1; i < profiler->stacks_size; i++) {
+    const perf_stack_node_t *node = &profiler->stacks[i];
+    if (node->samples == 0)
+      continue;
+
+    size_t depth = 0;
+    for (uint32_t index = (uint32_t)i; index != 0; index = profiler->stacks[index].parent)
+      path[depth++] = index;
+
+    // Print the outermost frame first
+    while (depth-- > 0) {
+      perf_write_frame(&profiler->stacks[path[depth]], output);
+      if (depth > 0)
+        fputc(';', output);
+    }
+    fprintf(output, " %" PRIu64 "\n", node->samples);
+  }
+
+  free((void *)path);
+  return ferror(output) ? PERF_ERROR_IO : 0;
+}
+
+// Returns the time of a monotonic clock in milliseconds.
+static int64_t perf_milliseconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+int perf_live_profile(perf_profiler_t *profiler, size_t top, int interval, int duration, FILE *output) {
+  int64_t start = perf_milliseconds();
+  int64_t next_redraw = start + interval;
+  for (;;) {
+    int64_t now = perf_milliseconds();
+    if (duration > 0 && now - start >= duration)
+      return 0;
+
+    // Wake up early when the buffer is filling up, so that no samples are lost
+    int status = perf_profiler_wait(profiler, next_redraw > now ? (int)(next_redraw - now) : 0);
+    if (status < 0)
+      return status;
+
+    status = perf_poll_profiler(profiler);
+    if (status < 0)
+      return status;
+
+    if (perf_milliseconds() < next_redraw)
+      continue;
+    next_redraw += interval;
+
+    // Move the cursor home and clear the screen before redrawing
+    fprintf(output, "\033[H\033[2J");
+    status = perf_print_profile(profiler, top, output);
+    if (status < 0)
+      return status;
+    fflush(output);
+  }
+}
+
+void perf_free_profiler(perf_profiler_t *profiler) {
+  for (size_t i = 0; i < profiler->thread_measurements_size; i++) {
+    perf_close_measurement(profiler->thread_measurements[i]);
+    free((void *)profiler->thread_measurements[i]);
+  }
+  free((void *)profiler->thread_measurements);
+
+  // Always unmap a ring buffer before closing its measurement
+  for (size_t i = 0; i < profiler->cpus; i++) {
+    if (profiler->ring_buffers[i] != NULL)
+      perf_unmap_ring_buffer(profiler->ring_buffers[i]);
+    if (profiler->measurements[i]->file_descriptor >= 0)
+      perf_close_measurement(profiler->measurements[i]);
+    free((void *)profiler->measurements[i]);
+  }
+  free((void *)profiler->ring_buffers);
+  free((void *)profiler->measurements);
+
+  if (profiler->symbols != NULL)
+    perf_free_symbol_table(profiler->symbols);
+  if (profiler->kernel != NULL)
+    perf_free_mapping(profiler->kernel);
+  if (profiler->stacks != NULL)
+    perf_free_stack_names(profiler);
+  free((void *)profiler->stacks);
+  free((void *)profiler->stack_map);
+  if (profiler->heatmap != NULL)
+    perf_free_heatmap(profiler->heatmap);
+
+  if (profiler->entries != NULL) {
+    for (size_t i = 0; i <= profiler->mask; i++) {
+      free((void *)profiler->entries[i].name);
+      free((void *)profiler->entries[i].module);
+    }
+    free((void *)profiler->entries);
+  }
+
+  free((void *)profiler);
+}
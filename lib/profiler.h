@@ -0,0 +1,157 @@
+#ifndef PERF_PROFILER_H
+#define PERF_PROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "heatmap.h"
+#include "sampling.h"
+#include "symbols.h"
+#include "utilities.h"
+
+// The samples attributed to a single function.
+typedef struct {
+  // The address of the function. 0 for unresolved samples
+  uint64_t address;
+  // The name of the function. Owned by the profiler
+  char *name;
+  // The mapping the function belongs to, such as /usr/lib/libc.so.6 or [kernel]. Owned by the profiler
+  char *module;
+  // The number of samples
+  uint64_t samples;
+} perf_profile_entry_t;
+
+// The kind of a frame of a sampled callchain.
+typedef enum {
+  // A function of a mapping, identified by its address
+  PERF_FRAME_FUNCTION,
+  // An unresolved address within a mapping, identified by the start of the mapping
+  PERF_FRAME_MAPPING,
+  // A function of the kernel, identified by its address
+  PERF_FRAME_KERNEL,
+  // An address outside of any known mapping
+  PERF_FRAME_UNKNOWN,
+} perf_frame_kind_t;
+
+// A node of the stack table. A stack is the path from a node to the root, so
+// stacks sharing callers share nodes and each distinct stack is stored once.
+typedef struct {
+  // The index of the calling frame's node. 0 for the outermost frame
+  uint32_t parent;
+  // The kind of the frame, a perf_frame_kind_t
+  uint32_t kind;
+  // The address identifying the frame
+  uint64_t address;
+  // The name of the function and the path of the module, resolved when the node was
+  // added, so that nodes outlive the mappings they were resolved from. NULL for the root
+  char *name;
+  char *module;
+  // The number of samples whose stack ends at this node
+  uint64_t samples;
+} perf_stack_node_t;
+
+// A sampling profiler of the threads of the calling process, building a histogram per function.
+typedef struct {
+  // The attribute of the sampling measurements
+  perf_event_attr_t attribute;
+  // The number of CPUs sampled. The kernel only maps the buffer of an inherited
+  // event when it's bound to a CPU, so there is a measurement per CPU
+  size_t cpus;
+  // The sampling measurement and ring buffer of each CPU
+  perf_measurement_t **measurements;
+  perf_ring_buffer_t **ring_buffers;
+  // The sampling measurements of the other threads which existed when the profiler was
+  // opened, one per thread and CPU, writing their samples to the ring buffer of their CPU
+  size_t thread_measurements_size;
+  perf_measurement_t **thread_measurements;
+  // The mappings of the process, used to resolve sampled instruction pointers
+  perf_symbol_table_t *symbols;
+  // The histogram. Open addressing with linear probing, keyed by function address and module
+  size_t size;
+  size_t mask;
+  perf_profile_entry_t *entries;
+  // The stack table, used when recording callchains. Node 0 is the root. The
+  // map holds node indices, keyed by parent and frame. 0 marks an empty entry
+  size_t stacks_size;
+  size_t stacks_capacity;
+  perf_stack_node_t *stacks;
+  size_t stack_map_mask;
+  uint32_t *stack_map;
+  // The symbols of the kernel, loaded on the first kernel frame. NULL if not loaded or not available
+  perf_mapping_t *kernel;
+  int kernel_loaded;
+  // The sampled data addresses, when recording addresses. NULL otherwise
+  perf_heatmap_t *heatmap;
+  // The total number of samples
+  uint64_t samples;
+  // The number of samples lost due to a full ring buffer
+  uint64_t lost;
+} perf_profiler_t;
+
+// Create a profiler sampling the instruction pointer of every thread of the calling
+// process, including threads created after the profiler is opened, frequency times per
+// second of the event. type and config are typically PERF_TYPE_HARDWARE and
+// PERF_COUNT_HW_CPU_CYCLES or PERF_TYPE_SOFTWARE and PERF_COUNT_SW_TASK_CLOCK.
+// The attribute may be modified before the profiler is opened. Should be freed using perf_free_profiler.
+// Returns NULL if an error occured.
+perf_profiler_t *perf_create_profiler(int type, uint64_t config, uint64_t frequency);
+
+// Open the profiler on all online CPUs, mapping pages data pages per CPU. pages must be a power of two.
+// Threads which already exist, such as the workers of a long-running service, are found in
+// /proc/self/task and each get a measurement per CPU, so the profiler uses a file descriptor
+// per thread and CPU. Threads created by other threads while opening may be missed.
+// Returns <0 if an error occured.
+int perf_open_profiler(perf_profiler_t *profiler, size_t pages);
+
+// Record the callchain of each sample, up to max_depth frames, walked by the kernel
+// using frame pointers. Must be called before the profiler is opened. Code should be
+// built with -fno-omit-frame-pointer for user space stacks to be complete.
+// Returns <0 if an error occured.
+int perf_profiler_record_callchains(perf_profiler_t *profiler, uint16_t max_depth);
+
+// Record the data address of each sample into the profiler's heatmap, such as the faulting
+// address of PERF_COUNT_SW_PAGE_FAULTS samples. Must be called before the profiler is opened.
+// To see every fault rather than a frequency, set attribute.freq to 0 and attribute.sample_period to 1.
+// Returns <0 if an error occured.
+int perf_profiler_record_addresses(perf_profiler_t *profiler);
+
+// Start sampling.
+// Returns <0 if an error occured.
+int perf_start_profiler(const perf_profiler_t *profiler);
+
+// Stop sampling.
+// Returns <0 if an error occured.
+int perf_stop_profiler(const perf_profiler_t *profiler);
+
+// Wait until a ring buffer is filling up or the timeout (in milliseconds) passes.
+// Returns <0 if an error occured, 0 on timeout and 1 if data is available.
+int perf_profiler_wait(const perf_profiler_t *profiler, int timeout);
+
+// Move the samples written by the kernel into the histogram. Must be called often
+// enough for the ring buffer not to fill up.
+// Returns <0 if an error occured, the number of samples added otherwise.
+int perf_poll_profiler(perf_profiler_t *profiler);
+
+// Clear the histogram, the stack table and the heatmap, keeping the resolved symbols.
+void perf_reset_profiler(perf_profiler_t *profiler);
+
+// Print the top entries of the histogram, sorted by samples. A top of 0 prints all entries.
+// Returns <0 if an error occured.
+int perf_print_profile(const perf_profiler_t *profiler, size_t top, FILE *output);
+
+// Write the recorded callchains as folded stacks, one line per distinct stack with the
+// outermost frame first, such as "main;compute;sqrt 42". The output may be passed directly to flamegraph.pl.
+// Returns <0 if an error occured.
+int perf_write_folded_stacks(perf_profiler_t *profiler, FILE *output);
+
+// Poll and print the top entries every interval milliseconds, redrawing the terminal,
+// until duration milliseconds have passed. A duration of 0 runs indefinitely.
+// Typically run by a thread of its own while the profiled threads do their work.
+// Returns <0 if an error occured.
+int perf_live_profile(perf_profiler_t *profiler, size_t top, int interval, int duration, FILE *output);
+
+// Close and free the profiler.
+void perf_free_profiler(perf_profiler_t *profiler);
+
+#endif
@@ -0,0 +1,240 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "group.h"
+#include "recorder.h"
+#include "statistics.h"
+#include "utilities.h"
+
+// Called by each recording thread as it exits. The aggregator frees the state once drained.
+static void perf_recorder_thread_exit(void *state) {
+  perf_recorder_thread_t *thread = (perf_recorder_thread_t *)state;
+  __atomic_store_n(&thread->exited, 1, __ATOMIC_RELEASE);
+}
+
+static void perf_free_recorder_thread(perf_recorder_thread_t *thread) {
+  if (thread->group != NULL) {
+    perf_close_group(thread->group);
+    free((void *)thread->group);
+  }
+  free((void *)thread->records);
+  free((void *)thread);
+}
+
+perf_recorder_t *perf_create_recorder(const perf_group_t *prototype, size_t ring_capacity) {
+  if (ring_capacity == 0 || (ring_capacity & (ring_capacity - 1)) != 0)
+    return NULL;
+
+  perf_recorder_t *recorder = (perf_recorder_t *)malloc(sizeof(perf_recorder_t));
+  if (recorder == NULL)
+    return NULL;
+
+  memset((void *)recorder, 0, sizeof(perf_recorder_t));
+  recorder->ring_capacity = ring_capacity;
+
+  // The clone is never opened, it only describes the group of each thread
+  recorder->prototype = perf_clone_group(prototype, 0, -1);
+  recorder->statistics = perf_create_statistics(prototype->size);
+  if (recorder->prototype == NULL || recorder->statistics == NULL) {
+    free((void *)recorder->prototype);
+    free((void *)recorder->statistics);
+    free((void *)recorder);
+    return NULL;
+  }
+
+  if (pthread_key_create(&recorder->key, perf_recorder_thread_exit) != 0) {
+    free((void *)recorder->prototype);
+    free((void *)recorder->statistics);
+    free((void *)recorder);
+    return NULL;
+  }
+
+  pthread_mutex_init(&recorder->lock, NULL);
+  pthread_cond_init(&recorder->wake, NULL);
+
+  return recorder;
+}
+
+perf_recorder_thread_t *perf_recorder_thread(perf_recorder_t *recorder) {
+  perf_recorder_thread_t *thread = (perf_recorder_thread_t *)pthread_getspecific(recorder->key);
+  if (thread != NULL)
+    return thread;
+
+  // The state holds cache line aligned counters
+  if (posix_memalign((void **)&thread, 64, sizeof(perf_recorder_thread_t)) != 0)
+    return NULL;
+
+  memset((void *)thread, 0, sizeof(perf_recorder_thread_t));
+  thread->mask = recorder->ring_capacity - 1;
+  thread->records = (uint64_t *)malloc(sizeof(uint64_t) * (recorder->prototype->size * recorder->ring_capacity + 1));
+  thread->group = perf_clone_group(recorder->prototype, 0, -1);
+  if (thread->records == NULL || thread->group == NULL) {
+    perf_free_recorder_thread(thread);
+    return NULL;
+  }
+
+  if (perf_open_group(thread->group, 0) < 0) {
+    perf_free_recorder_thread(thread);
+    return NULL;
+  }
+
+  // Registration is the only time a recording thread takes the lock
+  pthread_mutex_lock(&recorder->lock);
+  thread->next = recorder->threads;
+  recorder->threads = thread;
+  pthread_mutex_unlock(&recorder->lock);
+
+  pthread_setspecific(recorder->key, thread);
+  return thread;
+}
+
+void perf_recorder_record(perf_recorder_thread_t *thread, const uint64_t *values) {
+  size_t size = thread->group->size;
+  uint64_t head = thread->head;
+  // The acquire pairs with the aggregator's release of tail, ensuring that a slot is
+  // no longer being read before it's overwritten
+  uint64_t tail = __atomic_load_n(&thread->tail, __ATOMIC_ACQUIRE);
+  if (head - tail > thread->mask) {
+    __atomic_store_n(&thread->dropped, thread->dropped + 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  memcpy((void *)&thread->records[(head & thread->mask) * size], (const void *)values, sizeof(uint64_t) * size);
+  // Publish the record only once it's written
+  __atomic_store_n(&thread->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int perf_recorder_end(perf_recorder_thread_t *thread) {
+  perf_stop_group(thread->group);
+  int status = perf_read_group(thread->group);
+  if (status < 0)
+    return status;
+
+  perf_recorder_record(thread, thread->group->values);
+  return 0;
+}
+
+// Drain all rings. The lock must be held.
+static uint64_t perf_drain_recorder_locked(perf_recorder_t *recorder) {
+  uint64_t drained = 0;
+  size_t size = recorder->prototype->size;
+
+  perf_recorder_thread_t **link = &recorder->threads;
+  while (*link != NULL) {
+    perf_recorder_thread_t *thread = *link;
+
+    // Once the thread has exited, its head is final
+    int exited = __atomic_load_n(&thread->exited, __ATOMIC_ACQUIRE);
+    uint64_t head = __atomic_load_n(&thread->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = thread->tail;
+    for (; tail < head; tail++)
+      perf_statistics_add(recorder->statistics, &thread->records[(tail & thread->mask) * size]);
+    drained += head - thread->tail;
+    __atomic_store_n(&thread->tail, tail, __ATOMIC_RELEASE);
+
+    if (exited) {
+      recorder->dropped += __atomic_load_n(&thread->dropped, __ATOMIC_RELAXED);
+      *link = thread->next;
+      perf_free_recorder_thread(thread);
+      continue;
+    }
+
+    link = &thread->next;
+  }
+
+  return drained;
+}
+
+uint64_t perf_drain_recorder(perf_recorder_t *recorder) {
+  pthread_mutex_lock(&recorder->lock);
+  uint64_t drained = perf_drain_recorder_locked(recorder);
+  pthread_mutex_unlock(&recorder->lock);
+  return drained;
+}
+
+static void *perf_recorder_aggregate(void *argument) {
+  perf_recorder_t *recorder = (perf_recorder_t *)argument;
+
+  pthread_mutex_lock(&recorder->lock);
+  while (recorder->running) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += recorder->interval / 1000;
+    deadline.tv_nsec += (long)(recorder->interval % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    // Sleeps without holding the lock, so threads may register meanwhile
+    pthread_cond_timedwait(&recorder->wake, &recorder->lock, &deadline);
+    perf_drain_recorder_locked(recorder);
+  }
+  pthread_mutex_unlock(&recorder->lock);
+
+  return NULL;
+}
+
+int perf_start_recorder(perf_recorder_t *recorder, int interval) {
+  pthread_mutex_lock(&recorder->lock);
+  if (recorder->running) {
+    pthread_mutex_unlock(&recorder->lock);
+    return PERF_ERROR_BAD_PARAMETERS;
+  }
+  recorder->running = 1;
+  recorder->interval = interval;
+  pthread_mutex_unlock(&recorder->lock);
+
+  if (pthread_create(&recorder->aggregator, NULL, perf_recorder_aggregate, recorder) != 0) {
+    recorder->running = 0;
+    return PERF_ERROR_LIBRARY_FAILURE;
+  }
+
+  return 0;
+}
+
+int perf_stop_recorder(perf_recorder_t *recorder) {
+  pthread_mutex_lock(&recorder->lock);
+  if (!recorder->running) {
+    pthread_mutex_unlock(&recorder->lock);
+    return PERF_ERROR_BAD_PARAMETERS;
+  }
+  recorder->running = 0;
+  pthread_cond_signal(&recorder->wake);
+  pthread_mutex_unlock(&recorder->lock);
+
+  if (pthread_join(recorder->aggregator, NULL) != 0)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  perf_drain_recorder(recorder);
+  return 0;
+}
+
+uint64_t perf_recorder_dropped(perf_recorder_t *recorder) {
+  pthread_mutex_lock(&recorder->lock);
+  uint64_t dropped = recorder->dropped;
+  for (const perf_recorder_thread_t *thread = recorder->threads; thread != NULL; thread = thread->next)
+    dropped += __atomic_load_n(&thread->dropped, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&recorder->lock);
+
+  return dropped;
+}
+
+void perf_free_recorder(perf_recorder_t *recorder) {
+  pthread_key_delete(recorder->key);
+
+  perf_recorder_thread_t *thread = recorder->threads;
+  while (thread != NULL) {
+    perf_recorder_thread_t *next = thread->next;
+    perf_free_recorder_thread(thread);
+    thread = next;
+  }
+
+  pthread_mutex_destroy(&recorder->lock);
+  pthread_cond_destroy(&recorder->wake);
+  free((void *)recorder->prototype);
+  free((void *)recorder->statistics);
+  free((void *)recorder);
+}
@@ -0,0 +1,99 @@
+#ifndef PERF_RECORDER_H
+#define PERF_RECORDER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "group.h"
+#include "statistics.h"
+
+// The state of a thread recording into a recorder. Owned by the recorder.
+typedef struct perf_recorder_thread {
+  // The group of the thread, measuring only the thread itself
+  perf_group_t *group;
+  // The thread's single producer, single consumer ring of recorded values. The
+  // thread only writes head, the aggregator only writes tail. They're kept on
+  // separate cache lines so that the two never contend
+  uint64_t head __attribute__((aligned(64)));
+  uint64_t tail __attribute__((aligned(64)));
+  // The number of records dropped because the ring was full. Only written by the thread
+  uint64_t dropped __attribute__((aligned(64)));
+  // Whether or not the thread has exited. Its state is freed once drained
+  int exited;
+  // The number of records of the ring minus one. The number of records is a power of two
+  uint64_t mask;
+  // The records, group->size values each
+  uint64_t *records;
+  // The next registered thread
+  struct perf_recorder_thread *next;
+} perf_recorder_thread_t;
+
+// Records measurements of many threads without locks, aggregating them in the background.
+typedef struct {
+  // The group cloned for each thread. Owned by the recorder
+  perf_group_t *prototype;
+  // The number of records of each thread's ring. Always a power of two
+  size_t ring_capacity;
+  // The statistics of all drained records, indexed by slot. Only safe to read
+  // while the aggregator is stopped, or while holding lock
+  perf_statistics_t *statistics;
+  // The number of records dropped by threads which have exited
+  uint64_t dropped;
+  // Guards the list of threads and the statistics. Never taken when recording
+  pthread_mutex_t lock;
+  // Signaled to wake the aggregator when stopping
+  pthread_cond_t wake;
+  // The registered threads
+  perf_recorder_thread_t *threads;
+  // The key of each thread's state
+  pthread_key_t key;
+  // The background aggregator
+  pthread_t aggregator;
+  int running;
+  // The interval of the aggregator in milliseconds
+  int interval;
+} perf_recorder_t;
+
+// Create a recorder for the members of a prototype group. The prototype is copied
+// and may be freed once the recorder is created. ring_capacity is the number of
+// records buffered per thread and must be a power of two. Should be freed using perf_free_recorder.
+// Returns NULL if an error occured.
+perf_recorder_t *perf_create_recorder(const perf_group_t *prototype, size_t ring_capacity);
+
+// Get the state of the calling thread, creating and opening its group on the first call.
+// Returns NULL if an error occured.
+perf_recorder_thread_t *perf_recorder_thread(perf_recorder_t *recorder);
+
+// Start measuring a region of the calling thread.
+#define perf_recorder_begin(thread) perf_start_group((thread)->group)
+
+// Stop measuring a region of the calling thread and record its values.
+// Returns <0 if an error occured.
+int perf_recorder_end(perf_recorder_thread_t *thread);
+
+// Record values of the calling thread, indexed by slot. Never blocks. If the
+// ring is full the values are dropped and counted.
+void perf_recorder_record(perf_recorder_thread_t *thread, const uint64_t *values);
+
+// Drain the rings of all threads into the statistics and free the state of exited threads.
+// Called periodically by the aggregator, but may be called at any time.
+// Returns the number of drained records.
+uint64_t perf_drain_recorder(perf_recorder_t *recorder);
+
+// Start the background aggregator, draining all rings every interval milliseconds.
+// Returns <0 if an error occured.
+int perf_start_recorder(perf_recorder_t *recorder, int interval);
+
+// Stop the background aggregator and drain all rings a final time.
+// Returns <0 if an error occured.
+int perf_stop_recorder(perf_recorder_t *recorder);
+
+// Returns the number of dropped records of all threads.
+uint64_t perf_recorder_dropped(perf_recorder_t *recorder);
+
+// Free the recorder and the state of all threads. The aggregator must be stopped
+// and threads must no longer record.
+void perf_free_recorder(perf_recorder_t *recorder);
+
+#endif
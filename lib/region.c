@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "group.h"
+#include "off_cpu.h"
+#include "region.h"
+#include "statistics.h"
+#include "utilities.h"
+
+// The bounds of the perf_regions section, provided by the linker. Weak so that
+// programs defining no regions still link
+extern perf_region_t *const __start_perf_regions[] __attribute__((weak));
+extern perf_region_t *const __stop_perf_regions[] __attribute__((weak));
+
+// The group read when entering and exiting regions. NULL if not opened
+static perf_group_t *perf_regions_group = NULL;
+// Set on the thread which opened the regions. The group only counts that thread, and the
+// state below is only ever touched by it, so regions reached by other threads are ignored
+static _Thread_local int perf_regions_owner = 0;
+// The entered regions and the values read when entering them, group->size values each
+static perf_region_t *perf_regions_stack[PERF_REGION_MAX_DEPTH];
+static uint64_t *perf_regions_values = NULL;
+static size_t perf_regions_depth = 0;
+// The number of entered regions beyond PERF_REGION_MAX_DEPTH, which are not measured
+static size_t perf_regions_overflow = 0;
+// The off-CPU tracker and its state when entering each region. NULL if not tracking off-CPU time
+static perf_off_cpu_t *perf_regions_off_cpu = NULL;
+static perf_off_cpu_snapshot_t perf_regions_snapshots[PERF_REGION_MAX_DEPTH];
+
+perf_region_t *const *perf_list_regions(size_t *count) {
+  if (__start_perf_regions == NULL || __stop_perf_regions == NULL) {
+    *count = 0;
+    return NULL;
+  }
+
+  *count = (size_t)(__stop_perf_regions - __start_perf_regions);
+  return __start_perf_regions;
+}
+
+int perf_open_regions(perf_group_t *group) {
+  if (perf_regions_group != NULL)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  // Holds the values of each nesting level, and the values of the exit as the last level
+  perf_regions_values = (uint64_t *)malloc(sizeof(uint64_t) * group->size * (PERF_REGION_MAX_DEPTH + 1));
+  if (perf_regions_values == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  size_t count;
+  perf_region_t *const *regions = perf_list_regions(&count);
+  for (size_t i = 0; i < count; i++) {
+    regions[i]->statistics = perf_create_statistics(group->size);
+    if (regions[i]->statistics == NULL) {
+      perf_close_regions();
+      return PERF_ERROR_LIBRARY_FAILURE;
+    }
+  }
+
+  // Started once, the counters are never reset
+  perf_start_group(group);
+
+  perf_regions_depth = 0;
+  perf_regions_overflow = 0;
+  perf_regions_group = group;
+  perf_regions_owner = 1;
+  return 0;
+}
+
+int perf_regions_track_off_cpu(perf_off_cpu_t *tracker) {
+  if (perf_regions_group == NULL || perf_regions_off_cpu != NULL)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  size_t count;
+  perf_region_t *const *regions = perf_list_regions(&count);
+  for (size_t i = 0; i < count; i++) {
+    regions[i]->off_cpu = perf_create_statistics(PERF_OFF_CPU_VALUES);
+    if (regions[i]->off_cpu == NULL) {
+      for (size_t j = 0; j < i; j++) {
+        free((void *)regions[j]->off_cpu);
+        regions[j]->off_cpu = NULL;
+      }
+      return PERF_ERROR_LIBRARY_FAILURE;
+    }
+  }
+
+  perf_regions_off_cpu = tracker;
+  return 0;
+}
+
+void perf_region_enter(perf_region_t *region) {
+  if (!perf_regions_owner || perf_regions_group == NULL)
+    return;
+
+  if (perf_regions_depth == PERF_REGION_MAX_DEPTH || region->statistics == NULL) {
+    perf_regions_overflow++;
+    return;
+  }
+
+  if (perf_read_group(perf_regions_group) < 0) {
+    perf_regions_overflow++;
+    return;
+  }
+
+  size_t size = perf_regions_group->size;
+  memcpy((void *)&perf_regions_values[perf_regions_depth * size], (const void *)perf_regions_group->values, sizeof(uint64_t) * size);
+  if (perf_regions_off_cpu != NULL)
+    perf_off_cpu_snapshot(perf_regions_off_cpu, &perf_regions_snapshots[perf_regions_depth]);
+  perf_regions_stack[perf_regions_depth++] = region;
+}
+
+int perf_region_exit(const char *name) {
+  if (!perf_regions_owner || perf_regions_group == NULL)
+    return 0;
+
+  // Pair the exit with an entry which was not measured
+  if (perf_regions_overflow > 0) {
+    perf_regions_overflow--;
+    return 0;
+  }
+
+  if (perf_regions_depth == 0)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  // Leave the stack as is on a mismatch, so that the matching exit still finds its region
+  perf_region_t *region = perf_regions_stack[perf_regions_depth - 1];
+  if (strcmp(region->name, name) != 0)
+    return PERF_ERROR_BAD_PARAMETERS;
+  perf_regions_depth--;
+
+  int status = perf_read_group(perf_regions_group);
+  if (status < 0)
+    return status;
+
+  size_t size = perf_regions_group->size;
+  const uint64_t *entered = &perf_regions_values[perf_regions_depth * size];
+  uint64_t *deltas = &perf_regions_values[PERF_REGION_MAX_DEPTH * size];
+  for (size_t i = 0; i < size; i++)
+    deltas[i] = perf_regions_group->values[i] - entered[i];
+
+  perf_statistics_add(region->statistics, deltas);
+
+  if (perf_regions_off_cpu != NULL && region->off_cpu != NULL) {
+    uint64_t times[PERF_OFF_CPU_VALUES];
+    perf_off_cpu_since(perf_regions_off_cpu, &perf_regions_snapshots[perf_regions_depth], times);
+    perf_statistics_add(region->off_cpu, times);
+  }
+  return 0;
+}
+
+void perf_region_leave(perf_region_t **region) {
+  perf_region_exit((*region)->name);
+}
+
+void perf_print_regions(FILE *output) {
+  if (perf_regions_group == NULL)
+    return;
+
+  size_t count;
+  perf_region_t *const *regions = perf_list_regions(&count);
+  for (size_t i = 0; i < count; i++) {
+    const perf_region_t *region = regions[i];
+    if (region->statistics == NULL || region->statistics->size == 0 || region->statistics->events[0].count == 0)
+      continue;
+
+    fprintf(output, "%s (%s:%d)\n", region->name, region->file, region->line);
+    perf_print_statistics(region->statistics, perf_regions_group->names, output);
+    if (region->off_cpu != NULL)
+      perf_print_statistics(region->off_cpu, perf_off_cpu_names, output);
+    fprintf(output, "\n");
+  }
+}
+
+void perf_close_regions() {
+  if (perf_regions_group != NULL)
+    perf_stop_group(perf_regions_group);
+
+  size_t count;
+  perf_region_t *const *regions = perf_list_regions(&count);
+  for (size_t i = 0; i < count; i++) {
+    free((void *)regions[i]->statistics);
+    regions[i]->statistics = NULL;
+    free((void *)regions[i]->off_cpu);
+    regions[i]->off_cpu = NULL;
+  }
+
+  free((void *)perf_regions_values);
+  perf_regions_values = NULL;
+  perf_regions_group = NULL;
+  perf_regions_off_cpu = NULL;
+  perf_regions_owner = 0;
+}
@@ -0,0 +1,106 @@
+#ifndef PERF_REGION_H
+#define PERF_REGION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "group.h"
+#include "off_cpu.h"
+#include "statistics.h"
+
+// The maximum number of nested regions. Regions nested deeper are not measured
+#define PERF_REGION_MAX_DEPTH 64
+
+// A named region of code. Regions are defined statically by the PERF_REGION_* macros
+// and registered in the perf_regions section at link time, so that all regions of
+// a program are known without any registration at runtime.
+typedef struct {
+  // The name of the region, such as "parse"
+  const char *name;
+  // Where the region is defined
+  const char *file;
+  int line;
+  // The statistics of the region, indexed by slot of the region group. NULL until the regions are opened
+  perf_statistics_t *statistics;
+  // The wall, on-CPU and off-CPU time and off-CPU intervals of the region, indexed by
+  // PERF_OFF_CPU_ slot. NULL unless tracking off-CPU time
+  perf_statistics_t *off_cpu;
+} perf_region_t;
+
+// Start measuring regions of the calling thread using an opened group. The group is
+// started once and never reset. Entering and exiting a region reads the cumulative
+// values of the group, so regions may nest and the values of a region include those
+// of the regions nested within it. Only the thread which opened the regions is measured,
+// regions entered and exited by other threads are ignored.
+// Returns <0 if an error occured.
+int perf_open_regions(perf_group_t *group);
+
+// Also track the wall, on-CPU and off-CPU time of regions using an opened tracker of the
+// thread which opened the regions. Must be called after perf_open_regions. The tracker is not owned.
+// Returns <0 if an error occured.
+int perf_regions_track_off_cpu(perf_off_cpu_t *tracker);
+
+// Enter a region, reading the current values of the region group. Does nothing if
+// the regions are not opened or if called by another thread than the one which opened them.
+void perf_region_enter(perf_region_t *region);
+
+// Exit the innermost region, adding the values counted since it was entered to its statistics.
+// Does nothing if called by another thread than the one which opened the regions.
+// Returns <0 if an error occured or if name does not match the innermost region, which is then not exited.
+int perf_region_exit(const char *name);
+
+// Exit the region of a scoped variable. Used as a cleanup function by PERF_REGION_SCOPED.
+void perf_region_leave(perf_region_t **region);
+
+// Get all regions of the program.
+// Returns the regions, count is set to their number.
+perf_region_t *const *perf_list_regions(size_t *count);
+
+// Print the statistics of all entered regions.
+void perf_print_regions(FILE *output);
+
+// Stop measuring regions and free their statistics. The group is stopped, but not closed,
+// and the off-CPU tracker is left open. Must be called by the thread which opened the regions.
+void perf_close_regions();
+
+#ifdef PERF_REGIONS_DISABLED
+
+// Regions compile to nothing
+#define PERF_REGION_BEGIN(name)
+#define PERF_REGION_END(name)
+#define PERF_REGION_SCOPED(name)
+
+#else
+
+#define PERF_REGION_CONCAT_(a, b) a##b
+#define PERF_REGION_CONCAT(a, b) PERF_REGION_CONCAT_(a, b)
+
+// Define a static region and register it in the perf_regions section
+#define PERF_REGION_DEFINE(variable, region_name)                                              \
+  static perf_region_t variable = {region_name, __FILE__, __LINE__, NULL, NULL};                     \
+  static perf_region_t *const PERF_REGION_CONCAT(variable, _entry)                             \
+      __attribute__((section("perf_regions"), used)) = &variable
+
+// Enter a region named name, a string literal. Must be followed by PERF_REGION_END
+// with the same name, in the same thread.
+#define PERF_REGION_BEGIN(name)                                                                \
+  do {                                                                                         \
+    PERF_REGION_DEFINE(perf_region, name);                                                     \
+    perf_region_enter(&perf_region);                                                           \
+  } while (0)
+
+// Exit the region named name.
+#define PERF_REGION_END(name) perf_region_exit(name)
+
+// Enter a region named name, exiting it when the enclosing scope ends.
+#define PERF_REGION_SCOPED(name)                                                               \
+  PERF_REGION_DEFINE(PERF_REGION_CONCAT(perf_region_, __LINE__), name);                        \
+  perf_region_t *PERF_REGION_CONCAT(perf_region_scope_, __LINE__)                              \
+      __attribute__((cleanup(perf_region_leave))) =                                            \
+          (perf_region_enter(&PERF_REGION_CONCAT(perf_region_, __LINE__)),                     \
+           &PERF_REGION_CONCAT(perf_region_, __LINE__))
+
+#endif
+
+#endif
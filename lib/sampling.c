@@ -0,0 +1,248 @@
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "perf.h"
+#include "sampling.h"
+#include "utilities.h"
+
+perf_measurement_t *perf_create_sampling_measurement(int type, uint64_t config, pid_t pid, int cpu, uint64_t period, uint64_t sample_type) {
+  perf_measurement_t *measurement = perf_create_measurement(type, config, pid, cpu);
+  if (measurement == NULL)
+    return NULL;
+
+  measurement->attribute.sample_period = period;
+  measurement->attribute.sample_type = sample_type;
+  // Wake up any waiting reader for every written sample
+  measurement->attribute.wakeup_events = 1;
+
+  return measurement;
+}
+
+perf_ring_buffer_t *perf_map_ring_buffer(const perf_measurement_t *measurement, size_t pages) {
+  // The kernel requires 2^n data pages
+  if (pages == 0 || (pages & (pages - 1)) != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (page_size < 0)
+    return NULL;
+
+  perf_ring_buffer_t *ring_buffer = (perf_ring_buffer_t *)malloc(sizeof(perf_ring_buffer_t));
+  if (ring_buffer == NULL)
+    return NULL;
+
+  memset((void *)ring_buffer, 0, sizeof(perf_ring_buffer_t));
+
+  // The mapping is one metadata page followed by the data pages. The mapping is
+  // writable so that the kernel respects data_tail and never overwrites unread records
+  size_t mapped_size = (pages + 1) * page_size;
+  void *base = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, measurement->file_descriptor, 0);
+  if (base == MAP_FAILED) {
+    free((void *)ring_buffer);
+    return NULL;
+  }
+
+  ring_buffer->file_descriptor = measurement->file_descriptor;
+  ring_buffer->metadata = (struct perf_event_mmap_page *)base;
+  ring_buffer->data = (uint8_t *)base + page_size;
+  ring_buffer->data_size = pages * page_size;
+  ring_buffer->mapped_size = mapped_size;
+  ring_buffer->sample_type = measurement->attribute.sample_type;
+  ring_buffer->read_format = measurement->attribute.read_format;
+
+  // Linux 4.1 and newer state the data area explicitly
+  if (ring_buffer->metadata->data_offset != 0) {
+    ring_buffer->data = (uint8_t *)base + ring_buffer->metadata->data_offset;
+    ring_buffer->data_size = ring_buffer->metadata->data_size;
+  }
+
+  ring_buffer->tail = ring_buffer->metadata->data_tail;
+  ring_buffer->head = ring_buffer->tail;
+
+  return ring_buffer;
+}
+
+int perf_ring_buffer_wait(const perf_ring_buffer_t *ring_buffer, int timeout) {
+  struct pollfd descriptor = {ring_buffer->file_descriptor, POLLIN, 0};
+  int status = poll(&descriptor, 1, timeout);
+  if (status < 0)
+    return PERF_ERROR_IO;
+
+  return status > 0 ? 1 : 0;
+}
+
+uint64_t perf_ring_buffer_begin_read(perf_ring_buffer_t *ring_buffer) {
+  // The acquire pairs with the kernel's write barrier, ensuring that the records
+  // before head are visible before they're read
+  ring_buffer->head = __atomic_load_n(&ring_buffer->metadata->data_head, __ATOMIC_ACQUIRE);
+  return ring_buffer->head - ring_buffer->tail;
+}
+
+const struct perf_event_header *perf_ring_buffer_next(perf_ring_buffer_t *ring_buffer) {
+  if (ring_buffer->tail >= ring_buffer->head)
+    return NULL;
+
+  // Records are 8-byte aligned, so the header itself never wraps
+  uint64_t offset = ring_buffer->tail & (ring_buffer->data_size - 1);
+  const struct perf_event_header *header = (const struct perf_event_header *)(ring_buffer->data + offset);
+
+  // Guard against a corrupt size, which would otherwise stall the reader forever
+  if (header->size < sizeof(struct perf_event_header)) {
+    ring_buffer->tail = ring_buffer->head;
+    return NULL;
+  }
+
+  ring_buffer->tail += header->size;
+
+  if (offset + header->size <= ring_buffer->data_size)
+    return header;
+
+  // The record wraps around the end of the buffer - stitch it together
+  uint64_t first_part = ring_buffer->data_size - offset;
+  memcpy(ring_buffer->scratch, ring_buffer->data + offset, first_part);
+  memcpy(ring_buffer->scratch + first_part, ring_buffer->data, header->size - first_part);
+  return (const struct perf_event_header *)ring_buffer->scratch;
+}
+
+void perf_ring_buffer_end_read(perf_ring_buffer_t *ring_buffer) {
+  // The release ensures that all reads of the records are done before the kernel
+  // may reuse the space
+  __atomic_store_n(&ring_buffer->metadata->data_tail, ring_buffer->tail, __ATOMIC_RELEASE);
+}
+
+// Returns the number of 64-bit words of a PERF_SAMPLE_READ value.
+static uint64_t perf_read_format_words(uint64_t read_format, const uint64_t *read) {
+  uint64_t per_value = 1;
+  if (read_format & PERF_FORMAT_ID)
+    per_value++;
+  if (read_format & PERF_FORMAT_LOST)
+    per_value++;
+
+  uint64_t times = 0;
+  if (read_format & PERF_FORMAT_TOTAL_TIME_ENABLED)
+    times++;
+  if (read_format & PERF_FORMAT_TOTAL_TIME_RUNNING)
+    times++;
+
+  // { nr, [time_enabled], [time_running], { value, [id], [lost] } * nr }
+  if (read_format & PERF_FORMAT_GROUP)
+    return 1 + times + read[0] * per_value;
+
+  // { value, [time_enabled], [time_running], [id], [lost] }
+  return times + per_value;
+}
+
+int perf_parse_sample(const perf_ring_buffer_t *ring_buffer, const struct perf_event_header *record, perf_sample_t *sample) {
+  if (record->type != PERF_RECORD_SAMPLE)
+    return PERF_ERROR_BAD_PARAMETERS;
+
+  memset((void *)sample, 0, sizeof(perf_sample_t));
+
+  uint64_t sample_type = ring_buffer->sample_type;
+  const uint64_t *current = (const uint64_t *)(record + 1);
+  const uint64_t *end = (const uint64_t *)((const uint8_t *)record + record->size);
+
+// Fail instead of reading past the record if the sample type doesn't match the record
+#define ENSURE_WORDS(words)          \
+  do {                               \
+    if (current + (words) > end)     \
+      return PERF_ERROR_NOT_SUPPORTED; \
+  } while (0)
+
+  // Fields are laid out in the order of the PERF_SAMPLE_ bits.
+  // See: https://man7.org/linux/man-pages/man2/perf_event_open.2.html
+  if (sample_type & PERF_SAMPLE_IDENTIFIER) {
+    ENSURE_WORDS(1);
+    sample->identifier = *current++;
+  }
+
+  if (sample_type & PERF_SAMPLE_IP) {
+    ENSURE_WORDS(1);
+    sample->ip = *current++;
+  }
+
+  if (sample_type & PERF_SAMPLE_TID) {
+    ENSURE_WORDS(1);
+    const uint32_t *words = (const uint32_t *)current++;
+    sample->pid = words[0];
+    sample->tid = words[1];
+  }
+
+  if (sample_type & PERF_SAMPLE_TIME) {
+    ENSURE_WORDS(1);
+    sample->time = *current++;
+  }
+
+  if (sample_type & PERF_SAMPLE_ADDR) {
+    ENSURE_WORDS(1);
+    sample->addr = *current++;
+  }
+
+  if (sample_type & PERF_SAMPLE_ID) {
+    ENSURE_WORDS(1);
+    sample->id = *current++;
+  }
+
+  if (sample_type & PERF_SAMPLE_STREAM_ID) {
+    ENSURE_WORDS(1);
+    sample->stream_id = *current++;
+  }
+
+  if (sample_type & PERF_SAMPLE_CPU) {
+    ENSURE_WORDS(1);
+    const uint32_t *words = (const uint32_t *)current++;
+    sample->cpu = words[0];
+  }
+
+  if (sample_type & PERF_SAMPLE_PERIOD) {
+    ENSURE_WORDS(1);
+    sample->period = *current++;
+  }
+
+  if (sample_type & PERF_SAMPLE_READ) {
+    ENSURE_WORDS(1);
+    uint64_t words = perf_read_format_words(ring_buffer->read_format, current);
+    ENSURE_WORDS(words);
+    sample->read = current;
+    current += words;
+  }
+
+  if (sample_type & PERF_SAMPLE_CALLCHAIN) {
+    ENSURE_WORDS(1);
+    sample->callchain_length = *current++;
+    ENSURE_WORDS(sample->callchain_length);
+    sample->callchain = current;
+    current += sample->callchain_length;
+  }
+
+  if (sample_type & PERF_SAMPLE_RAW) {
+    // { u32 size; char data[size]; } padded to 8 bytes, including the size
+    ENSURE_WORDS(1);
+    sample->raw_size = *(const uint32_t *)current;
+    sample->raw = (const uint8_t *)current + sizeof(uint32_t);
+    uint64_t words = (sizeof(uint32_t) + sample->raw_size + 7) / 8;
+    ENSURE_WORDS(words);
+    current += words;
+  }
+
+#undef ENSURE_WORDS
+
+  // Any later fields (branch stacks, registers etc.) are left undecoded
+  return 0;
+}
+
+int perf_unmap_ring_buffer(perf_ring_buffer_t *ring_buffer) {
+  int status = munmap((void *)ring_buffer->metadata, ring_buffer->mapped_size);
+  free((void *)ring_buffer);
+  if (status < 0)
+    return PERF_ERROR_IO;
+
+  return 0;
+}
@@ -0,0 +1,110 @@
+#ifndef PERF_SAMPLING_H
+#define PERF_SAMPLING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "perf.h"
+#include "utilities.h"
+
+// The largest possible record. The size of a record is stored as a 16-bit value
+#define PERF_RING_BUFFER_MAX_RECORD_SIZE (1 << 16)
+
+typedef struct {
+  // The file descriptor of the mapped measurement
+  int file_descriptor;
+  // The first page of the mapping, holding the ring buffer's head and tail
+  struct perf_event_mmap_page *metadata;
+  // The start of the data area, directly following the metadata page
+  uint8_t *data;
+  // The size of the data area in bytes. Always a power of two
+  uint64_t data_size;
+  // The size of the entire mapping in bytes
+  size_t mapped_size;
+  // The head as of the last call to perf_ring_buffer_begin_read
+  uint64_t head;
+  // The position of the next record to read
+  uint64_t tail;
+  // The sample type and read format of the measurement, used to decode samples
+  uint64_t sample_type;
+  uint64_t read_format;
+  // Storage for a record wrapping around the end of the data area. Allocated once
+  // so that no record requires an allocation
+  uint8_t scratch[PERF_RING_BUFFER_MAX_RECORD_SIZE];
+} perf_ring_buffer_t;
+
+// A decoded PERF_RECORD_SAMPLE. Fields not requested in the sample type are zero.
+// Pointers point into the record and are only valid until perf_ring_buffer_end_read.
+typedef struct {
+  uint64_t identifier;
+  uint64_t ip;
+  uint32_t pid;
+  uint32_t tid;
+  uint64_t time;
+  uint64_t addr;
+  uint64_t id;
+  uint64_t stream_id;
+  uint32_t cpu;
+  uint64_t period;
+  // The raw PERF_SAMPLE_READ values, laid out according to the read format
+  const uint64_t *read;
+  // The number of instruction pointers in the callchain, including PERF_CONTEXT_ markers
+  uint64_t callchain_length;
+  const uint64_t *callchain;
+  uint32_t raw_size;
+  const void *raw;
+} perf_sample_t;
+
+// The layout of a PERF_RECORD_LOST record, excluding any trailing sample_id.
+typedef struct {
+  struct perf_event_header header;
+  uint64_t id;
+  uint64_t lost;
+} perf_record_lost_t;
+
+// The layout of a PERF_RECORD_THROTTLE or PERF_RECORD_UNTHROTTLE record,
+// excluding any trailing sample_id.
+typedef struct {
+  struct perf_event_header header;
+  uint64_t time;
+  uint64_t id;
+  uint64_t stream_id;
+} perf_record_throttle_t;
+
+// Create a sampling measurement. Should be freed.
+// A sample is written every period events. See perf_create_measurement for pid and cpu.
+// sample_type is a mask of PERF_SAMPLE_ values.
+// Returns NULL if an error occured.
+perf_measurement_t *perf_create_sampling_measurement(int type, uint64_t config, pid_t pid, int cpu, uint64_t period, uint64_t sample_type);
+
+// Map the ring buffer of an opened measurement. Should be unmapped using perf_unmap_ring_buffer.
+// pages is the number of data pages and must be a power of two.
+// Returns NULL if an error occured. Use errno to gather more information.
+perf_ring_buffer_t *perf_map_ring_buffer(const perf_measurement_t *measurement, size_t pages);
+
+// Wait until the kernel signals that data is available or the timeout (in milliseconds) passes.
+// A timeout of -1 waits indefinitely.
+// Returns <0 if an error occured, 0 on timeout and 1 if data is available.
+int perf_ring_buffer_wait(const perf_ring_buffer_t *ring_buffer, int timeout);
+
+// Take a snapshot of the records written by the kernel.
+// Returns the number of bytes available for reading.
+uint64_t perf_ring_buffer_begin_read(perf_ring_buffer_t *ring_buffer);
+
+// Get the next record of the snapshot, without copying it unless it wraps around the end of the buffer.
+// The record is valid until the next call to perf_ring_buffer_next or perf_ring_buffer_end_read.
+// Returns NULL when all records of the snapshot have been read.
+const struct perf_event_header *perf_ring_buffer_next(perf_ring_buffer_t *ring_buffer);
+
+// Hand the space of all read records back to the kernel.
+void perf_ring_buffer_end_read(perf_ring_buffer_t *ring_buffer);
+
+// Decode a PERF_RECORD_SAMPLE record in place.
+// Returns <0 if an error occured.
+int perf_parse_sample(const perf_ring_buffer_t *ring_buffer, const struct perf_event_header *record, perf_sample_t *sample);
+
+// Unmap and free a ring buffer.
+// Returns <0 if an error occured.
+int perf_unmap_ring_buffer(perf_ring_buffer_t *ring_buffer);
+
+#endif
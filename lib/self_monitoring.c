@@ -0,0 +1,99 @@
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "perf.h"
+#include "self_monitoring.h"
+#include "utilities.h"
+
+// Large enough for a group read of 170 members including times and ids
+#define PERF_SELF_MONITOR_READ_WORDS 512
+
+perf_self_monitor_t *perf_map_self_monitor(const perf_measurement_t *measurement) {
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (page_size < 0)
+    return NULL;
+
+  perf_self_monitor_t *monitor = (perf_self_monitor_t *)malloc(sizeof(perf_self_monitor_t));
+  if (monitor == NULL)
+    return NULL;
+
+  memset((void *)monitor, 0, sizeof(perf_self_monitor_t));
+
+  // Only the metadata page is required for reading the counter
+  void *base = mmap(NULL, page_size, PROT_READ, MAP_SHARED, measurement->file_descriptor, 0);
+  if (base == MAP_FAILED) {
+    free((void *)monitor);
+    return NULL;
+  }
+
+  monitor->measurement = measurement;
+  monitor->metadata = (struct perf_event_mmap_page *)base;
+  monitor->mapped_size = page_size;
+
+  // The counter is left running - measurements are taken as deltas
+  if (ioctl(measurement->file_descriptor, PERF_EVENT_IOC_ENABLE, 0) < 0) {
+    munmap(base, page_size);
+    free((void *)monitor);
+    return NULL;
+  }
+
+  return monitor;
+}
+
+int perf_self_monitor_is_userspace(const perf_self_monitor_t *monitor) {
+#if PERF_HAS_RDPMC
+  return monitor->metadata->cap_user_rdpmc && monitor->metadata->index != 0 ? 1 : 0;
+#else
+  return 0;
+#endif
+}
+
+uint64_t perf_self_monitor_read_syscall(const perf_self_monitor_t *monitor) {
+  const perf_measurement_t *measurement = monitor->measurement;
+  uint64_t read_format = measurement->attribute.read_format;
+
+  uint64_t buffer[PERF_SELF_MONITOR_READ_WORDS];
+  ssize_t bytes = read(measurement->file_descriptor, buffer, sizeof(buffer));
+  if (bytes < (ssize_t)sizeof(uint64_t))
+    return 0;
+
+  uint64_t times = 0;
+  if (read_format & PERF_FORMAT_TOTAL_TIME_ENABLED)
+    times++;
+  if (read_format & PERF_FORMAT_TOTAL_TIME_RUNNING)
+    times++;
+
+  // { value, [time_enabled], [time_running], [id] }
+  if (!(read_format & PERF_FORMAT_GROUP))
+    return buffer[0];
+
+  // { nr, [time_enabled], [time_running], { value, [id] } * nr }
+  uint64_t words = (uint64_t)bytes / sizeof(uint64_t);
+  if (!(read_format & PERF_FORMAT_ID))
+    return words > 1 + times ? buffer[1 + times] : 0;
+
+  // The measurement may be part of a group - find its value
+  for (uint64_t i = 1 + times; i + 1 < words; i += 2) {
+    if (buffer[i + 1] == measurement->id)
+      return buffer[i];
+  }
+
+  return 0;
+}
+
+int perf_unmap_self_monitor(perf_self_monitor_t *monitor) {
+  int status = 0;
+  if (ioctl(monitor->measurement->file_descriptor, PERF_EVENT_IOC_DISABLE, 0) < 0)
+    status = PERF_ERROR_IO;
+
+  if (munmap((void *)monitor->metadata, monitor->mapped_size) < 0)
+    status = PERF_ERROR_IO;
+
+  free((void *)monitor);
+  return status;
+}
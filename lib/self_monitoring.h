@@ -0,0 +1,101 @@
+#ifndef PERF_SELF_MONITORING_H
+#define PERF_SELF_MONITORING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "perf.h"
+#include "utilities.h"
+
+// Self-monitoring reads a counter of the calling thread in userspace, using the
+// rdpmc instruction and the event's metadata page instead of ioctl and read.
+// The counter is enabled once and then left running. Measurements are taken as
+// the difference between two reads, so a start / stop pair costs tens of cycles
+// rather than three syscalls.
+// See: https://man7.org/linux/man-pages/man2/perf_event_open.2.html (the mmap layout)
+
+typedef struct {
+  // The mapped measurement
+  const perf_measurement_t *measurement;
+  // The metadata page of the measurement
+  struct perf_event_mmap_page *metadata;
+  // The size of the mapping in bytes
+  size_t mapped_size;
+  // The counter value as of the last call to perf_self_monitor_start
+  uint64_t start;
+} perf_self_monitor_t;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PERF_HAS_RDPMC 1
+// Read the performance-monitoring counter with the specified hardware index.
+static inline uint64_t perf_rdpmc(uint32_t counter) {
+  uint32_t low, high;
+  __asm__ volatile("rdpmc"
+                   : "=a"(low), "=d"(high)
+                   : "c"(counter));
+  return (uint64_t)high << 32 | low;
+}
+#else
+#define PERF_HAS_RDPMC 0
+#endif
+
+// Map the metadata page of an opened measurement and enable the measurement.
+// The measurement should measure the calling thread (pid == 0 and cpu == -1).
+// Should be unmapped using perf_unmap_self_monitor.
+// Returns NULL if an error occured. Use errno to gather more information.
+perf_self_monitor_t *perf_map_self_monitor(const perf_measurement_t *measurement);
+
+// Whether or not the counter may currently be read using rdpmc. When not, reads
+// fall back to the read syscall. This is the case for software events, on
+// architectures other than x86 and when the kernel disallows rdpmc
+// (see /sys/bus/event_source/devices/cpu/rdpmc).
+// Returns 1 if rdpmc is used, 0 otherwise.
+int perf_self_monitor_is_userspace(const perf_self_monitor_t *monitor);
+
+// Read the counter using the read syscall. Used when rdpmc is unavailable.
+// Returns 0 if an error occured.
+uint64_t perf_self_monitor_read_syscall(const perf_self_monitor_t *monitor);
+
+// Read the current, cumulative value of the counter.
+static inline uint64_t perf_self_monitor_read(const perf_self_monitor_t *monitor) {
+#if PERF_HAS_RDPMC
+  volatile struct perf_event_mmap_page *metadata = monitor->metadata;
+  uint32_t sequence, index;
+  uint64_t count;
+
+  // The kernel bumps lock whenever it updates the page, such as when the task is
+  // rescheduled. Retry until a consistent snapshot was read
+  do {
+    sequence = metadata->lock;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    index = metadata->index;
+    if (!metadata->cap_user_rdpmc || index == 0)
+      return perf_self_monitor_read_syscall(monitor);
+
+    count = metadata->offset;
+    uint16_t width = metadata->pmc_width;
+    // Sign extend the pmc_width-bit counter to 64 bits
+    uint64_t value = perf_rdpmc(index - 1) << (64 - width);
+    count += (uint64_t)((int64_t)value >> (64 - width));
+
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  } while (metadata->lock != sequence);
+
+  return count;
+#else
+  return perf_self_monitor_read_syscall(monitor);
+#endif
+}
+
+// Start a measurement. Does not reset the counter.
+#define perf_self_monitor_start(monitor) ((monitor)->start = perf_self_monitor_read(monitor))
+
+// Stop a measurement, evaluating to the value counted since perf_self_monitor_start.
+#define perf_self_monitor_stop(monitor) (perf_self_monitor_read(monitor) - (monitor)->start)
+
+// Disable the measurement, unmap the metadata page and free the monitor.
+// Returns <0 if an error occured.
+int perf_unmap_self_monitor(perf_self_monitor_t *monitor);
+
+#endif
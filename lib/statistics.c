@@ -0,0 +1,141 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "statistics.h"
+
+// Returns the histogram bucket of a value.
+static size_t perf_histogram_bucket(uint64_t value) {
+  if (value < PERF_HISTOGRAM_SUB_BUCKETS)
+    return value;
+
+  // Keep the PERF_HISTOGRAM_PRECISION most significant bits of the value
+  unsigned int most_significant_bit = 63 - __builtin_clzll(value);
+  unsigned int shift = most_significant_bit - (PERF_HISTOGRAM_PRECISION - 1);
+  uint64_t sub_bucket = (value >> shift) - PERF_HISTOGRAM_SUB_BUCKETS / 2;
+
+  return PERF_HISTOGRAM_SUB_BUCKETS + (shift - 1) * (PERF_HISTOGRAM_SUB_BUCKETS / 2) + sub_bucket;
+}
+
+// Returns the midpoint of the values of a histogram bucket.
+static uint64_t perf_histogram_value(size_t bucket) {
+  if (bucket < PERF_HISTOGRAM_SUB_BUCKETS)
+    return bucket;
+
+  size_t offset = bucket - PERF_HISTOGRAM_SUB_BUCKETS;
+  unsigned int shift = offset / (PERF_HISTOGRAM_SUB_BUCKETS / 2) + 1;
+  uint64_t sub_bucket = offset % (PERF_HISTOGRAM_SUB_BUCKETS / 2) + PERF_HISTOGRAM_SUB_BUCKETS / 2;
+
+  uint64_t lowest = sub_bucket << shift;
+  return lowest + ((1llu << shift) - 1) / 2;
+}
+
+perf_statistics_t *perf_create_statistics(size_t size) {
+  size_t allocation = sizeof(perf_statistics_t) + sizeof(perf_statistic_t) * size;
+
+  perf_statistics_t *statistics = (perf_statistics_t *)malloc(allocation);
+  if (statistics == NULL)
+    return NULL;
+
+  statistics->size = size;
+  statistics->events = (perf_statistic_t *)(statistics + 1);
+  perf_statistics_reset(statistics);
+
+  return statistics;
+}
+
+void perf_statistic_add(perf_statistic_t *statistic, uint64_t value) {
+  statistic->count++;
+  if (statistic->count == 1 || value < statistic->min)
+    statistic->min = value;
+  if (value > statistic->max)
+    statistic->max = value;
+
+  // Welford's online algorithm, numerically stable for large counts
+  double delta = (double)value - statistic->mean;
+  statistic->mean += delta / (double)statistic->count;
+  statistic->m2 += delta * ((double)value - statistic->mean);
+
+  statistic->buckets[perf_histogram_bucket(value)]++;
+}
+
+void perf_statistic_merge(perf_statistic_t *statistic, const perf_statistic_t *other) {
+  if (other->count == 0)
+    return;
+
+  if (statistic->count == 0 || other->min < statistic->min)
+    statistic->min = other->min;
+  if (other->max > statistic->max)
+    statistic->max = other->max;
+
+  // Chan et al.'s parallel variant of Welford's algorithm
+  double count = (double)statistic->count + (double)other->count;
+  double delta = other->mean - statistic->mean;
+  statistic->mean += delta * (double)other->count / count;
+  statistic->m2 += other->m2 + delta * delta * (double)statistic->count * (double)other->count / count;
+  statistic->count += other->count;
+
+  for (size_t i = 0; i < PERF_HISTOGRAM_BUCKETS; i++)
+    statistic->buckets[i] += other->buckets[i];
+}
+
+double perf_statistic_stddev(const perf_statistic_t *statistic) {
+  if (statistic->count < 2)
+    return 0;
+
+  return sqrt(statistic->m2 / (double)(statistic->count - 1));
+}
+
+uint64_t perf_statistic_percentile(const perf_statistic_t *statistic, double percentile) {
+  if (statistic->count == 0)
+    return 0;
+
+  uint64_t rank = (uint64_t)ceil(percentile / 100 * (double)statistic->count);
+  if (rank == 0)
+    rank = 1;
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < PERF_HISTOGRAM_BUCKETS; i++) {
+    seen += statistic->buckets[i];
+    if (seen < rank)
+      continue;
+
+    // The bucket's midpoint may lie outside of the observed range
+    uint64_t value = perf_histogram_value(i);
+    if (value < statistic->min)
+      return statistic->min;
+    if (value > statistic->max)
+      return statistic->max;
+    return value;
+  }
+
+  return statistic->max;
+}
+
+void perf_statistics_add(perf_statistics_t *statistics, const uint64_t *values) {
+  for (size_t i = 0; i < statistics->size; i++)
+    perf_statistic_add(&statistics->events[i], values[i]);
+}
+
+void perf_statistics_reset(perf_statistics_t *statistics) {
+  memset((void *)statistics->events, 0, sizeof(perf_statistic_t) * statistics->size);
+}
+
+void perf_print_statistics(const perf_statistics_t *statistics, const char **names, FILE *output) {
+  fprintf(output, "            event          count            min           mean         stddev            p50            p99          p99.9            max\n");
+  for (size_t i = 0; i < statistics->size; i++) {
+    const perf_statistic_t *statistic = &statistics->events[i];
+    fprintf(output, "%17s%15" PRIu64 "%15" PRIu64 "%15.1f%15.1f%15" PRIu64 "%15" PRIu64 "%15" PRIu64 "%15" PRIu64 "\n",
+            names[i],
+            statistic->count,
+            statistic->min,
+            statistic->mean,
+            perf_statistic_stddev(statistic),
+            perf_statistic_percentile(statistic, 50),
+            perf_statistic_percentile(statistic, 99),
+            perf_statistic_percentile(statistic, 99.9),
+            statistic->max);
+  }
+}
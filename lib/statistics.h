@@ -0,0 +1,69 @@
+#ifndef PERF_STATISTICS_H
+#define PERF_STATISTICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "group.h"
+
+// The histogram keeps values below 2^PERF_HISTOGRAM_PRECISION exact and splits each larger
+// power of two into 2^(PERF_HISTOGRAM_PRECISION - 1) linear buckets, bounding the relative
+// error of a percentile to 2^-(PERF_HISTOGRAM_PRECISION - 1)
+#define PERF_HISTOGRAM_PRECISION 7
+#define PERF_HISTOGRAM_SUB_BUCKETS (1 << PERF_HISTOGRAM_PRECISION)
+// Values below PERF_HISTOGRAM_SUB_BUCKETS are exact, larger values use half of the
+// sub buckets for each remaining power of two
+#define PERF_HISTOGRAM_BUCKETS (PERF_HISTOGRAM_SUB_BUCKETS + (64 - PERF_HISTOGRAM_PRECISION) * (PERF_HISTOGRAM_SUB_BUCKETS / 2))
+
+// Streaming statistics of a single event. Uses constant memory regardless of the
+// number of values added.
+typedef struct {
+  // The number of values added
+  uint64_t count;
+  uint64_t min;
+  uint64_t max;
+  // The running mean and sum of squared differences from the mean (Welford's algorithm)
+  double mean;
+  double m2;
+  // A log-bucketed histogram (HDR-style) of all added values
+  uint64_t buckets[PERF_HISTOGRAM_BUCKETS];
+} perf_statistic_t;
+
+// Streaming statistics of a set of events, such as the members of a group.
+typedef struct {
+  // The number of events
+  size_t size;
+  // The statistics of each event, indexed by slot
+  perf_statistic_t *events;
+} perf_statistics_t;
+
+// Create statistics for size events. Should be freed.
+// Returns NULL if an error occured.
+perf_statistics_t *perf_create_statistics(size_t size);
+
+// Add a value to the statistics of an event.
+void perf_statistic_add(perf_statistic_t *statistic, uint64_t value);
+
+// Merge the values of one statistic into another.
+void perf_statistic_merge(perf_statistic_t *statistic, const perf_statistic_t *other);
+
+// Returns the sample standard deviation of the added values.
+double perf_statistic_stddev(const perf_statistic_t *statistic);
+
+// Returns the value at the specified percentile (0-100), accurate to the precision of the histogram.
+uint64_t perf_statistic_percentile(const perf_statistic_t *statistic, double percentile);
+
+// Add one value per event, indexed by slot.
+void perf_statistics_add(perf_statistics_t *statistics, const uint64_t *values);
+
+// Add the values of the last read of a group.
+#define perf_statistics_add_group(statistics, group) perf_statistics_add((statistics), (group)->values)
+
+// Reset all statistics.
+void perf_statistics_reset(perf_statistics_t *statistics);
+
+// Print a summary table of the statistics. names holds the name of each event.
+void perf_print_statistics(const perf_statistics_t *statistics, const char **names, FILE *output);
+
+#endif
@@ -0,0 +1,523 @@
+#include <elf.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "symbols.h"
+#include "utilities.h"
+
+// Map an ELF file for reading.
+// Returns NULL if an error occured.
+static void *perf_map_image(const char *path, size_t *size) {
+  int file_descriptor = open(path, O_RDONLY | O_CLOEXEC);
+  if (file_descriptor < 0)
+    return NULL;
+
+  struct stat status;
+  if (fstat(file_descriptor, &status) < 0 || status.st_size < (off_t)sizeof(Elf64_Ehdr)) {
+    close(file_descriptor);
+    return NULL;
+  }
+
+  void *image = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+  close(file_descriptor);
+  if (image == MAP_FAILED)
+    return NULL;
+
+  *size = status.st_size;
+  return image;
+}
+
+static int perf_compare_symbols(const void *a, const void *b) {
+  const perf_symbol_t *first = (const perf_symbol_t *)a;
+  const perf_symbol_t *second = (const perf_symbol_t *)b;
+  if (first->start != second->start)
+    return first->start < second->start ? -1 : 1;
+  // Prefer symbols with a known size for the same address
+  return (first->size == 0) - (second->size == 0);
+}
+
+// Whether or not a range lies within an image.
+#define perf_image_contains(size, offset, length) ((offset) <= (size) && (length) <= (size) - (offset))
+
+// Read the function symbols of an ELF image into a mapping.
+// Returns <0 if an error occured.
+static int perf_read_symbols(perf_mapping_t *mapping, const uint8_t *image, size_t size) {
+  const Elf64_Ehdr *header = (const Elf64_Ehdr *)image;
+  if (size < sizeof(Elf64_Ehdr) || memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 || header->e_ident[EI_CLASS] != ELFCLASS64)
+    return PERF_ERROR_NOT_SUPPORTED;
+
+  if (!perf_image_contains(size, header->e_phoff, (uint64_t)header->e_phnum * sizeof(Elf64_Phdr)) ||
+      !perf_image_contains(size, header->e_shoff, (uint64_t)header->e_shnum * sizeof(Elf64_Shdr)))
+    return PERF_ERROR_NOT_SUPPORTED;
+
+  // Find the load bias of the mapping: the difference between the address an
+  // address of the image is mapped to and the address the image was linked for
+  const Elf64_Phdr *program_headers = (const Elf64_Phdr *)(image + header->e_phoff);
+  uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+  int found_segment = 0;
+  uint64_t bias = 0;
+  for (size_t i = 0; i < header->e_phnum; i++) {
+    const Elf64_Phdr *segment = &program_headers[i];
+    if (segment->p_type != PT_LOAD || !(segment->p_flags & PF_X))
+      continue;
+    if (mapping->offset < (segment->p_offset & ~(page_size - 1)) || mapping->offset >= segment->p_offset + segment->p_filesz)
+      continue;
+
+    bias = mapping->start - (segment->p_vaddr - segment->p_offset + mapping->offset);
+    found_segment = 1;
+    break;
+  }
+
+  if (!found_segment)
+    return PERF_ERROR_NOT_SUPPORTED;
+
+  // Count the symbols of both tables to allocate them at once
+  const Elf64_Shdr *sections = (const Elf64_Shdr *)(image + header->e_shoff);
+  size_t capacity = 0;
+  for (size_t i = 0; i < header->e_shnum; i++) {
+    if ((sections[i].sh_type == SHT_SYMTAB || sections[i].sh_type == SHT_DYNSYM) && sections[i].sh_entsize == sizeof(Elf64_Sym))
+      capacity += sections[i].sh_size / sizeof(Elf64_Sym);
+  }
+
+  if (capacity == 0)
+    return 0;
+
+  perf_symbol_t *symbols = (perf_symbol_t *)malloc(sizeof(perf_symbol_t) * capacity);
+  if (symbols == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  size_t count = 0;
+  for (size_t i = 0; i < header->e_shnum; i++) {
+    const Elf64_Shdr *section = &sections[i];
+    if ((section->sh_type != SHT_SYMTAB && section->sh_type != SHT_DYNSYM) || section->sh_entsize != sizeof(Elf64_Sym))
+      continue;
+    if (section->sh_link >= header->e_shnum)
+      continue;
+
+    const Elf64_Shdr *strings = &sections[section->sh_link];
+    if (!perf_image_contains(size, section->sh_offset, section->sh_size) || !perf_image_contains(size, strings->sh_offset, strings->sh_size))
+      continue;
+
+    const Elf64_Sym *entries = (const Elf64_Sym *)(image + section->sh_offset);
+    size_t entries_count = section->sh_size / sizeof(Elf64_Sym);
+    for (size_t j = 0; j < entries_count; j++) {
+      const Elf64_Sym *entry = &entries[j];
+      int type = ELF64_ST_TYPE(entry->st_info);
+      if ((type != STT_FUNC && type != STT_GNU_IFUNC) || entry->st_shndx == SHN_UNDEF || entry->st_value == 0)
+        continue;
+      if (entry->st_name >= strings->sh_size)
+        continue;
+
+      // Only keep the symbols of this mapping
+      uint64_t start = entry->st_value + bias;
+      if (start < mapping->start || start >= mapping->end)
+        continue;
+
+      // A symbol of unknown size, such as _init, extends at most to the end of its section
+      uint64_t symbol_size = entry->st_size;
+      if (symbol_size == 0 && entry->st_shndx < header->e_shnum) {
+        const Elf64_Shdr *symbol_section = &sections[entry->st_shndx];
+        if (entry->st_value >= symbol_section->sh_addr && entry->st_value < symbol_section->sh_addr + symbol_section->sh_size)
+          symbol_size = symbol_section->sh_addr + symbol_section->sh_size - entry->st_value;
+      }
+
+      symbols[count].start = start;
+      symbols[count].size = symbol_size;
+      symbols[count].name = (const char *)(image + strings->sh_offset + entry->st_name);
+      count++;
+    }
+  }
+
+  // Sort the symbols and drop aliases of the same address, such as a symbol listed in both tables
+  qsort(symbols, count, sizeof(perf_symbol_t), perf_compare_symbols);
+  size_t unique = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (unique > 0 && symbols[unique - 1].start == symbols[i].start)
+      continue;
+    symbols[unique++] = symbols[i];
+  }
+
+  mapping->symbols = symbols;
+  mapping->symbols_count = unique;
+  return 0;
+}
+
+int perf_find_symbol_offset(const char *path, const char *name, uint64_t *offset) {
+  size_t size = 0;
+  const uint8_t *image = (const uint8_t *)perf_map_image(path, &size);
+  if (image == NULL)
+    return PERF_ERROR_IO;
+
+  const Elf64_Ehdr *header = (const Elf64_Ehdr *)image;
+  if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 || header->e_ident[EI_CLASS] != ELFCLASS64 ||
+      !perf_image_contains(size, header->e_phoff, (uint64_t)header->e_phnum * sizeof(Elf64_Phdr)) ||
+      !perf_image_contains(size, header->e_shoff, (uint64_t)header->e_shnum * sizeof(Elf64_Shdr))) {
+    munmap((void *)image, size);
+    return PERF_ERROR_NOT_SUPPORTED;
+  }
+
+  const Elf64_Shdr *sections = (const Elf64_Shdr *)(image + header->e_shoff);
+  const Elf64_Phdr *program_headers = (const Elf64_Phdr *)(image + header->e_phoff);
+  int status = PERF_ERROR_NOT_SUPPORTED;
+  for (size_t i = 0; i < header->e_shnum && status < 0; i++) {
+    const Elf64_Shdr *section = &sections[i];
+    if ((section->sh_type != SHT_SYMTAB && section->sh_type != SHT_DYNSYM) || section->sh_entsize != sizeof(Elf64_Sym) || section->sh_link >= header->e_shnum)
+      continue;
+
+    const Elf64_Shdr *strings = &sections[section->sh_link];
+    if (!perf_image_contains(size, section->sh_offset, section->sh_size) || !perf_image_contains(size, strings->sh_offset, strings->sh_size))
+      continue;
+
+    const Elf64_Sym *entries = (const Elf64_Sym *)(image + section->sh_offset);
+    size_t entries_count = section->sh_size / sizeof(Elf64_Sym);
+    for (size_t j = 0; j < entries_count; j++) {
+      const Elf64_Sym *entry = &entries[j];
+      int type = ELF64_ST_TYPE(entry->st_info);
+      if ((type != STT_FUNC && type != STT_GNU_IFUNC) || entry->st_shndx == SHN_UNDEF || entry->st_name >= strings->sh_size)
+        continue;
+
+      // Compare within the bounds of the string table
+      const char *symbol = (const char *)(image + strings->sh_offset + entry->st_name);
+      size_t length = strlen(name);
+      if (strings->sh_size - entry->st_name <= length || memcmp(symbol, name, length + 1) != 0)
+        continue;
+
+      // The file offset of the loadable segment holding the symbol's address
+      for (size_t k = 0; k < header->e_phnum; k++) {
+        const Elf64_Phdr *segment = &program_headers[k];
+        if (segment->p_type != PT_LOAD || entry->st_value < segment->p_vaddr || entry->st_value >= segment->p_vaddr + segment->p_filesz)
+          continue;
+
+        *offset = entry->st_value - segment->p_vaddr + segment->p_offset;
+        status = 0;
+        break;
+      }
+      break;
+    }
+  }
+
+  munmap((void *)image, size);
+  return status;
+}
+
+// Load the symbols of a mapping, if not already loaded.
+static void perf_load_mapping(perf_mapping_t *mapping, pid_t pid) {
+  if (mapping->loaded)
+    return;
+  mapping->loaded = 1;
+
+  if (mapping->path[0] == '/') {
+    size_t size = 0;
+    void *image = perf_map_image(mapping->path, &size);
+    if (image == NULL)
+      return;
+
+    if (perf_read_symbols(mapping, (const uint8_t *)image, size) < 0 || mapping->symbols_count == 0) {
+      munmap(image, size);
+      return;
+    }
+
+    mapping->image = image;
+    mapping->image_size = size;
+  } else if (pid == 0 && strcmp(mapping->path, "[vdso]") == 0) {
+    // The vDSO is a complete ELF image in the memory of the calling process
+    perf_read_symbols(mapping, (const uint8_t *)(uintptr_t)mapping->start, mapping->end - mapping->start);
+  }
+}
+
+void perf_free_mapping(perf_mapping_t *mapping) {
+  if (mapping->image != NULL)
+    munmap(mapping->image, mapping->image_size);
+  free((void *)mapping->strings);
+  free((void *)mapping->symbols);
+  free((void *)mapping->path);
+  free((void *)mapping);
+}
+
+// Binary search the mappings by their start address.
+// Returns the index of the first mapping starting at or after the address.
+static size_t perf_search_mappings(perf_mapping_t *const *mappings, size_t size, uint64_t address) {
+  size_t low = 0;
+  size_t high = size;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (mappings[middle]->start < address)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return low;
+}
+
+// Read the executable mappings of a process, reusing existing mappings when unchanged.
+// Mappings no longer present are freed.
+// Returns <0 if an error occured.
+static int perf_read_mappings(perf_symbol_table_t *table) {
+  char path[64];
+  if (table->pid == 0)
+    strcpy(path, "/proc/self/maps");
+  else
+    snprintf(path, sizeof(path), "/proc/%d/maps", table->pid);
+
+  FILE *maps = fopen(path, "r");
+  if (maps == NULL)
+    return PERF_ERROR_IO;
+
+  size_t size = 0;
+  size_t capacity = table->capacity > 0 ? table->capacity : 64;
+  perf_mapping_t **mappings = (perf_mapping_t **)malloc(sizeof(perf_mapping_t *) * capacity);
+  if (mappings == NULL) {
+    fclose(maps);
+    return PERF_ERROR_LIBRARY_FAILURE;
+  }
+
+  // Marks the existing mappings which are still present
+  uint8_t *reused = (uint8_t *)calloc(table->size + 1, sizeof(uint8_t));
+  if (reused == NULL) {
+    free((void *)mappings);
+    fclose(maps);
+    return PERF_ERROR_LIBRARY_FAILURE;
+  }
+
+  char line[4096 + 128];
+  while (fgets(line, sizeof(line), maps) != NULL) {
+    unsigned long start, end, offset;
+    char permissions[5];
+    int path_offset = 0;
+    if (sscanf(line, "%lx-%lx %4s %lx %*s %*s %n", &start, &end, permissions, &offset, &path_offset) < 4)
+      continue;
+    if (permissions[2] != 'x')
+      continue;
+
+    char *name = line + path_offset;
+    name[strcspn(name, "\n")] = '\0';
+    if (name[0] == '\0')
+      name = "[anonymous]";
+
+    if (size == capacity) {
+      capacity *= 2;
+      perf_mapping_t **resized = (perf_mapping_t **)realloc(mappings, sizeof(perf_mapping_t *) * capacity);
+      if (resized == NULL) {
+        free((void *)mappings);
+        free((void *)reused);
+        fclose(maps);
+        return PERF_ERROR_LIBRARY_FAILURE;
+      }
+      mappings = resized;
+    }
+
+    // Reuse an unchanged mapping, keeping its symbols
+    size_t index = perf_search_mappings(table->mappings, table->size, start);
+    if (index < table->size && !reused[index]) {
+      perf_mapping_t *existing = table->mappings[index];
+      if (existing->start == start && existing->end == end && existing->offset == offset && strcmp(existing->path, name) == 0) {
+        mappings[size++] = existing;
+        reused[index] = 1;
+        continue;
+      }
+    }
+
+    perf_mapping_t *mapping = (perf_mapping_t *)malloc(sizeof(perf_mapping_t));
+    if (mapping == NULL)
+      continue;
+    memset((void *)mapping, 0, sizeof(perf_mapping_t));
+    mapping->start = start;
+    mapping->end = end;
+    mapping->offset = offset;
+    mapping->path = strdup(name);
+    if (mapping->path == NULL) {
+      free((void *)mapping);
+      continue;
+    }
+
+    mappings[size++] = mapping;
+  }
+
+  fclose(maps);
+
+  // The maps file is sorted by address, so the new list is as well
+  for (size_t i = 0; i < table->size; i++) {
+    if (!reused[i])
+      perf_free_mapping(table->mappings[i]);
+  }
+  free((void *)table->mappings);
+  free((void *)reused);
+
+  table->mappings = mappings;
+  table->size = size;
+  table->capacity = capacity;
+  return 0;
+}
+
+perf_symbol_table_t *perf_load_symbol_table(pid_t pid) {
+  perf_symbol_table_t *table = (perf_symbol_table_t *)malloc(sizeof(perf_symbol_table_t));
+  if (table == NULL)
+    return NULL;
+
+  memset((void *)table, 0, sizeof(perf_symbol_table_t));
+  table->pid = pid;
+
+  if (perf_read_mappings(table) < 0) {
+    free((void *)table);
+    return NULL;
+  }
+
+  return table;
+}
+
+int perf_update_symbol_table(perf_symbol_table_t *table) {
+  return perf_read_mappings(table);
+}
+
+perf_mapping_t *perf_find_mapping(const perf_symbol_table_t *table, uint64_t address) {
+  // The mapping containing the address is the last one starting at or before it
+  size_t index = perf_search_mappings(table->mappings, table->size, address + 1);
+  if (index == 0)
+    return NULL;
+
+  perf_mapping_t *mapping = table->mappings[index - 1];
+  return address < mapping->end ? mapping : NULL;
+}
+
+const perf_symbol_t *perf_resolve_symbol(const perf_symbol_table_t *table, uint64_t address, const perf_mapping_t **mapping) {
+  perf_mapping_t *found = perf_find_mapping(table, address);
+  if (mapping != NULL)
+    *mapping = found;
+  if (found == NULL)
+    return NULL;
+
+  perf_load_mapping(found, table->pid);
+  return perf_resolve_mapping_symbol(found, address);
+}
+
+const perf_symbol_t *perf_resolve_mapping_symbol(const perf_mapping_t *mapping, uint64_t address) {
+  // The symbol containing the address is the last one starting at or before it
+  size_t low = 0;
+  size_t high = mapping->symbols_count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (mapping->symbols[middle].start <= address)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  if (low == 0)
+    return NULL;
+
+  const perf_symbol_t *symbol = &mapping->symbols[low - 1];
+  if (symbol->size > 0 && address >= symbol->start + symbol->size)
+    return NULL;
+
+  return symbol;
+}
+
+// Read the function symbols of /proc/kallsyms into a mapping. The symbols and
+// names are stored in the mapping as they grow, so that perf_free_mapping frees them on failure.
+// Returns <0 if an error occured.
+static int perf_read_kallsyms(FILE *kallsyms, perf_mapping_t *mapping) {
+  size_t capacity = 1 << 16;
+  size_t strings_capacity = 1 << 20;
+  size_t strings_size = 0;
+  mapping->symbols = (perf_symbol_t *)malloc(sizeof(perf_symbol_t) * capacity);
+  mapping->strings = (char *)malloc(strings_capacity);
+  if (mapping->symbols == NULL || mapping->strings == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  // Names are stored as offsets while the strings grow, and turned into pointers once read
+  char line[512];
+  while (fgets(line, sizeof(line), kallsyms) != NULL) {
+    unsigned long long address;
+    char type;
+    int name_offset = 0;
+    if (sscanf(line, "%llx %c %n", &address, &type, &name_offset) < 2 || name_offset == 0)
+      continue;
+    if ((type != 't' && type != 'T' && type != 'w' && type != 'W') || address == 0)
+      continue;
+
+    // Strip the trailing module, such as "\t[ext4]"
+    char *name = line + name_offset;
+    name[strcspn(name, " \t\n")] = '\0';
+    size_t length = strlen(name) + 1;
+
+    if (mapping->symbols_count == capacity) {
+      capacity *= 2;
+      perf_symbol_t *resized = (perf_symbol_t *)realloc(mapping->symbols, sizeof(perf_symbol_t) * capacity);
+      if (resized == NULL)
+        return PERF_ERROR_LIBRARY_FAILURE;
+      mapping->symbols = resized;
+    }
+
+    if (strings_size + length > strings_capacity) {
+      strings_capacity *= 2;
+      char *resized = (char *)realloc(mapping->strings, strings_capacity);
+      if (resized == NULL)
+        return PERF_ERROR_LIBRARY_FAILURE;
+      mapping->strings = resized;
+    }
+
+    memcpy(mapping->strings + strings_size, name, length);
+    perf_symbol_t *symbol = &mapping->symbols[mapping->symbols_count++];
+    symbol->start = address;
+    symbol->size = 0;
+    symbol->name = (const char *)(uintptr_t)strings_size;
+    strings_size += length;
+  }
+
+  // All addresses read as zero when hidden by kptr_restrict
+  if (mapping->symbols_count == 0)
+    return PERF_ERROR_NOT_SUPPORTED;
+
+  for (size_t i = 0; i < mapping->symbols_count; i++)
+    mapping->symbols[i].name = mapping->strings + (uintptr_t)mapping->symbols[i].name;
+
+  qsort(mapping->symbols, mapping->symbols_count, sizeof(perf_symbol_t), perf_compare_symbols);
+  size_t unique = 0;
+  for (size_t i = 0; i < mapping->symbols_count; i++) {
+    if (unique > 0 && mapping->symbols[unique - 1].start == mapping->symbols[i].start)
+      continue;
+    mapping->symbols[unique++] = mapping->symbols[i];
+  }
+  mapping->symbols_count = unique;
+
+  return 0;
+}
+
+perf_mapping_t *perf_load_kernel_symbols() {
+  FILE *kallsyms = fopen("/proc/kallsyms", "r");
+  if (kallsyms == NULL)
+    return NULL;
+
+  perf_mapping_t *mapping = (perf_mapping_t *)calloc(1, sizeof(perf_mapping_t));
+  if (mapping == NULL) {
+    fclose(kallsyms);
+    return NULL;
+  }
+
+  mapping->path = strdup("[kernel.kallsyms]");
+  int status = mapping->path == NULL ? PERF_ERROR_LIBRARY_FAILURE : perf_read_kallsyms(kallsyms, mapping);
+  fclose(kallsyms);
+  if (status < 0) {
+    perf_free_mapping(mapping);
+    return NULL;
+  }
+
+  // The size of the last symbol is unknown, so don't let it cover the rest of the address space
+  mapping->start = mapping->symbols[0].start;
+  mapping->end = mapping->symbols[mapping->symbols_count - 1].start;
+  mapping->loaded = 1;
+  return mapping;
+}
+
+void perf_free_symbol_table(perf_symbol_table_t *table) {
+  for (size_t i = 0; i < table->size; i++)
+    perf_free_mapping(table->mappings[i]);
+  free((void *)table->mappings);
+  free((void *)table);
+}
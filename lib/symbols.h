@@ -0,0 +1,92 @@
+#ifndef PERF_SYMBOLS_H
+#define PERF_SYMBOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// A function symbol of an ELF image.
+typedef struct {
+  // The address of the symbol, as mapped into the process
+  uint64_t start;
+  // The size of the symbol in bytes. 0 if unknown, in which case the symbol extends to the next symbol
+  uint64_t size;
+  // The name of the symbol. Points into the mapped image
+  const char *name;
+} perf_symbol_t;
+
+// An executable mapping of a process.
+typedef struct {
+  // The mapped address range
+  uint64_t start;
+  uint64_t end;
+  // The offset of the mapping within its file
+  uint64_t offset;
+  // The path of the mapped file, or a name such as [vdso]. Owned by the mapping
+  char *path;
+  // Whether or not the symbols of the mapping have been loaded. Symbols are loaded on the first lookup
+  int loaded;
+  // The symbols of the mapping, sorted by address
+  size_t symbols_count;
+  perf_symbol_t *symbols;
+  // The image the symbols point into. NULL if the image is not mapped by the table
+  void *image;
+  size_t image_size;
+  // The names of the symbols when not read from an image, such as for the kernel
+  char *strings;
+} perf_mapping_t;
+
+// The executable mappings of a process and their symbols.
+typedef struct {
+  // The process whose mappings are listed. 0 for the calling process
+  pid_t pid;
+  // The number of mappings
+  size_t size;
+  size_t capacity;
+  // The mappings, sorted by address. Each mapping is allocated separately, so that
+  // pointers to unchanged mappings and their symbols stay valid when the table is updated
+  perf_mapping_t **mappings;
+} perf_symbol_table_t;
+
+// Load the executable mappings of a process from /proc/<pid>/maps. Should be freed using perf_free_symbol_table.
+// Use pid 0 for the calling process. The symbols of each mapping are read from its
+// ELF .symtab and .dynsym once, on the first lookup of an address within the mapping.
+// Returns NULL if an error occured.
+perf_symbol_table_t *perf_load_symbol_table(pid_t pid);
+
+// Read the mappings again, adding mappings created since the table was loaded, such as by dlopen.
+// Unchanged mappings, and pointers to them and their symbols, are left untouched.
+// Mappings no longer present are freed.
+// Returns <0 if an error occured.
+int perf_update_symbol_table(perf_symbol_table_t *table);
+
+// Find the mapping containing an address.
+// Returns NULL if the address is not part of a known executable mapping.
+perf_mapping_t *perf_find_mapping(const perf_symbol_table_t *table, uint64_t address);
+
+// Find the function containing an address.
+// If mapping is not NULL, it is set to the mapping containing the address, or NULL.
+// Returns NULL if the address could not be resolved.
+const perf_symbol_t *perf_resolve_symbol(const perf_symbol_table_t *table, uint64_t address, const perf_mapping_t **mapping);
+
+// Find the function containing an address within a loaded mapping.
+// Returns NULL if the address could not be resolved.
+const perf_symbol_t *perf_resolve_mapping_symbol(const perf_mapping_t *mapping, uint64_t address);
+
+// Find the file offset of a function symbol of an ELF file, such as the offset of
+// "main" within /usr/bin/app. Used to place uprobes.
+// Returns <0 if an error occured. PERF_ERROR_NOT_SUPPORTED if the symbol does not exist.
+int perf_find_symbol_offset(const char *path, const char *name, uint64_t *offset);
+
+// Load the function symbols of the kernel from /proc/kallsyms as a single mapping.
+// Should be freed using perf_free_mapping.
+// Returns NULL if an error occured or if the addresses are hidden by kptr_restrict.
+perf_mapping_t *perf_load_kernel_symbols();
+
+// Free a mapping and its symbols.
+void perf_free_mapping(perf_mapping_t *mapping);
+
+// Free a symbol table and all of its mappings.
+void perf_free_symbol_table(perf_symbol_table_t *table);
+
+#endif
@@ -0,0 +1,315 @@
+#include <dirent.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "group.h"
+#include "thread_tracker.h"
+#include "utilities.h"
+
+static void perf_free_tracked_thread(perf_tracked_thread_t *thread) {
+  if (thread->group != NULL) {
+    perf_close_group(thread->group);
+    free((void *)thread->group);
+  }
+  free((void *)thread);
+}
+
+perf_thread_tracker_t *perf_create_thread_tracker(const perf_group_t *prototype) {
+  perf_thread_tracker_t *tracker = (perf_thread_tracker_t *)malloc(sizeof(perf_thread_tracker_t));
+  if (tracker == NULL)
+    return NULL;
+
+  memset((void *)tracker, 0, sizeof(perf_thread_tracker_t));
+
+  // The clone is never opened, it only describes the group of each thread
+  tracker->prototype = perf_clone_group(prototype, 0, -1);
+  tracker->exited = (uint64_t *)calloc(prototype->size + 1, sizeof(uint64_t));
+  tracker->totals = (uint64_t *)calloc(prototype->size + 1, sizeof(uint64_t));
+  if (tracker->prototype == NULL || tracker->exited == NULL || tracker->totals == NULL) {
+    free((void *)tracker->prototype);
+    free((void *)tracker->exited);
+    free((void *)tracker->totals);
+    free((void *)tracker);
+    return NULL;
+  }
+
+  pthread_mutex_init(&tracker->lock, NULL);
+  pthread_cond_init(&tracker->wake, NULL);
+
+  return tracker;
+}
+
+// Read the name of a thread of the calling process.
+static void perf_read_thread_name(pid_t tid, char name[16]) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
+
+  name[0] = '\0';
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+    return;
+  if (fgets(name, 16, file) != NULL)
+    name[strcspn(name, "\n")] = '\0';
+  fclose(file);
+}
+
+// Read the start time of a thread of the calling process, in clock ticks since boot.
+// Returns 0 if the thread has exited.
+static uint64_t perf_read_thread_start_time(pid_t tid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+    return 0;
+
+  char line[1024];
+  char *read = fgets(line, sizeof(line), file);
+  fclose(file);
+  if (read == NULL)
+    return 0;
+
+  // The name may contain spaces and parentheses, so count the fields from the last ')'.
+  // The start time is the 22nd field, the 20th following the name
+  char *field = strrchr(line, ')');
+  for (int i = 0; field != NULL && i < 20; i++)
+    field = strchr(field + 1, ' ');
+  return field != NULL ? strtoull(field + 1, NULL, 10) : 0;
+}
+
+// Attach a group to a thread.
+// Returns NULL if the thread could not be measured, such as if it has already exited.
+static perf_tracked_thread_t *perf_attach_thread(perf_thread_tracker_t *tracker, pid_t tid, uint64_t start_time) {
+  perf_tracked_thread_t *thread = (perf_tracked_thread_t *)malloc(sizeof(perf_tracked_thread_t));
+  if (thread == NULL)
+    return NULL;
+
+  memset((void *)thread, 0, sizeof(perf_tracked_thread_t));
+  thread->tid = tid;
+  thread->start_time = start_time;
+  thread->generation = tracker->generation;
+  perf_read_thread_name(tid, thread->name);
+
+  thread->group = perf_clone_group(tracker->prototype, tid, -1);
+  if (thread->group == NULL) {
+    free((void *)thread);
+    return NULL;
+  }
+
+  // The leader and some members may have opened before the thread exited
+  if (perf_open_group(thread->group, 0) < 0) {
+    perf_free_tracked_thread(thread);
+    return NULL;
+  }
+
+  perf_start_group(thread->group);
+  return thread;
+}
+
+// Update the tracker. The lock must be held.
+static int perf_update_thread_tracker_locked(perf_thread_tracker_t *tracker) {
+  DIR *tasks = opendir("/proc/self/task");
+  if (tasks == NULL)
+    return PERF_ERROR_IO;
+
+  tracker->generation++;
+  int attached = 0;
+
+  struct dirent *entry;
+  while ((entry = readdir(tasks)) != NULL) {
+    if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+      continue;
+
+    pid_t tid = (pid_t)atoi(entry->d_name);
+    if (tracker->running && tid == tracker->poller_tid)
+      continue;
+
+    uint64_t start_time = perf_read_thread_start_time(tid);
+    if (start_time == 0)
+      continue;
+
+    // A tid may be reused by a new thread between two updates. The old thread is left
+    // unmarked, so that it is finalized as exited below
+    perf_tracked_thread_t *thread = tracker->threads;
+    while (thread != NULL && (thread->tid != tid || thread->start_time != start_time))
+      thread = thread->next;
+
+    if (thread != NULL) {
+      thread->generation = tracker->generation;
+      continue;
+    }
+
+    thread = perf_attach_thread(tracker, tid, start_time);
+    if (thread == NULL)
+      continue;
+
+    thread->next = tracker->threads;
+    tracker->threads = thread;
+    tracker->size++;
+    attached++;
+  }
+  closedir(tasks);
+
+  // Threads no longer listed have exited. Their counters remain readable until closed
+  size_t size = tracker->prototype->size;
+  perf_tracked_thread_t **link = &tracker->threads;
+  while (*link != NULL) {
+    perf_tracked_thread_t *thread = *link;
+    if (thread->generation == tracker->generation) {
+      link = &thread->next;
+      continue;
+    }
+
+    if (perf_read_group(thread->group) == 0) {
+      for (size_t i = 0; i < size; i++)
+        tracker->exited[i] += thread->group->values[i];
+    }
+    tracker->exited_count++;
+
+    *link = thread->next;
+    tracker->size--;
+    perf_free_tracked_thread(thread);
+  }
+
+  return attached;
+}
+
+int perf_update_thread_tracker(perf_thread_tracker_t *tracker) {
+  pthread_mutex_lock(&tracker->lock);
+  int status = perf_update_thread_tracker_locked(tracker);
+  pthread_mutex_unlock(&tracker->lock);
+  return status;
+}
+
+int perf_read_thread_tracker(perf_thread_tracker_t *tracker) {
+  pthread_mutex_lock(&tracker->lock);
+
+  size_t size = tracker->prototype->size;
+  memcpy((void *)tracker->totals, (const void *)tracker->exited, sizeof(uint64_t) * size);
+
+  for (perf_tracked_thread_t *thread = tracker->threads; thread != NULL; thread = thread->next) {
+    int status = perf_read_group(thread->group);
+    if (status < 0) {
+      pthread_mutex_unlock(&tracker->lock);
+      return status;
+    }
+
+    for (size_t i = 0; i < size; i++)
+      tracker->totals[i] += thread->group->values[i];
+  }
+
+  pthread_mutex_unlock(&tracker->lock);
+  return 0;
+}
+
+static void *perf_thread_tracker_poll(void *argument) {
+  perf_thread_tracker_t *tracker = (perf_thread_tracker_t *)argument;
+
+  pthread_mutex_lock(&tracker->lock);
+  tracker->poller_tid = (pid_t)syscall(SYS_gettid);
+  while (tracker->running) {
+    perf_update_thread_tracker_locked(tracker);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += tracker->interval / 1000;
+    deadline.tv_nsec += (long)(tracker->interval % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    // Sleeps without holding the lock, so the tracker may be read meanwhile
+    pthread_cond_timedwait(&tracker->wake, &tracker->lock, &deadline);
+  }
+  pthread_mutex_unlock(&tracker->lock);
+
+  return NULL;
+}
+
+int perf_start_thread_tracker(perf_thread_tracker_t *tracker, int interval) {
+  pthread_mutex_lock(&tracker->lock);
+  if (tracker->running) {
+    pthread_mutex_unlock(&tracker->lock);
+    return PERF_ERROR_BAD_PARAMETERS;
+  }
+  tracker->running = 1;
+  tracker->interval = interval;
+  pthread_mutex_unlock(&tracker->lock);
+
+  if (pthread_create(&tracker->poller, NULL, perf_thread_tracker_poll, tracker) != 0) {
+    tracker->running = 0;
+    return PERF_ERROR_LIBRARY_FAILURE;
+  }
+
+  return 0;
+}
+
+int perf_stop_thread_tracker(perf_thread_tracker_t *tracker) {
+  pthread_mutex_lock(&tracker->lock);
+  if (!tracker->running) {
+    pthread_mutex_unlock(&tracker->lock);
+    return PERF_ERROR_BAD_PARAMETERS;
+  }
+  tracker->running = 0;
+  pthread_cond_signal(&tracker->wake);
+  pthread_mutex_unlock(&tracker->lock);
+
+  if (pthread_join(tracker->poller, NULL) != 0)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  int status = perf_update_thread_tracker(tracker);
+  return status < 0 ? status : 0;
+}
+
+static void perf_print_thread_row(const char *tid, const char *name, const uint64_t *values, size_t size, FILE *output) {
+  fprintf(output, "%8s  %-16s", tid, name);
+  for (size_t i = 0; i < size; i++)
+    fprintf(output, "%20" PRIu64, values[i]);
+  fprintf(output, "\n");
+}
+
+void perf_print_thread_tracker(perf_thread_tracker_t *tracker, FILE *output) {
+  pthread_mutex_lock(&tracker->lock);
+
+  size_t size = tracker->prototype->size;
+  fprintf(output, "%8s  %-16s", "tid", "name");
+  for (size_t i = 0; i < size; i++)
+    fprintf(output, "%20s", tracker->prototype->names[i]);
+  fprintf(output, "\n");
+
+  for (const perf_tracked_thread_t *thread = tracker->threads; thread != NULL; thread = thread->next) {
+    char tid[16];
+    snprintf(tid, sizeof(tid), "%d", thread->tid);
+    perf_print_thread_row(tid, thread->name, thread->group->values, size, output);
+  }
+
+  char exited[32];
+  snprintf(exited, sizeof(exited), "%zu threads", tracker->exited_count);
+  perf_print_thread_row("exited", exited, tracker->exited, size, output);
+  perf_print_thread_row("total", "", tracker->totals, size, output);
+
+  pthread_mutex_unlock(&tracker->lock);
+}
+
+void perf_free_thread_tracker(perf_thread_tracker_t *tracker) {
+  perf_tracked_thread_t *thread = tracker->threads;
+  while (thread != NULL) {
+    perf_tracked_thread_t *next = thread->next;
+    perf_free_tracked_thread(thread);
+    thread = next;
+  }
+
+  pthread_mutex_destroy(&tracker->lock);
+  pthread_cond_destroy(&tracker->wake);
+  free((void *)tracker->prototype);
+  free((void *)tracker->exited);
+  free((void *)tracker->totals);
+  free((void *)tracker);
+}
@@ -0,0 +1,85 @@
+#ifndef PERF_THREAD_TRACKER_H
+#define PERF_THREAD_TRACKER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "group.h"
+
+// A thread measured by a thread tracker. Owned by the tracker.
+typedef struct perf_tracked_thread {
+  pid_t tid;
+  // The start time of the thread in clock ticks since boot, telling a reused tid apart
+  uint64_t start_time;
+  // The name of the thread as of when it was found, see pthread_setname_np
+  char name[16];
+  // The group of the thread, measuring only the thread itself
+  perf_group_t *group;
+  // The update which last found the thread
+  uint64_t generation;
+  // The next tracked thread
+  struct perf_tracked_thread *next;
+} perf_tracked_thread_t;
+
+// Measures every thread of the calling process, including threads created after the
+// tracker, by attaching a group to each thread found in /proc/self/task. Inherited
+// events can't be read as a group, so each thread gets a group of its own instead.
+typedef struct {
+  // The group cloned for each thread. Owned by the tracker
+  perf_group_t *prototype;
+  // The live threads
+  perf_tracked_thread_t *threads;
+  size_t size;
+  // The summed final values of exited threads, indexed by slot
+  uint64_t *exited;
+  size_t exited_count;
+  // The summed values of all threads as of the last read, indexed by slot
+  uint64_t *totals;
+  // Incremented by each update, marking the threads found
+  uint64_t generation;
+  // Guards all of the above. Held while updating, reading and printing
+  pthread_mutex_t lock;
+  // Signaled to wake the poller when stopping
+  pthread_cond_t wake;
+  // The background poller, which is never measured
+  pthread_t poller;
+  pid_t poller_tid;
+  int running;
+  // The interval of the poller in milliseconds
+  int interval;
+} perf_thread_tracker_t;
+
+// Create a tracker for the members of a prototype group. The prototype is copied
+// and may be freed once the tracker is created. Should be freed using perf_free_thread_tracker.
+// Returns NULL if an error occured.
+perf_thread_tracker_t *perf_create_thread_tracker(const perf_group_t *prototype);
+
+// Attach and start a group for each new thread, and read the final values of, and
+// close, the groups of threads which have exited. A thread is measured from the
+// update which finds it, so threads living shorter than the interval between updates may be missed.
+// Returns <0 if an error occured, the number of attached threads otherwise.
+int perf_update_thread_tracker(perf_thread_tracker_t *tracker);
+
+// Read the group of each live thread and sum the values of all threads, including
+// exited threads, into totals.
+// Returns <0 if an error occured.
+int perf_read_thread_tracker(perf_thread_tracker_t *tracker);
+
+// Start a background poller, updating the tracker every interval milliseconds.
+// Returns <0 if an error occured.
+int perf_start_thread_tracker(perf_thread_tracker_t *tracker, int interval);
+
+// Stop the background poller and update the tracker a final time.
+// Returns <0 if an error occured.
+int perf_stop_thread_tracker(perf_thread_tracker_t *tracker);
+
+// Print the values of each live thread, of exited threads and of all threads, as of the last read.
+void perf_print_thread_tracker(perf_thread_tracker_t *tracker, FILE *output);
+
+// Close all groups and free the tracker. The poller must be stopped.
+void perf_free_thread_tracker(perf_thread_tracker_t *tracker);
+
+#endif
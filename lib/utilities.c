@@ -7,6 +7,7 @@
 #include <sys/utsname.h>
 #include <unistd.h>
 
+#include "environment.h"
 #include "perf.h"
 #include "utilities.h"
 
@@ -39,6 +40,9 @@ void perf_print_error(int error) {
   case PERF_ERROR_BAD_PARAMETERS:
     fprintf(stderr, "bad parameters\n");
     break;
+  case PERF_ERROR_INSUFFICIENT_PRIVILEGE:
+    fprintf(stderr, "insufficient privilege\n");
+    break;
   default:
     fprintf(stderr, "unknown error\n");
     break;
@@ -56,9 +60,15 @@ int perf_get_event_paranoia() {
     return PERF_ERROR_IO;
 
   int value;
-  if (fscanf(perf_event_paranoid, "%d", &value) < 1)
+  int matched = fscanf(perf_event_paranoid, "%d", &value);
+  fclose(perf_event_paranoid);
+  if (matched < 1)
     return PERF_ERROR_IO;
 
+  return perf_event_paranoia_flags(value);
+}
+
+int perf_event_paranoia_flags(int value) {
   if (value >= 2)
     return PERF_EVENT_PARANOIA_DISALLOW_CPU | PERF_EVENT_PARANOIA_DISALLOW_FTRACE | PERF_EVENT_PARANOIA_DISALLOW_KERNEL;
   if (value >= 1)
@@ -69,24 +79,25 @@ int perf_get_event_paranoia() {
 }
 
 int perf_has_sufficient_privilege(const perf_measurement_t *measurement) {
+  // Capabilities, paranoia and kernel version are read once per process
+  const perf_environment_t *environment = perf_get_environment();
+
   // Immediately return if the user is an admin
-  int has_cap_sys_admin = perf_has_capability(CAP_SYS_ADMIN);
+  int has_cap_sys_admin = environment->has_cap_sys_admin;
   if (has_cap_sys_admin == 1)
     return true;
 
-  int event_paranoia = perf_get_event_paranoia();
+  int event_paranoia = environment->event_paranoia;
   if (event_paranoia < 0)
     return event_paranoia;
 
   // This requires CAP_PERFMON (since Linux 5.8) or CAP_SYS_ADMIN capability or a  perf_event_paranoid value of less than 1.
   if (measurement->pid == -1 && measurement->cpu >= 0) {
-    int kernel_major, kernel_minor;
-    int status = perf_get_kernel_version(&kernel_major, &kernel_minor, NULL);
-    if (status != true)
-      return status;
+    if (environment->kernel_major < 0)
+      return PERF_ERROR_IO;
 
-    if (kernel_major >= 5 && kernel_minor >= 8) {
-      int has_cap_perfmon = perf_has_capability(CAP_PERFMON);
+    if (environment->kernel_major > 5 || (environment->kernel_major == 5 && environment->kernel_minor >= 8)) {
+      int has_cap_perfmon = environment->has_cap_perfmon;
       if (has_cap_perfmon != true)
         return has_cap_perfmon;
     } else {
@@ -132,7 +143,7 @@ int perf_has_capability(int capability) {
   return sys_admin_value == CAP_SET;
 }
 
-perf_measurement_t *perf_create_measurement(int type, int config, pid_t pid, int cpu) {
+perf_measurement_t *perf_create_measurement(int type, uint64_t config, pid_t pid, int cpu) {
   perf_measurement_t *measurement = (perf_measurement_t *)malloc(sizeof(perf_measurement_t));
   if (measurement == NULL)
     return NULL;
@@ -142,6 +153,8 @@ perf_measurement_t *perf_create_measurement(int type, int config, pid_t pid, int
   measurement->pid = pid;
   measurement->cpu = cpu;
 
+  // The size identifies the version of the attribute structure to the kernel
+  measurement->attribute.size = sizeof(perf_event_attr_t);
   measurement->attribute.type = type;
   measurement->attribute.config = config;
   measurement->attribute.disabled = 1;
@@ -154,6 +167,9 @@ int perf_open_measurement(perf_measurement_t *measurement, int group, int flags)
   // Invalid parameters. See: https://man7.org/linux/man-pages/man2/perf_event_open.2.html
   if (measurement->pid == -1 && measurement->cpu == -1)
     return PERF_ERROR_BAD_PARAMETERS;
+  // The pid of a cgroup measurement is the file descriptor of the cgroup, which is only measured per CPU
+  if ((flags & PERF_FLAG_PID_CGROUP) && (measurement->pid < 0 || measurement->cpu < 0))
+    return PERF_ERROR_BAD_PARAMETERS;
 
   int file_descriptor = perf_event_open(&measurement->attribute, measurement->pid, measurement->cpu, group, flags);
   if (file_descriptor < 0) {
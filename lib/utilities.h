@@ -7,6 +7,12 @@
 
 #include "perf.h"
 
+// PERF_FORMAT_LOST was added in Linux 6.0. It's an enumerator of linux/perf_event.h,
+// included above, so defining it never clashes with its declaration
+#ifndef PERF_FORMAT_LOST
+#define PERF_FORMAT_LOST (1U << 4)
+#endif
+
 // An IO error occured. Use errno to gather more information
 #define PERF_ERROR_IO -1
 // A call to a library method failed. Use errno to gather more information
@@ -19,6 +25,8 @@
 #define PERF_ERROR_BAD_PARAMETERS -5
 // The event is not supported, or invalid
 #define PERF_ERROR_NOT_SUPPORTED -6
+// The calling user lacks the privilege to perform the measurement
+#define PERF_ERROR_INSUFFICIENT_PRIVILEGE -7
 
 typedef struct {
   // The attribute for the measurement
@@ -52,13 +60,16 @@ int perf_is_supported();
 // Prints an error.
 void perf_print_error(int error);
 
+// Get the PERF_EVENT_PARANOIA_ flags of a raw perf_event_paranoid value.
+int perf_event_paranoia_flags(int value);
+
 // Reads the currently configured event paranoia.
 // Returns <0 if an error occured, a PERF_EVENT_PARANOIA_ value otherwise.
 // Note: does not return the actually configured paranoia value.
 int perf_get_event_paranoia();
 
 // Returns whether or not the current user has sufficient privilege for using the
-// perf API.
+// perf API. Uses the cached snapshot of perf_get_environment.
 // Returns <0 if an error occured.
 int perf_has_sufficient_privilege(const perf_measurement_t *measurement);
 
@@ -73,8 +84,10 @@ int perf_has_capability(int capability);
 // pid > 0 and cpu >= 0 This measures the specified process / thread only when running on the specified CPU.
 // pid == -1 and cpu >= 0 This measures all processes / threads on the specified CPU.This requires CAP_PERFMON(since Linux 5.8) or CAP_SYS_ADMIN capability or a event paranoia value of less than 1.
 // pid  == -1 and cpu == -1 This setting is invalid and will return an error.
+// When opened with PERF_FLAG_PID_CGROUP, pid is instead the file descriptor of a cgroup directory,
+// measuring all of the cgroup's processes on the specified CPU. cpu must then be >= 0.
 // Returns NULL if an error occured.
-perf_measurement_t *perf_create_measurement(int type, int config, pid_t pid, int cpu);
+perf_measurement_t *perf_create_measurement(int type, uint64_t config, pid_t pid, int cpu);
 
 // Open a measurement to prepare it for usage.
 // An opened measurement should be closed using perf_close_measurement.
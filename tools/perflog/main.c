@@ -0,0 +1,125 @@
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <perf/log.h>
+#include <perf/statistics.h>
+#include <perf/utilities.h>
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-r] [-f interval] log\n", name);
+  fprintf(stderr, "  -r           print each record as CSV instead of a summary\n");
+  fprintf(stderr, "  -f interval  follow the log as it's written, printing new records every interval milliseconds\n");
+}
+
+static void print_record_header(const perf_log_reader_t *reader) {
+  printf("timestamp,time_enabled,time_running");
+  for (size_t i = 0; i < reader->header->events; i++)
+    printf(",%s", reader->names[i]);
+  printf("\n");
+}
+
+static void print_records(const perf_log_reader_t *reader, size_t start) {
+  for (size_t i = start; i < reader->size; i++) {
+    const perf_log_record_t *record = perf_log_record(reader, i);
+    printf("%" PRIu64 ",%" PRIu64 ",%" PRIu64, record->timestamp, record->time_enabled, record->time_running);
+    for (size_t j = 0; j < reader->header->events; j++)
+      printf(",%" PRIu64, record->values[j]);
+    printf("\n");
+  }
+}
+
+static int print_summary(const perf_log_reader_t *reader) {
+  perf_statistics_t *statistics = perf_create_statistics(reader->header->events);
+  if (statistics == NULL)
+    return PERF_ERROR_LIBRARY_FAILURE;
+
+  perf_aggregate_log(reader, statistics);
+
+  time_t start = (time_t)(reader->header->start_time / 1000000000);
+  char date[64];
+  strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&start));
+
+  uint64_t duration = reader->size > 0 ? perf_log_record(reader, reader->size - 1)->timestamp : 0;
+  printf("started: %s\n", date);
+  printf("records: %zu over %.3fs\n", reader->size, (double)duration / 1e9);
+  printf("%s\n\n", reader->header->flags & PERF_LOG_CUMULATIVE ? "cumulative" : "interval");
+  perf_print_statistics(statistics, reader->names, stdout);
+
+  free((void *)statistics);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int records = 0;
+  int follow = 0;
+
+  int option;
+  while ((option = getopt(argc, argv, "rf:h")) != -1) {
+    switch (option) {
+    case 'r':
+      records = 1;
+      break;
+    case 'f':
+      follow = atoi(optarg);
+      if (follow < 1) {
+        fprintf(stderr, "error: invalid interval: %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'h':
+      usage(argv[0]);
+      return EXIT_SUCCESS;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  perf_log_reader_t *reader = perf_open_log(argv[optind]);
+  if (reader == NULL) {
+    perror("unable to open log");
+    return EXIT_FAILURE;
+  }
+
+  if (follow > 0) {
+    print_record_header(reader);
+    size_t printed = 0;
+    struct timespec interval = {follow / 1000, (long)(follow % 1000) * 1000000};
+    for (;;) {
+      print_records(reader, printed);
+      printed = reader->size;
+      fflush(stdout);
+
+      nanosleep(&interval, NULL);
+      int status = perf_refresh_log(reader);
+      if (status < 0) {
+        perf_print_error(status);
+        perf_close_log_reader(reader);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  if (records) {
+    print_record_header(reader);
+    print_records(reader, 0);
+  } else {
+    int status = print_summary(reader);
+    if (status < 0) {
+      perf_print_error(status);
+      perf_close_log_reader(reader);
+      return EXIT_FAILURE;
+    }
+  }
+
+  perf_close_log_reader(reader);
+  return EXIT_SUCCESS;
+}
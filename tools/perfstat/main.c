@@ -0,0 +1,348 @@
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <perf/events.h>
+#include <perf/group.h>
+#include <perf/statistics.h>
+#include <perf/utilities.h>
+
+#define DEFAULT_EVENTS "task-clock,context-switches,cpu-migrations,page-faults,cycles,instructions,branches,branch-misses"
+
+// The measurements of a single run of the command
+typedef struct {
+  // The measurement of each event. NULL if the event is not supported
+  perf_measurement_t **measurements;
+  // The values of each event, scaled to the time enabled
+  uint64_t *values;
+  // The share of the enabled time each event was actually counting
+  double *ratios;
+  // The wall time of the run in nanoseconds
+  uint64_t duration;
+  // The exit status of the command
+  int status;
+} run_t;
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-e events] [-r repeats] [-j] [-o output] command [arguments...]\n", name);
+  fprintf(stderr, "  -e events   comma separated list of events (default: %s)\n", DEFAULT_EVENTS);
+  fprintf(stderr, "  -r repeats  run the command repeats times and print the mean and stddev (default: 1)\n");
+  fprintf(stderr, "  -j          write JSON instead of a table\n");
+  fprintf(stderr, "  -o output   write to a file instead of stderr\n");
+}
+
+static uint64_t now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+}
+
+// Write a JSON string, escaping quotes, backslashes and control characters
+static void write_json_string(FILE *output, const char *string) {
+  fputc('"', output);
+  for (const char *c = string; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\')
+      fprintf(output, "\\%c", *c);
+    else if ((unsigned char)*c < 0x20)
+      fprintf(output, "\\u%04x", (unsigned char)*c);
+    else
+      fputc(*c, output);
+  }
+  fputc('"', output);
+}
+
+// Run the command once, counting the events of it and all of its children.
+// Returns <0 if an error occured.
+static int run_command(char **command, const perf_event_list_t *events, run_t *run) {
+  // The child waits for the events to be opened before executing the command
+  int ready[2];
+  if (pipe(ready) < 0)
+    return PERF_ERROR_IO;
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(ready[0]);
+    close(ready[1]);
+    return PERF_ERROR_LIBRARY_FAILURE;
+  }
+
+  if (pid == 0) {
+    close(ready[1]);
+    // Closing the pipe without writing means the events could not be opened
+    char go;
+    if (read(ready[0], &go, 1) != 1)
+      _exit(127);
+    close(ready[0]);
+
+    signal(SIGINT, SIG_DFL);
+    execvp(command[0], command);
+    fprintf(stderr, "error: unable to execute %s: %s\n", command[0], strerror(errno));
+    _exit(127);
+  }
+
+  close(ready[0]);
+
+  for (size_t i = 0; i < events->size; i++) {
+    run->measurements[i] = NULL;
+
+    perf_measurement_t *measurement = perf_create_measurement(events->attributes[i].type, events->attributes[i].config, pid, -1);
+    if (measurement == NULL)
+      continue;
+
+    measurement->attribute = events->attributes[i];
+    // Count the command from the moment it's executed, including the children it creates.
+    // Inherited events may not be read as a group, so each event is opened on its own
+    measurement->attribute.disabled = 1;
+    measurement->attribute.enable_on_exec = 1;
+    measurement->attribute.inherit = 1;
+    measurement->attribute.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    if (perf_open_measurement(measurement, -1, PERF_FLAG_FD_CLOEXEC) < 0) {
+      free((void *)measurement);
+      continue;
+    }
+
+    run->measurements[i] = measurement;
+  }
+
+  uint64_t start = now();
+  // Releases the child
+  char go = 1;
+  if (write(ready[1], &go, 1) != 1) {
+    close(ready[1]);
+    waitpid(pid, NULL, 0);
+    return PERF_ERROR_IO;
+  }
+  close(ready[1]);
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR)
+      return PERF_ERROR_LIBRARY_FAILURE;
+  }
+  run->duration = now() - start;
+
+  if (WIFEXITED(status))
+    run->status = WEXITSTATUS(status);
+  else if (WIFSIGNALED(status))
+    run->status = 128 + WTERMSIG(status);
+  else
+    run->status = 1;
+
+  for (size_t i = 0; i < events->size; i++) {
+    run->values[i] = 0;
+    run->ratios[i] = 0;
+
+    perf_measurement_t *measurement = run->measurements[i];
+    if (measurement == NULL)
+      continue;
+
+    // { value, time_enabled, time_running }
+    uint64_t buffer[3];
+    if (perf_read_measurement(measurement, buffer, sizeof(buffer)) == sizeof(buffer)) {
+      run->values[i] = perf_scale_value(buffer[0], buffer[1], buffer[2]);
+      run->ratios[i] = buffer[1] == 0 ? 0 : (double)buffer[2] / (double)buffer[1];
+    }
+
+    perf_close_measurement(measurement);
+    free((void *)measurement);
+  }
+
+  return 0;
+}
+
+static void print_table(FILE *output, char **command, int repeats, const perf_event_list_t *events, const int *supported, const perf_statistics_t *statistics, const double *ratios) {
+  fprintf(output, "\n Performance counter stats for '");
+  for (char **argument = command; *argument != NULL; argument++)
+    fprintf(output, argument == command ? "%s" : " %s", *argument);
+  if (repeats > 1)
+    fprintf(output, "' (%d runs):\n\n", repeats);
+  else
+    fprintf(output, "':\n\n");
+
+  for (size_t i = 0; i < events->size; i++) {
+    if (!supported[i]) {
+      fprintf(output, "%20s      %-25s\n", "<not supported>", events->names[i]);
+      continue;
+    }
+
+    const perf_statistic_t *statistic = &statistics->events[i];
+    fprintf(output, "%20.0f      %-25s", statistic->mean, events->names[i]);
+    if (repeats > 1 && statistic->mean > 0)
+      fprintf(output, " ( +- %6.2f%% )", 100 * perf_statistic_stddev(statistic) / statistic->mean);
+    // Events that did not count the entire time were multiplexed and scaled
+    if (ratios[i] < 0.9999)
+      fprintf(output, "  (%.2f%%)", 100 * ratios[i]);
+    fprintf(output, "\n");
+  }
+
+  const perf_statistic_t *duration = &statistics->events[events->size];
+  fprintf(output, "\n%20.9f seconds time elapsed", duration->mean / 1e9);
+  if (repeats > 1 && duration->mean > 0)
+    fprintf(output, " ( +- %6.2f%% )", 100 * perf_statistic_stddev(duration) / duration->mean);
+  fprintf(output, "\n\n");
+}
+
+static void print_json(FILE *output, char **command, int repeats, const perf_event_list_t *events, const int *supported, const perf_statistics_t *statistics, const double *ratios, const uint64_t *values) {
+  fprintf(output, "{\"command\":[");
+  for (char **argument = command; *argument != NULL; argument++) {
+    if (argument != command)
+      fputc(',', output);
+    write_json_string(output, *argument);
+  }
+  fprintf(output, "],\"runs\":%d,\"events\":[", repeats);
+
+  for (size_t i = 0; i < events->size; i++) {
+    if (i > 0)
+      fputc(',', output);
+    fprintf(output, "{\"name\":");
+    write_json_string(output, events->names[i]);
+    if (!supported[i]) {
+      fprintf(output, ",\"supported\":false}");
+      continue;
+    }
+
+    const perf_statistic_t *statistic = &statistics->events[i];
+    fprintf(output, ",\"supported\":true,\"mean\":%.3f,\"stddev\":%.3f,\"min\":%" PRIu64 ",\"max\":%" PRIu64 ",\"running_ratio\":%.6f,\"values\":[",
+            statistic->mean, perf_statistic_stddev(statistic), statistic->min, statistic->max, ratios[i]);
+    for (int run = 0; run < repeats; run++)
+      fprintf(output, run == 0 ? "%" PRIu64 : ",%" PRIu64, values[run * events->size + i]);
+    fprintf(output, "]}");
+  }
+
+  const perf_statistic_t *duration = &statistics->events[events->size];
+  fprintf(output, "],\"duration\":{\"mean\":%.0f,\"stddev\":%.0f,\"min\":%" PRIu64 ",\"max\":%" PRIu64 "}}\n",
+          duration->mean, perf_statistic_stddev(duration), duration->min, duration->max);
+}
+
+int main(int argc, char **argv) {
+  const char *specification = DEFAULT_EVENTS;
+  const char *output_path = NULL;
+  int repeats = 1;
+  int json = 0;
+
+  // + stops at the first non-option, leaving the options of the command untouched
+  int option;
+  while ((option = getopt(argc, argv, "+e:r:jo:h")) != -1) {
+    switch (option) {
+    case 'e':
+      specification = optarg;
+      break;
+    case 'r':
+      repeats = atoi(optarg);
+      if (repeats < 1) {
+        fprintf(stderr, "error: invalid number of repeats: %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'j':
+      json = 1;
+      break;
+    case 'o':
+      output_path = optarg;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return EXIT_SUCCESS;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind == argc) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  char **command = &argv[optind];
+
+  perf_event_list_t *events;
+  int status = perf_parse_event_list(specification, &events);
+  if (status < 0) {
+    fprintf(stderr, "error: invalid event list: %s\n", specification);
+    perf_print_error(status);
+    return EXIT_FAILURE;
+  }
+
+  FILE *output = stderr;
+  if (output_path != NULL) {
+    output = fopen(output_path, "w");
+    if (output == NULL) {
+      perror("unable to open output");
+      return EXIT_FAILURE;
+    }
+  }
+
+  // The last slot holds the wall time
+  perf_statistics_t *statistics = perf_create_statistics(events->size + 1);
+  perf_measurement_t **measurements = (perf_measurement_t **)malloc(sizeof(perf_measurement_t *) * events->size);
+  uint64_t *values = (uint64_t *)malloc(sizeof(uint64_t) * events->size * repeats);
+  double *ratios = (double *)calloc(events->size, sizeof(double));
+  double *run_ratios = (double *)malloc(sizeof(double) * events->size);
+  int *supported = (int *)calloc(events->size, sizeof(int));
+  if (statistics == NULL || measurements == NULL || values == NULL || ratios == NULL || run_ratios == NULL || supported == NULL) {
+    perror("unable to allocate");
+    return EXIT_FAILURE;
+  }
+
+  // The command handles interrupts, the counters are read once it has exited
+  signal(SIGINT, SIG_IGN);
+
+  int exit_status = 0;
+  for (int i = 0; i < repeats; i++) {
+    run_t run = {
+        .measurements = measurements,
+        .values = &values[i * events->size],
+        .ratios = run_ratios,
+    };
+
+    status = run_command(command, events, &run);
+    if (status < 0) {
+      perf_print_error(status);
+      return EXIT_FAILURE;
+    }
+
+    for (size_t j = 0; j < events->size; j++) {
+      if (measurements[j] == NULL)
+        continue;
+      supported[j] = 1;
+      perf_statistic_add(&statistics->events[j], run.values[j]);
+      ratios[j] += run.ratios[j];
+    }
+    perf_statistic_add(&statistics->events[events->size], run.duration);
+
+    exit_status = run.status;
+    // A failing command would make further runs meaningless
+    if (exit_status != 0)
+      break;
+  }
+
+  int runs = (int)statistics->events[events->size].count;
+  for (size_t i = 0; i < events->size; i++)
+    ratios[i] /= runs;
+
+  if (json)
+    print_json(output, command, runs, events, supported, statistics, ratios, values);
+  else
+    print_table(output, command, runs, events, supported, statistics, ratios);
+
+  if (output != stderr)
+    fclose(output);
+
+  free((void *)statistics);
+  free((void *)measurements);
+  free((void *)values);
+  free((void *)ratios);
+  free((void *)run_ratios);
+  free((void *)supported);
+  free((void *)events);
+
+  return exit_status;
+}